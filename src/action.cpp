@@ -27,6 +27,12 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
+#include <vector>
+
+#include <boost/foreach.hpp>
+#define foreach BOOST_FOREACH
+
 #include <compiz.h>
 
 #include <core/option.h>
@@ -642,3 +648,83 @@ PrivateAction::PrivateAction (const PrivateAction& a) :
 {
     memcpy (&priv, &a.priv, sizeof (CompPrivate));
 }
+
+static const char *actionArgumentNames[ActionArguments::SlotNum] = {
+    "event_window", "window", "modifiers", "x", "y", "root",
+    "button", "keycode", "time"
+};
+
+/* every argument vector core built, the name lookup is skipped for them */
+static std::vector<ActionArguments *> actionArguments;
+
+ActionArguments::ActionArguments (unsigned int nCommon,
+				  Slot         extra1,
+				  Slot         extra2) :
+    vector (),
+    count (0)
+{
+    for (int i = 0; i < SlotNum; i++)
+	index[i] = -1;
+
+    for (unsigned int i = 0; i < nCommon; i++)
+	add ((Slot) i);
+
+    if (extra1 != SlotNum)
+	add (extra1);
+    if (extra2 != SlotNum)
+	add (extra2);
+
+    count = vector.size ();
+
+    actionArguments.push_back (this);
+}
+
+ActionArguments::~ActionArguments ()
+{
+    actionArguments.erase (std::find (actionArguments.begin (),
+				      actionArguments.end (), this));
+}
+
+void
+ActionArguments::add (Slot slot)
+{
+    index[slot] = vector.size ();
+    vector.push_back (CompOption (actionArgumentNames[slot],
+				  CompOption::TypeInt));
+}
+
+CompOption::Vector &
+ActionArguments::options ()
+{
+    return vector;
+}
+
+void
+ActionArguments::set (Slot slot,
+		      int  value)
+{
+    vector[index[slot]].value ().set (value);
+}
+
+int
+ActionArguments::get (CompOption::Vector &options,
+		      Slot               slot,
+		      int                defaultValue)
+{
+    foreach (ActionArguments *args, actionArguments)
+    {
+	if (&args->vector != &options)
+	    continue;
+
+	if (options.size () != args->count)
+	    break;
+
+	if (args->index[slot] < 0)
+	    return defaultValue;
+
+	return options[args->index[slot]].value ().i ();
+    }
+
+    return CompOption::getIntOptionNamed (options, actionArgumentNames[slot],
+					  defaultValue);
+}
@@ -0,0 +1,210 @@
+/*
+ * Copyright © 2008 Dennis Kasprzyk
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the name of
+ * Dennis Kasprzyk not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior permission.
+ * Dennis Kasprzyk makes no representations about the suitability of this
+ * software for any purpose. It is provided "as is" without express or
+ * implied warranty.
+ *
+ * DENNIS KASPRZYK DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL DENNIS KASPRZYK BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION
+ * WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Dennis Kasprzyk <onestone@compiz-fusion.org>
+ */
+
+#include <algorithm>
+
+#include <boost/foreach.hpp>
+#define foreach BOOST_FOREACH
+
+#include <core/core.h>
+#include "privateactionindex.h"
+
+static bool
+bindingBefore (const ActionIndex::Binding &a,
+	       const ActionIndex::Binding &b)
+{
+    return a.seq < b.seq;
+}
+
+ActionIndex::ActionIndex () :
+    valid (false),
+    count (0)
+{
+}
+
+void
+ActionIndex::invalidate ()
+{
+    valid = false;
+}
+
+void
+ActionIndex::update ()
+{
+    unsigned int modMask;
+
+    if (valid)
+	return;
+
+    modMask = REAL_MOD_MASK & ~modHandler->ignoredModMask ();
+    count   = 0;
+
+    pluginBindings.clear ();
+    keyMap.clear ();
+    modifierKeyBindings.clear ();
+    modifiedKeyBindings.clear ();
+    buttonMap.clear ();
+    buttonReleaseMap.clear ();
+    bellBindings.clear ();
+    allBindings.clear ();
+
+    for (int i = 0; i < ACTION_INDEX_EDGE_BITS; i++)
+	edgeBindings[i].clear ();
+
+    foreach (CompPlugin *p, CompPlugin::getPlugins ())
+    {
+	pluginBindings.push_back (Bindings ());
+
+	foreach (CompOption &option, p->vTable->getOptions ())
+	    if (option.isAction ())
+		add (option, modMask);
+    }
+
+    valid = true;
+}
+
+void
+ActionIndex::add (CompOption   &option,
+		  unsigned int modMask)
+{
+    CompAction   &action = option.value ().action ();
+    Binding      binding = { count++, &option };
+    unsigned int keyMods, buttonMods;
+    int          keycode = action.key ().keycode ();
+
+    pluginBindings.back ().push_back (binding);
+    allBindings.push_back (binding);
+
+    keyMods = modHandler->virtualToRealModMask (action.key ().modifiers ());
+
+    if (keycode)
+    {
+	keyMap[Key (keycode, keyMods & modMask)].push_back (binding);
+    }
+    else
+    {
+	keyMap[Key (0, keyMods)].push_back (binding);
+	modifierKeyBindings.push_back (binding);
+    }
+
+    if (keyMods & modMask)
+	modifiedKeyBindings.push_back (binding);
+
+    buttonMods =
+	modHandler->virtualToRealModMask (action.button ().modifiers ());
+
+    buttonMap[Key (action.button ().button (),
+		   buttonMods & modMask)].push_back (binding);
+    buttonReleaseMap[Key (action.button ().button (), 0)].push_back (binding);
+
+    for (int i = 0; i < ACTION_INDEX_EDGE_BITS; i++)
+	if (action.edgeMask () & (1U << i))
+	    edgeBindings[i].push_back (binding);
+
+    if (action.bell ())
+	bellBindings.push_back (binding);
+}
+
+const ActionIndex::Bindings &
+ActionIndex::find (const Map &map,
+		   const Key &key) const
+{
+    Map::const_iterator it = map.find (key);
+
+    if (it == map.end ())
+	return none;
+
+    return it->second;
+}
+
+const std::vector<ActionIndex::Bindings> &
+ActionIndex::plugins () const
+{
+    return pluginBindings;
+}
+
+const ActionIndex::Bindings &
+ActionIndex::keys (int          keycode,
+		   unsigned int mods) const
+{
+    return find (keyMap, Key (keycode, mods));
+}
+
+const ActionIndex::Bindings &
+ActionIndex::modifierKeys () const
+{
+    return modifierKeyBindings;
+}
+
+const ActionIndex::Bindings &
+ActionIndex::modifiedKeys () const
+{
+    return modifiedKeyBindings;
+}
+
+const ActionIndex::Bindings &
+ActionIndex::buttons (int          button,
+		      unsigned int mods) const
+{
+    return find (buttonMap, Key (button, mods));
+}
+
+const ActionIndex::Bindings &
+ActionIndex::buttonReleases (int button) const
+{
+    return find (buttonReleaseMap, Key (button, 0));
+}
+
+const ActionIndex::Bindings &
+ActionIndex::edge (unsigned int mask) const
+{
+    for (int i = 0; i < ACTION_INDEX_EDGE_BITS; i++)
+	if (mask & (1U << i))
+	    return edgeBindings[i];
+
+    return none;
+}
+
+const ActionIndex::Bindings &
+ActionIndex::bells () const
+{
+    return bellBindings;
+}
+
+const ActionIndex::Bindings &
+ActionIndex::all () const
+{
+    return allBindings;
+}
+
+void
+ActionIndex::merge (const Bindings &a,
+		    const Bindings &b,
+		    Bindings       &result)
+{
+    result.resize (a.size () + b.size ());
+    std::merge (a.begin (), a.end (), b.begin (), b.end (),
+		result.begin (), bindingBefore);
+}
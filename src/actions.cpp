@@ -30,6 +30,7 @@
 #include <core/atoms.h>
 #include "privatescreen.h"
 #include "privatewindow.h"
+#include "privateaction.h"
 
 bool
 CompScreen::closeWin (CompAction         *action,
@@ -40,8 +41,9 @@ CompScreen::closeWin (CompAction         *action,
     Window       xid;
     unsigned int time;
 
-    xid  = CompOption::getIntOptionNamed (options, "window");
-    time = CompOption::getIntOptionNamed (options, "time", CurrentTime);
+    xid  = ActionArguments::get (options, ActionArguments::SlotWindow);
+    time = ActionArguments::get (options, ActionArguments::SlotTime,
+				 CurrentTime);
 
     w = screen->findTopLevelWindow (xid);
     if (w && (w->priv->actions  & CompWindowActionCloseMask))
@@ -58,7 +60,7 @@ CompScreen::unmaximizeWin (CompAction         *action,
     CompWindow *w;
     Window     xid;
 
-    xid = CompOption::getIntOptionNamed (options, "window");
+    xid = ActionArguments::get (options, ActionArguments::SlotWindow);
 
     w = screen->findTopLevelWindow (xid);
     if (w)
@@ -75,7 +77,7 @@ CompScreen::minimizeWin (CompAction         *action,
     CompWindow *w;
     Window     xid;
 
-    xid = CompOption::getIntOptionNamed (options, "window");
+    xid = ActionArguments::get (options, ActionArguments::SlotWindow);
 
     w = screen->findTopLevelWindow (xid);
     if (w && (w->actions () & CompWindowActionMinimizeMask))
@@ -92,7 +94,7 @@ CompScreen::maximizeWin (CompAction         *action,
     CompWindow *w;
     Window     xid;
 
-    xid = CompOption::getIntOptionNamed (options, "window");
+    xid = ActionArguments::get (options, ActionArguments::SlotWindow);
 
     w = screen->findTopLevelWindow (xid);
     if (w)
@@ -109,7 +111,7 @@ CompScreen::maximizeWinHorizontally (CompAction         *action,
     CompWindow *w;
     Window     xid;
 
-    xid = CompOption::getIntOptionNamed (options, "window");
+    xid = ActionArguments::get (options, ActionArguments::SlotWindow);
 
     w = screen->findTopLevelWindow (xid);
     if (w)
@@ -126,7 +128,7 @@ CompScreen::maximizeWinVertically (CompAction         *action,
     CompWindow *w;
     Window     xid;
 
-    xid = CompOption::getIntOptionNamed (options, "window");
+    xid = ActionArguments::get (options, ActionArguments::SlotWindow);
 
     w = screen->findTopLevelWindow (xid);
     if (w)
@@ -156,7 +158,7 @@ CompScreen::raiseWin (CompAction         *action,
     CompWindow *w;
     Window     xid;
 
-    xid = CompOption::getIntOptionNamed (options, "window");
+    xid = ActionArguments::get (options, ActionArguments::SlotWindow);
 
     w = screen->findTopLevelWindow (xid);
     if (w)
@@ -173,7 +175,7 @@ CompScreen::lowerWin (CompAction         *action,
     CompWindow *w;
     Window     xid;
 
-    xid = CompOption::getIntOptionNamed (options, "window");
+    xid = ActionArguments::get (options, ActionArguments::SlotWindow);
 
     w = screen->findTopLevelWindow (xid);
     if (w)
@@ -190,7 +192,7 @@ CompScreen::windowMenu (CompAction         *action,
     CompWindow *w;
     Window     xid;
 
-    xid = CompOption::getIntOptionNamed (options, "window");
+    xid = ActionArguments::get (options, ActionArguments::SlotWindow);
 
     w = screen->findTopLevelWindow (xid);
     if (w && screen->priv->grabs.empty ())
@@ -198,12 +200,13 @@ CompScreen::windowMenu (CompAction         *action,
 	int  x, y, button;
 	Time time;
 
-	time   = CompOption::getIntOptionNamed (options, "time", CurrentTime);
-	button = CompOption::getIntOptionNamed (options, "button", 0);
-	x      = CompOption::getIntOptionNamed (options, "x",
-						w->geometry ().x ());
-	y      = CompOption::getIntOptionNamed (options, "y",
-						w->geometry ().y ());
+	time   = ActionArguments::get (options, ActionArguments::SlotTime,
+				       CurrentTime);
+	button = ActionArguments::get (options, ActionArguments::SlotButton, 0);
+	x      = ActionArguments::get (options, ActionArguments::SlotX,
+				       w->geometry ().x ());
+	y      = ActionArguments::get (options, ActionArguments::SlotY,
+				       w->geometry ().y ());
 
 	screen->toolkitAction (Atoms::toolkitActionWindowMenu,
 			       time, w->id (), button, x, y);
@@ -220,7 +223,7 @@ CompScreen::toggleWinMaximized (CompAction         *action,
     CompWindow *w;
     Window     xid;
 
-    xid = CompOption::getIntOptionNamed (options, "window");
+    xid = ActionArguments::get (options, ActionArguments::SlotWindow);
 
     w = screen->findTopLevelWindow (xid);
     if (w)
@@ -242,7 +245,7 @@ CompScreen::toggleWinMaximizedHorizontally (CompAction         *action,
     CompWindow *w;
     Window     xid;
 
-    xid = CompOption::getIntOptionNamed (options, "window");
+    xid = ActionArguments::get (options, ActionArguments::SlotWindow);
 
     w = screen->findTopLevelWindow (xid);
     if (w)
@@ -259,7 +262,7 @@ CompScreen::toggleWinMaximizedVertically (CompAction         *action,
     CompWindow *w;
     Window     xid;
 
-    xid = CompOption::getIntOptionNamed (options, "window");
+    xid = ActionArguments::get (options, ActionArguments::SlotWindow);
 
     w = screen->findTopLevelWindow (xid);
     if (w)
@@ -276,7 +279,7 @@ CompScreen::shadeWin (CompAction         *action,
     CompWindow *w;
     Window     xid;
 
-    xid = CompOption::getIntOptionNamed (options, "window");
+    xid = ActionArguments::get (options, ActionArguments::SlotWindow);
 
     w = screen->findTopLevelWindow (xid);
     if (w && (w->priv->actions & CompWindowActionShadeMask))
@@ -25,7 +25,10 @@
  *          David Reveman <davidr@novell.com>
  */
 
+#include <vector>
+
 #include <core/atoms.h>
+#include "privateatoms.h"
 
 namespace Atoms {
     Atom supported;
@@ -153,172 +156,195 @@ namespace Atoms {
 
     Atom startupId;
 
+    struct Name {
+	const char *name;
+	Atom       *atom;
+    };
+
+    static const Name names[] = {
+	{ "_NET_SUPPORTED", &supported },
+	{ "_NET_SUPPORTING_WM_CHECK", &supportingWmCheck },
+
+	{ "UTF8_STRING", &utf8String },
+
+	{ "_NET_WM_NAME", &wmName },
+
+	{ "_NET_WM_WINDOW_TYPE", &winType },
+	{ "_NET_WM_WINDOW_TYPE_DESKTOP", &winTypeDesktop },
+	{ "_NET_WM_WINDOW_TYPE_DOCK", &winTypeDock },
+	{ "_NET_WM_WINDOW_TYPE_TOOLBAR", &winTypeToolbar },
+	{ "_NET_WM_WINDOW_TYPE_MENU", &winTypeMenu },
+	{ "_NET_WM_WINDOW_TYPE_UTILITY", &winTypeUtil },
+	{ "_NET_WM_WINDOW_TYPE_SPLASH", &winTypeSplash },
+	{ "_NET_WM_WINDOW_TYPE_DIALOG", &winTypeDialog },
+	{ "_NET_WM_WINDOW_TYPE_NORMAL", &winTypeNormal },
+
+	{ "_NET_WM_WINDOW_TYPE_DROPDOWN_MENU", &winTypeDropdownMenu },
+	{ "_NET_WM_WINDOW_TYPE_POPUP_MENU", &winTypePopupMenu },
+	{ "_NET_WM_WINDOW_TYPE_TOOLTIP", &winTypeTooltip },
+	{ "_NET_WM_WINDOW_TYPE_NOTIFICATION", &winTypeNotification },
+	{ "_NET_WM_WINDOW_TYPE_COMBO", &winTypeCombo },
+	{ "_NET_WM_WINDOW_TYPE_DND", &winTypeDnd },
+
+	{ "_NET_WM_WINDOW_OPACITY", &winOpacity },
+	{ "_NET_WM_WINDOW_BRIGHTNESS", &winBrightness },
+	{ "_NET_WM_WINDOW_SATURATION", &winSaturation },
+
+	{ "_NET_ACTIVE_WINDOW", &winActive },
+	{ "_NET_WM_DESKTOP", &winDesktop },
+	{ "_NET_WORKAREA", &workarea },
+
+	{ "_NET_DESKTOP_VIEWPORT", &desktopViewport },
+	{ "_NET_DESKTOP_GEOMETRY", &desktopGeometry },
+	{ "_NET_CURRENT_DESKTOP", &currentDesktop },
+	{ "_NET_NUMBER_OF_DESKTOPS", &numberOfDesktops },
+
+	{ "_NET_WM_STATE", &winState },
+	{ "_NET_WM_STATE_MODAL", &winStateModal },
+	{ "_NET_WM_STATE_STICKY", &winStateSticky },
+	{ "_NET_WM_STATE_MAXIMIZED_VERT", &winStateMaximizedVert },
+	{ "_NET_WM_STATE_MAXIMIZED_HORZ", &winStateMaximizedHorz },
+	{ "_NET_WM_STATE_SHADED", &winStateShaded },
+	{ "_NET_WM_STATE_SKIP_TASKBAR", &winStateSkipTaskbar },
+	{ "_NET_WM_STATE_SKIP_PAGER", &winStateSkipPager },
+	{ "_NET_WM_STATE_HIDDEN", &winStateHidden },
+	{ "_NET_WM_STATE_FULLSCREEN", &winStateFullscreen },
+	{ "_NET_WM_STATE_ABOVE", &winStateAbove },
+	{ "_NET_WM_STATE_BELOW", &winStateBelow },
+	{ "_NET_WM_STATE_DEMANDS_ATTENTION", &winStateDemandsAttention },
+	{ "_NET_WM_STATE_DISPLAY_MODAL", &winStateDisplayModal },
+
+	{ "_NET_WM_ACTION_MOVE", &winActionMove },
+	{ "_NET_WM_ACTION_RESIZE", &winActionResize },
+	{ "_NET_WM_ACTION_STICK", &winActionStick },
+	{ "_NET_WM_ACTION_MINIMIZE", &winActionMinimize },
+	{ "_NET_WM_ACTION_MAXIMIZE_HORZ", &winActionMaximizeHorz },
+	{ "_NET_WM_ACTION_MAXIMIZE_VERT", &winActionMaximizeVert },
+	{ "_NET_WM_ACTION_FULLSCREEN", &winActionFullscreen },
+	{ "_NET_WM_ACTION_CLOSE", &winActionClose },
+	{ "_NET_WM_ACTION_SHADE", &winActionShade },
+	{ "_NET_WM_ACTION_CHANGE_DESKTOP", &winActionChangeDesktop },
+	{ "_NET_WM_ACTION_ABOVE", &winActionAbove },
+	{ "_NET_WM_ACTION_BELOW", &winActionBelow },
+
+	{ "_NET_WM_ALLOWED_ACTIONS", &wmAllowedActions },
+
+	{ "_NET_WM_STRUT", &wmStrut },
+	{ "_NET_WM_STRUT_PARTIAL", &wmStrutPartial },
+
+	{ "_NET_WM_USER_TIME", &wmUserTime },
+
+	{ "_NET_WM_ICON", &wmIcon },
+	{ "_NET_WM_ICON_GEOMETRY", &wmIconGeometry },
+
+	{ "_NET_CLIENT_LIST", &clientList },
+	{ "_NET_CLIENT_LIST_STACKING", &clientListStacking },
+
+	{ "_NET_FRAME_EXTENTS", &frameExtents },
+	{ "_NET_FRAME_WINDOW", &frameWindow },
+
+	{ "WM_STATE", &wmState },
+	{ "WM_CHANGE_STATE", &wmChangeState },
+	{ "WM_PROTOCOLS", &wmProtocols },
+	{ "WM_CLIENT_LEADER", &wmClientLeader },
+
+	{ "WM_DELETE_WINDOW", &wmDeleteWindow },
+	{ "WM_TAKE_FOCUS", &wmTakeFocus },
+	{ "_NET_WM_PING", &wmPing },
+	{ "_NET_WM_SYNC_REQUEST", &wmSyncRequest },
+
+	{ "_NET_WM_SYNC_REQUEST_COUNTER", &wmSyncRequestCounter },
+
+	{ "_NET_WM_FULLSCREEN_MONITORS", &wmFullscreenMonitors },
+
+	{ "_NET_CLOSE_WINDOW", &closeWindow },
+	{ "_NET_WM_MOVERESIZE", &wmMoveResize },
+	{ "_NET_MOVERESIZE_WINDOW", &moveResizeWindow },
+	{ "_NET_RESTACK_WINDOW", &restackWindow },
+
+	{ "_NET_SHOWING_DESKTOP", &showingDesktop },
+
+	{ "_XSETROOT_ID", &xBackground[0] },
+	{ "_XROOTPMAP_ID", &xBackground[1] },
+
+	{ "_COMPIZ_TOOLKIT_ACTION", &toolkitAction },
+	{ "_COMPIZ_TOOLKIT_ACTION_WINDOW_MENU", &toolkitActionWindowMenu },
+	{ "_COMPIZ_TOOLKIT_ACTION_FORCE_QUIT_DIALOG", &toolkitActionForceQuitDialog },
+
+	{ "_MOTIF_WM_HINTS", &mwmHints },
+
+	{ "XdndAware", &xdndAware },
+	{ "XdndEnter", &xdndEnter },
+	{ "XdndLeave", &xdndLeave },
+	{ "XdndPosition", &xdndPosition },
+	{ "XdndStatus", &xdndStatus },
+	{ "XdndDrop", &xdndDrop },
+
+	{ "MANAGER", &manager },
+	{ "TARGETS", &targets },
+	{ "MULTIPLE", &multiple },
+	{ "TIMESTAMP", &timestamp },
+	{ "VERSION", &version },
+	{ "ATOM_PAIR", &atomPair },
+
+	{ "_NET_STARTUP_ID", &startupId }
+    };
+
+    /* names registered with add () that still need to be interned */
+    static std::vector<Name> pending;
+
+    static Display *display = NULL;
+
+    static void
+    intern (Display *dpy, const Name *list, unsigned int n)
+    {
+	std::vector<char *> atomNames (n);
+	std::vector<Atom>   atoms (n);
+	unsigned int        i;
+
+	if (!n)
+	    return;
+
+	for (i = 0; i < n; i++)
+	    atomNames[i] = const_cast<char *> (list[i].name);
+
+	XInternAtoms (dpy, &atomNames[0], n, 0, &atoms[0]);
+
+	for (i = 0; i < n; i++)
+	    *list[i].atom = atoms[i];
+    }
+
+    /* Queues an atom to be interned with the next batch: together with
+       the core atoms if called before init, otherwise on the next
+       flush (), which happens before any plugin is initialized. */
+    void add (const char *name, Atom *atom)
+    {
+	Name n = { name, atom };
+
+	pending.push_back (n);
+    }
+
+    void flush ()
+    {
+	std::vector<Name> list;
+
+	if (!display)
+	    return;
+
+	list.swap (pending);
+
+	if (!list.empty ())
+	    intern (display, &list[0], list.size ());
+    }
+
+    /* core and early registered atoms, in a single round trip */
     void init (Display *dpy)
     {
-	supported         = XInternAtom (dpy, "_NET_SUPPORTED", 0);
-	supportingWmCheck = XInternAtom (dpy, "_NET_SUPPORTING_WM_CHECK", 0);
-
-	utf8String = XInternAtom (dpy, "UTF8_STRING", 0);
-
-	wmName = XInternAtom (dpy, "_NET_WM_NAME", 0);
-
-	winType        = XInternAtom (dpy, "_NET_WM_WINDOW_TYPE", 0);
-	winTypeDesktop = XInternAtom (dpy, "_NET_WM_WINDOW_TYPE_DESKTOP",
-					     0);
-	winTypeDock    = XInternAtom (dpy, "_NET_WM_WINDOW_TYPE_DOCK", 0);
-	winTypeToolbar = XInternAtom (dpy, "_NET_WM_WINDOW_TYPE_TOOLBAR",
-					     0);
-	winTypeMenu    = XInternAtom (dpy, "_NET_WM_WINDOW_TYPE_MENU", 0);
-	winTypeUtil    = XInternAtom (dpy, "_NET_WM_WINDOW_TYPE_UTILITY",
-					     0);
-	winTypeSplash  = XInternAtom (dpy, "_NET_WM_WINDOW_TYPE_SPLASH", 0);
-	winTypeDialog  = XInternAtom (dpy, "_NET_WM_WINDOW_TYPE_DIALOG", 0);
-	winTypeNormal  = XInternAtom (dpy, "_NET_WM_WINDOW_TYPE_NORMAL", 0);
-
-	winTypeDropdownMenu =
-	    XInternAtom (dpy, "_NET_WM_WINDOW_TYPE_DROPDOWN_MENU", 0);
-	winTypePopupMenu    =
-	    XInternAtom (dpy, "_NET_WM_WINDOW_TYPE_POPUP_MENU", 0);
-	winTypeTooltip      =
-	    XInternAtom (dpy, "_NET_WM_WINDOW_TYPE_TOOLTIP", 0);
-	winTypeNotification =
-	    XInternAtom (dpy, "_NET_WM_WINDOW_TYPE_NOTIFICATION", 0);
-	winTypeCombo        =
-	    XInternAtom (dpy, "_NET_WM_WINDOW_TYPE_COMBO", 0);
-	winTypeDnd          =
-	    XInternAtom (dpy, "_NET_WM_WINDOW_TYPE_DND", 0);
-
-	winOpacity    = XInternAtom (dpy, "_NET_WM_WINDOW_OPACITY", 0);
-	winBrightness = XInternAtom (dpy, "_NET_WM_WINDOW_BRIGHTNESS", 0);
-	winSaturation = XInternAtom (dpy, "_NET_WM_WINDOW_SATURATION", 0);
-
-	winActive  = XInternAtom (dpy, "_NET_ACTIVE_WINDOW", 0);
-	winDesktop = XInternAtom (dpy, "_NET_WM_DESKTOP", 0);
-	workarea   = XInternAtom (dpy, "_NET_WORKAREA", 0);
-
-	desktopViewport  = XInternAtom (dpy, "_NET_DESKTOP_VIEWPORT", 0);
-	desktopGeometry  = XInternAtom (dpy, "_NET_DESKTOP_GEOMETRY", 0);
-	currentDesktop   = XInternAtom (dpy, "_NET_CURRENT_DESKTOP", 0);
-	numberOfDesktops = XInternAtom (dpy, "_NET_NUMBER_OF_DESKTOPS", 0);
-
-	winState	             = XInternAtom (dpy, "_NET_WM_STATE", 0);
-	winStateModal            =
-	    XInternAtom (dpy, "_NET_WM_STATE_MODAL", 0);
-	winStateSticky           =
-	    XInternAtom (dpy, "_NET_WM_STATE_STICKY", 0);
-	winStateMaximizedVert    =
-	    XInternAtom (dpy, "_NET_WM_STATE_MAXIMIZED_VERT", 0);
-	winStateMaximizedHorz    =
-	    XInternAtom (dpy, "_NET_WM_STATE_MAXIMIZED_HORZ", 0);
-	winStateShaded           =
-	    XInternAtom (dpy, "_NET_WM_STATE_SHADED", 0);
-	winStateSkipTaskbar      =
-	    XInternAtom (dpy, "_NET_WM_STATE_SKIP_TASKBAR", 0);
-	winStateSkipPager        =
-	    XInternAtom (dpy, "_NET_WM_STATE_SKIP_PAGER", 0);
-	winStateHidden           =
-	    XInternAtom (dpy, "_NET_WM_STATE_HIDDEN", 0);
-	winStateFullscreen       =
-	    XInternAtom (dpy, "_NET_WM_STATE_FULLSCREEN", 0);
-	winStateAbove            =
-	    XInternAtom (dpy, "_NET_WM_STATE_ABOVE", 0);
-	winStateBelow            =
-	    XInternAtom (dpy, "_NET_WM_STATE_BELOW", 0);
-	winStateDemandsAttention =
-	    XInternAtom (dpy, "_NET_WM_STATE_DEMANDS_ATTENTION", 0);
-	winStateDisplayModal     =
-	    XInternAtom (dpy, "_NET_WM_STATE_DISPLAY_MODAL", 0);
-
-	winActionMove          = XInternAtom (dpy, "_NET_WM_ACTION_MOVE", 0);
-	winActionResize        =
-	    XInternAtom (dpy, "_NET_WM_ACTION_RESIZE", 0);
-	winActionStick         =
-	    XInternAtom (dpy, "_NET_WM_ACTION_STICK", 0);
-	winActionMinimize      =
-	    XInternAtom (dpy, "_NET_WM_ACTION_MINIMIZE", 0);
-	winActionMaximizeHorz  =
-	    XInternAtom (dpy, "_NET_WM_ACTION_MAXIMIZE_HORZ", 0);
-	winActionMaximizeVert  =
-	    XInternAtom (dpy, "_NET_WM_ACTION_MAXIMIZE_VERT", 0);
-	winActionFullscreen    =
-	    XInternAtom (dpy, "_NET_WM_ACTION_FULLSCREEN", 0);
-	winActionClose         =
-	    XInternAtom (dpy, "_NET_WM_ACTION_CLOSE", 0);
-	winActionShade         =
-	    XInternAtom (dpy, "_NET_WM_ACTION_SHADE", 0);
-	winActionChangeDesktop =
-	    XInternAtom (dpy, "_NET_WM_ACTION_CHANGE_DESKTOP", 0);
-	winActionAbove         =
-	    XInternAtom (dpy, "_NET_WM_ACTION_ABOVE", 0);
-	winActionBelow         =
-	    XInternAtom (dpy, "_NET_WM_ACTION_BELOW", 0);
-
-	wmAllowedActions = XInternAtom (dpy, "_NET_WM_ALLOWED_ACTIONS", 0);
-
-	wmStrut        = XInternAtom (dpy, "_NET_WM_STRUT", 0);
-	wmStrutPartial = XInternAtom (dpy, "_NET_WM_STRUT_PARTIAL", 0);
-
-	wmUserTime = XInternAtom (dpy, "_NET_WM_USER_TIME", 0);
-
-	wmIcon         = XInternAtom (dpy,"_NET_WM_ICON", 0);
-	wmIconGeometry = XInternAtom (dpy, "_NET_WM_ICON_GEOMETRY", 0);
-
-	clientList         = XInternAtom (dpy, "_NET_CLIENT_LIST", 0);
-	clientListStacking =
-	    XInternAtom (dpy, "_NET_CLIENT_LIST_STACKING", 0);
-
-	frameExtents = XInternAtom (dpy, "_NET_FRAME_EXTENTS", 0);
-	frameWindow  = XInternAtom (dpy, "_NET_FRAME_WINDOW", 0);
-
-	wmState        = XInternAtom (dpy, "WM_STATE", 0);
-	wmChangeState  = XInternAtom (dpy, "WM_CHANGE_STATE", 0);
-	wmProtocols    = XInternAtom (dpy, "WM_PROTOCOLS", 0);
-	wmClientLeader = XInternAtom (dpy, "WM_CLIENT_LEADER", 0);
-
-	wmDeleteWindow = XInternAtom (dpy, "WM_DELETE_WINDOW", 0);
-	wmTakeFocus    = XInternAtom (dpy, "WM_TAKE_FOCUS", 0);
-	wmPing         = XInternAtom (dpy, "_NET_WM_PING", 0);
-	wmSyncRequest  = XInternAtom (dpy, "_NET_WM_SYNC_REQUEST", 0);
-
-	wmSyncRequestCounter =
-	    XInternAtom (dpy, "_NET_WM_SYNC_REQUEST_COUNTER", 0);
-
-	wmFullscreenMonitors =
-	    XInternAtom (dpy, "_NET_WM_FULLSCREEN_MONITORS", 0);
-
-	closeWindow      = XInternAtom (dpy, "_NET_CLOSE_WINDOW", 0);
-	wmMoveResize     = XInternAtom (dpy, "_NET_WM_MOVERESIZE", 0);
-	moveResizeWindow = XInternAtom (dpy, "_NET_MOVERESIZE_WINDOW", 0);
-	restackWindow    = XInternAtom (dpy, "_NET_RESTACK_WINDOW", 0);
-
-	showingDesktop = XInternAtom (dpy, "_NET_SHOWING_DESKTOP", 0);
-
-	xBackground[0] = XInternAtom (dpy, "_XSETROOT_ID", 0);
-	xBackground[1] = XInternAtom (dpy, "_XROOTPMAP_ID", 0);
-
-	toolkitAction                =
-	    XInternAtom (dpy, "_COMPIZ_TOOLKIT_ACTION", 0);
-	toolkitActionWindowMenu      =
-	    XInternAtom (dpy, "_COMPIZ_TOOLKIT_ACTION_WINDOW_MENU", 0);
-	toolkitActionForceQuitDialog =
-	    XInternAtom (dpy, "_COMPIZ_TOOLKIT_ACTION_FORCE_QUIT_DIALOG", 0);
-
-	mwmHints = XInternAtom (dpy, "_MOTIF_WM_HINTS", 0);
-
-	xdndAware    = XInternAtom (dpy, "XdndAware", 0);
-	xdndEnter    = XInternAtom (dpy, "XdndEnter", 0);
-	xdndLeave    = XInternAtom (dpy, "XdndLeave", 0);
-	xdndPosition = XInternAtom (dpy, "XdndPosition", 0);
-	xdndStatus   = XInternAtom (dpy, "XdndStatus", 0);
-	xdndDrop     = XInternAtom (dpy, "XdndDrop", 0);
-
-	manager   = XInternAtom (dpy, "MANAGER", 0);
-	targets   = XInternAtom (dpy, "TARGETS", 0);
-	multiple  = XInternAtom (dpy, "MULTIPLE", 0);
-	timestamp = XInternAtom (dpy, "TIMESTAMP", 0);
-	version   = XInternAtom (dpy, "VERSION", 0);
-	atomPair  = XInternAtom (dpy, "ATOM_PAIR", 0);
-
-	startupId = XInternAtom (dpy, "_NET_STARTUP_ID", 0);
+	display = dpy;
+
+	pending.insert (pending.begin (), names,
+			names + sizeof (names) / sizeof (names[0]));
+
+	flush ();
     }
 };
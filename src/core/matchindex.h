@@ -0,0 +1,52 @@
+/*
+ * Copyright © 2008 Dennis Kasprzyk
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the name of
+ * Dennis Kasprzyk not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior permission.
+ * Dennis Kasprzyk makes no representations about the suitability of this
+ * software for any purpose. It is provided "as is" without express or
+ * implied warranty.
+ *
+ * DENNIS KASPRZYK DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL DENNIS KASPRZYK BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION
+ * WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Dennis Kasprzyk <onestone@compiz-fusion.org>
+ */
+
+#ifndef _COMPIZ_MATCHINDEX_H
+#define _COMPIZ_MATCHINDEX_H
+
+#include <vector>
+
+#include <core/string.h>
+
+class CompWindow;
+class CompMatch;
+
+/*
+ * Finds the match options of the active plugins a window satisfies
+ * without evaluating all of them. The options are filed by the type and
+ * state bits, xid or hooked key a window needs for them to match, the
+ * index follows changes to the options by itself.
+ */
+namespace MatchOptions {
+    /* appends the match options w matches, by plugin and option order */
+    void matching (CompWindow *w, std::vector<CompMatch *> &result);
+
+    /* a hook asserts that leaves "<prefix>=<value>" match exactly the
+       windows it returns <value> for, expression handlers add it next
+       to their matchInitExp wrap */
+    void addKeyHook (const char *prefix, CompString (*hook) (CompWindow *w));
+};
+
+#endif
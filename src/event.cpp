@@ -40,6 +40,7 @@
 #include <core/atoms.h>
 #include "privatescreen.h"
 #include "privatewindow.h"
+#include "privateaction.h"
 
 static Window xdndWindow = None;
 static Window edgeWindow = None;
@@ -85,9 +86,6 @@ autoRaiseTimeout (CompScreen *screen)
     return false;
 }
 
-#define REAL_MOD_MASK (ShiftMask | ControlMask | Mod1Mask | Mod2Mask | \
-		       Mod3Mask | Mod4Mask | Mod5Mask | CompNoMask)
-
 static bool
 isCallBackBinding (CompOption	           &option,
 		   CompAction::BindingType type,
@@ -140,9 +138,9 @@ isTerminateBinding (CompOption	            &option,
 }
 
 bool
-PrivateScreen::triggerButtonPressBindings (CompOption::Vector &options,
-					   XButtonEvent       *event,
-					   CompOption::Vector &arguments)
+PrivateScreen::triggerButtonPressBindings (const ActionIndex::Bindings &bindings,
+					   XButtonEvent                *event,
+					   CompOption::Vector          &arguments)
 {
     CompAction::State state = CompAction::StateInitButton;
     CompAction        *action;
@@ -175,8 +173,10 @@ PrivateScreen::triggerButtonPressBindings (CompOption::Vector &options,
 	}
     }
 
-    foreach (CompOption &option, options)
+    foreach (const ActionIndex::Binding &binding, bindings)
     {
+	CompOption &option = *binding.option;
+
 	if (isInitiateBinding (option, CompAction::BindingTypeButton, state,
 			       &action))
 	{
@@ -216,17 +216,19 @@ PrivateScreen::triggerButtonPressBindings (CompOption::Vector &options,
 }
 
 bool
-PrivateScreen::triggerButtonReleaseBindings (CompOption::Vector &options,
-					     XButtonEvent       *event,
-					     CompOption::Vector &arguments)
+PrivateScreen::triggerButtonReleaseBindings (const ActionIndex::Bindings &bindings,
+					     XButtonEvent                *event,
+					     CompOption::Vector          &arguments)
 {
     CompAction::State       state = CompAction::StateTermButton;
     CompAction::BindingType type  = CompAction::BindingTypeButton |
 				    CompAction::BindingTypeEdgeButton;
     CompAction	            *action;
 
-    foreach (CompOption &option, options)
+    foreach (const ActionIndex::Binding &binding, bindings)
     {
+	CompOption &option = *binding.option;
+
 	if (isTerminateBinding (option, type, state, &action))
 	{
 	    if (action->button ().button () == (int) event->button)
@@ -241,9 +243,9 @@ PrivateScreen::triggerButtonReleaseBindings (CompOption::Vector &options,
 }
 
 bool
-PrivateScreen::triggerKeyPressBindings (CompOption::Vector &options,
-					XKeyEvent          *event,
-					CompOption::Vector &arguments)
+PrivateScreen::triggerKeyPressBindings (const ActionIndex::Bindings &bindings,
+					XKeyEvent                   *event,
+					CompOption::Vector          &arguments)
 {
     CompAction::State state = 0;
     CompAction	      *action;
@@ -257,8 +259,10 @@ PrivateScreen::triggerKeyPressBindings (CompOption::Vector &options,
 
     if (state)
     {
-	foreach (CompOption &o, options)
+	foreach (const ActionIndex::Binding &binding, bindings)
 	{
+	    CompOption &o = *binding.option;
+
 	    if (o.isAction ())
 	    {
 		if (!o.value ().action ().terminate ().empty ())
@@ -272,8 +276,10 @@ PrivateScreen::triggerKeyPressBindings (CompOption::Vector &options,
     }
 
     state = CompAction::StateInitKey;
-    foreach (CompOption &option, options)
+    foreach (const ActionIndex::Binding &binding, bindings)
     {
+	CompOption &option = *binding.option;
+
 	if (isInitiateBinding (option, CompAction::BindingTypeKey,
 			       state, &action))
 	{
@@ -299,9 +305,9 @@ PrivateScreen::triggerKeyPressBindings (CompOption::Vector &options,
 }
 
 bool
-PrivateScreen::triggerKeyReleaseBindings (CompOption::Vector &options,
-					  XKeyEvent          *event,
-					  CompOption::Vector &arguments)
+PrivateScreen::triggerKeyReleaseBindings (const ActionIndex::Bindings &bindings,
+					  XKeyEvent                   *event,
+					  CompOption::Vector          &arguments)
 {
     CompAction::State state = CompAction::StateTermKey;
     CompAction        *action;
@@ -314,8 +320,10 @@ PrivateScreen::triggerKeyReleaseBindings (CompOption::Vector &options,
     if (!xkbEvent && !mods)
 	return false;
 
-    foreach (CompOption &option, options)
+    foreach (const ActionIndex::Binding &binding, bindings)
     {
+	CompOption &option = *binding.option;
+
 	if (isTerminateBinding (option, CompAction::BindingTypeKey,
 				state, &action))
 	{
@@ -342,9 +350,9 @@ PrivateScreen::triggerKeyReleaseBindings (CompOption::Vector &options,
 }
 
 bool
-PrivateScreen::triggerStateNotifyBindings (CompOption::Vector  &options,
-					   XkbStateNotifyEvent *event,
-					   CompOption::Vector  &arguments)
+PrivateScreen::triggerStateNotifyBindings (const ActionIndex::Bindings &bindings,
+					   XkbStateNotifyEvent         *event,
+					   CompOption::Vector          &arguments)
 {
     CompAction::State state;
     CompAction        *action;
@@ -356,8 +364,10 @@ PrivateScreen::triggerStateNotifyBindings (CompOption::Vector  &options,
     {
 	state = CompAction::StateInitKey;
 
-	foreach (CompOption &option, options)
+	foreach (const ActionIndex::Binding &binding, bindings)
 	{
+	    CompOption &option = *binding.option;
+
 	    if (isInitiateBinding (option, CompAction::BindingTypeKey,
 				   state, &action))
 	    {
@@ -379,8 +389,10 @@ PrivateScreen::triggerStateNotifyBindings (CompOption::Vector  &options,
     {
 	state = CompAction::StateTermKey;
 
-	foreach (CompOption &option, options)
+	foreach (const ActionIndex::Binding &binding, bindings)
 	{
+	    CompOption &option = *binding.option;
+
 	    if (isTerminateBinding (option, CompAction::BindingTypeKey,
 				    state, &action))
 	    {
@@ -422,14 +434,16 @@ isBellAction (CompOption        &option,
 }
 
 static bool
-triggerBellNotifyBindings (CompOption::Vector &options,
-			   CompOption::Vector &arguments)
+triggerBellNotifyBindings (const ActionIndex::Bindings &bindings,
+			   CompOption::Vector          &arguments)
 {
     CompAction::State state = CompAction::StateInitBell;
     CompAction        *action;
 
-    foreach (CompOption &option, options)
+    foreach (const ActionIndex::Binding &binding, bindings)
     {
+	CompOption &option = *binding.option;
+
 	if (isBellAction (option, state, &action))
 	{
 	    if (action->initiate () (action, state, arguments))
@@ -511,16 +525,18 @@ isEdgeLeaveAction (CompOption        &option,
 }
 
 static bool
-triggerEdgeEnterBindings (CompOption::Vector &options,
-			  CompAction::State  state,
-			  CompAction::State  delayState,
-			  unsigned int	     edge,
-			  CompOption::Vector &arguments)
+triggerEdgeEnterBindings (const ActionIndex::Bindings &bindings,
+			  CompAction::State           state,
+			  CompAction::State           delayState,
+			  unsigned int                edge,
+			  CompOption::Vector          &arguments)
 {
     CompAction *action;
 
-    foreach (CompOption &option, options)
+    foreach (const ActionIndex::Binding &binding, bindings)
     {
+	CompOption &option = *binding.option;
+
 	if (isEdgeEnterAction (option, state, delayState, edge, &action))
 	{
 	    if (action->initiate () (action, state, arguments))
@@ -532,15 +548,17 @@ triggerEdgeEnterBindings (CompOption::Vector &options,
 }
 
 static bool
-triggerEdgeLeaveBindings (CompOption::Vector &options,
-			  CompAction::State  state,
-			  unsigned int	     edge,
-			  CompOption::Vector &arguments)
+triggerEdgeLeaveBindings (const ActionIndex::Bindings &bindings,
+			  CompAction::State           state,
+			  unsigned int                edge,
+			  CompOption::Vector          &arguments)
 {
     CompAction *action;
 
-    foreach (CompOption &option, options)
+    foreach (const ActionIndex::Binding &binding, bindings)
     {
+	CompOption &option = *binding.option;
+
 	if (isEdgeLeaveAction (option, state, edge, &action))
 	{
 	    if (action->terminate () (action, state, arguments))
@@ -557,16 +575,15 @@ triggerAllEdgeEnterBindings (CompAction::State  state,
 			     unsigned int       edge,
 			     CompOption::Vector &arguments)
 {
-    foreach (CompPlugin *p, CompPlugin::getPlugins ())
-    {
-	CompOption::Vector &options = p->vTable->getOptions ();
-	if (triggerEdgeEnterBindings (options, state, delayState, edge,
-				      arguments))
-	{
-	    return true;
-	}
-    }
-    return false;
+    ActionIndex &index = screen->priv->actionIndex;
+
+    index.update ();
+
+    /* a copy, actions may cause the index to be rebuilt */
+    ActionIndex::Bindings bindings (index.edge (edge));
+
+    return triggerEdgeEnterBindings (bindings, state, delayState, edge,
+				     arguments);
 }
 
 static bool
@@ -616,100 +633,121 @@ PrivateScreen::triggerEdgeEnter (unsigned int       edge,
 bool
 PrivateScreen::handleActionEvent (XEvent *event)
 {
-    static CompOption::Vector o (8);
-    o.resize (8);
-
-    o[0].setName ("event_window", CompOption::TypeInt);
-    o[1].setName ("window", CompOption::TypeInt);
-    o[2].setName ("modifiers", CompOption::TypeInt);
-    o[3].setName ("x", CompOption::TypeInt);
-    o[4].setName ("y", CompOption::TypeInt);
-    o[5].setName ("root", CompOption::TypeInt);
+    static ActionArguments buttonArgs (6, ActionArguments::SlotButton,
+				       ActionArguments::SlotTime);
+    static ActionArguments keyArgs (6, ActionArguments::SlotKeycode,
+				    ActionArguments::SlotTime);
+    static ActionArguments crossingArgs (6, ActionArguments::SlotTime);
+    static ActionArguments dndArgs (6);
+    static ActionArguments stateArgs (3, ActionArguments::SlotTime);
+    static ActionArguments bellArgs (2, ActionArguments::SlotTime);
+
+    /* copied out of the index, actions may cause it to be rebuilt */
+    ActionIndex::Bindings bindings;
+    unsigned int          modMask = REAL_MOD_MASK &
+				    ~modHandler->ignoredModMask ();
+
+    actionIndex.update ();
 
     switch (event->type) {
     case ButtonPress:
-	o[0].value ().set ((int) event->xbutton.window);
-	o[1].value ().set ((int) event->xbutton.window);
-	o[2].value ().set ((int) event->xbutton.state);
-	o[3].value ().set ((int) event->xbutton.x_root);
-	o[4].value ().set ((int) event->xbutton.y_root);
-	o[5].value ().set ((int) event->xbutton.root);
-
-	o[6].setName ("button", CompOption::TypeInt);
-	o[7].setName ("time", CompOption::TypeInt);
-
-	o[6].value ().set ((int) event->xbutton.button);
-	o[7].value ().set ((int) event->xbutton.time);
-
-	foreach (CompPlugin *p, CompPlugin::getPlugins ())
-	{
-	    CompOption::Vector &options = p->vTable->getOptions ();
-	    if (triggerButtonPressBindings (options, &event->xbutton, o))
-		return true;
-	}
+	buttonArgs.set (ActionArguments::SlotEventWindow,
+			(int) event->xbutton.window);
+	buttonArgs.set (ActionArguments::SlotWindow,
+			(int) event->xbutton.window);
+	buttonArgs.set (ActionArguments::SlotModifiers,
+			(int) event->xbutton.state);
+	buttonArgs.set (ActionArguments::SlotX, (int) event->xbutton.x_root);
+	buttonArgs.set (ActionArguments::SlotY, (int) event->xbutton.y_root);
+	buttonArgs.set (ActionArguments::SlotRoot, (int) event->xbutton.root);
+	buttonArgs.set (ActionArguments::SlotButton,
+			(int) event->xbutton.button);
+	buttonArgs.set (ActionArguments::SlotTime, (int) event->xbutton.time);
+
+	bindings = actionIndex.buttons (event->xbutton.button,
+					event->xbutton.state & modMask);
+
+	if (triggerButtonPressBindings (bindings, &event->xbutton,
+					buttonArgs.options ()))
+	    return true;
 	break;
     case ButtonRelease:
-	o[0].value ().set ((int) event->xbutton.window);
-	o[1].value ().set ((int) event->xbutton.window);
-	o[2].value ().set ((int) event->xbutton.state);
-	o[3].value ().set ((int) event->xbutton.x_root);
-	o[4].value ().set ((int) event->xbutton.y_root);
-	o[5].value ().set ((int) event->xbutton.root);
-
-	o[6].setName ("button", CompOption::TypeInt);
-	o[7].setName ("time", CompOption::TypeInt);
-
-	o[6].value ().set ((int) event->xbutton.button);
-	o[7].value ().set ((int) event->xbutton.time);
-
-	foreach (CompPlugin *p, CompPlugin::getPlugins ())
-	{
-	    CompOption::Vector &options = p->vTable->getOptions ();
-	    if (triggerButtonReleaseBindings (options, &event->xbutton, o))
-		return true;
-	}
+	buttonArgs.set (ActionArguments::SlotEventWindow,
+			(int) event->xbutton.window);
+	buttonArgs.set (ActionArguments::SlotWindow,
+			(int) event->xbutton.window);
+	buttonArgs.set (ActionArguments::SlotModifiers,
+			(int) event->xbutton.state);
+	buttonArgs.set (ActionArguments::SlotX, (int) event->xbutton.x_root);
+	buttonArgs.set (ActionArguments::SlotY, (int) event->xbutton.y_root);
+	buttonArgs.set (ActionArguments::SlotRoot, (int) event->xbutton.root);
+	buttonArgs.set (ActionArguments::SlotButton,
+			(int) event->xbutton.button);
+	buttonArgs.set (ActionArguments::SlotTime, (int) event->xbutton.time);
+
+	bindings = actionIndex.buttonReleases (event->xbutton.button);
+
+	if (triggerButtonReleaseBindings (bindings, &event->xbutton,
+					  buttonArgs.options ()))
+	    return true;
 	break;
     case KeyPress:
-	o[0].value ().set ((int) event->xkey.window);
-	o[1].value ().set ((int) activeWindow);
-	o[2].value ().set ((int) event->xkey.state);
-	o[3].value ().set ((int) event->xkey.x_root);
-	o[4].value ().set ((int) event->xkey.y_root);
-	o[5].value ().set ((int) event->xkey.root);
-
-	o[6].setName ("keycode", CompOption::TypeInt);
-	o[7].setName ("time", CompOption::TypeInt);
+	keyArgs.set (ActionArguments::SlotEventWindow,
+		     (int) event->xkey.window);
+	keyArgs.set (ActionArguments::SlotWindow, (int) activeWindow);
+	keyArgs.set (ActionArguments::SlotModifiers, (int) event->xkey.state);
+	keyArgs.set (ActionArguments::SlotX, (int) event->xkey.x_root);
+	keyArgs.set (ActionArguments::SlotY, (int) event->xkey.y_root);
+	keyArgs.set (ActionArguments::SlotRoot, (int) event->xkey.root);
+	keyArgs.set (ActionArguments::SlotKeycode, (int) event->xkey.keycode);
+	keyArgs.set (ActionArguments::SlotTime, (int) event->xkey.time);
+
+	/* escape and return terminate every action, plugin by plugin */
+	if (event->xkey.keycode == escapeKeyCode ||
+	    event->xkey.keycode == returnKeyCode)
+	{
+	    std::vector<ActionIndex::Bindings> plugins (actionIndex.plugins ());
+
+	    foreach (ActionIndex::Bindings &pluginBindings, plugins)
+		if (triggerKeyPressBindings (pluginBindings, &event->xkey,
+					     keyArgs.options ()))
+		    return true;
+	    break;
+	}
 
-	o[6].value ().set ((int) event->xkey.keycode);
-	o[7].value ().set ((int) event->xkey.time);
+	if (xkbEvent)
+	    bindings = actionIndex.keys (event->xkey.keycode,
+					 event->xkey.state & modMask);
+	else
+	    ActionIndex::merge (actionIndex.keys (event->xkey.keycode,
+						  event->xkey.state & modMask),
+				actionIndex.keys (0, event->xkey.state & modMask),
+				bindings);
 
-	foreach (CompPlugin *p, CompPlugin::getPlugins ())
-	{
-	    CompOption::Vector &options = p->vTable->getOptions ();
-	    if (triggerKeyPressBindings (options, &event->xkey, o))
-		return true;
-	}
+	if (triggerKeyPressBindings (bindings, &event->xkey,
+				     keyArgs.options ()))
+	    return true;
 	break;
     case KeyRelease:
-	o[0].value ().set ((int) event->xkey.window);
-	o[1].value ().set ((int) activeWindow);
-	o[2].value ().set ((int) event->xkey.state);
-	o[3].value ().set ((int) event->xkey.x_root);
-	o[4].value ().set ((int) event->xkey.y_root);
-	o[5].value ().set ((int) event->xkey.root);
-
-	o[6].setName ("keycode", CompOption::TypeInt);
-	o[7].setName ("time", CompOption::TypeInt);
-
-	o[6].value ().set ((int) event->xkey.keycode);
-	o[7].value ().set ((int) event->xkey.time);
+	keyArgs.set (ActionArguments::SlotEventWindow,
+		     (int) event->xkey.window);
+	keyArgs.set (ActionArguments::SlotWindow, (int) activeWindow);
+	keyArgs.set (ActionArguments::SlotModifiers, (int) event->xkey.state);
+	keyArgs.set (ActionArguments::SlotX, (int) event->xkey.x_root);
+	keyArgs.set (ActionArguments::SlotY, (int) event->xkey.y_root);
+	keyArgs.set (ActionArguments::SlotRoot, (int) event->xkey.root);
+	keyArgs.set (ActionArguments::SlotKeycode, (int) event->xkey.keycode);
+	keyArgs.set (ActionArguments::SlotTime, (int) event->xkey.time);
+
+	if (xkbEvent)
+	    bindings = actionIndex.keys (event->xkey.keycode, 0);
+	else
+	    ActionIndex::merge (actionIndex.keys (event->xkey.keycode, 0),
+				actionIndex.modifiedKeys (), bindings);
 
-	foreach (CompPlugin *p, CompPlugin::getPlugins ())
-	{
-	    CompOption::Vector &options = p->vTable->getOptions ();
-	    if (triggerKeyReleaseBindings (options, &event->xkey, o))
-		return true;
-	}
+	if (triggerKeyReleaseBindings (bindings, &event->xkey,
+				       keyArgs.options ()))
+	    return true;
 	break;
     case EnterNotify:
 	if (event->xcrossing.mode   != NotifyGrab   &&
@@ -741,24 +779,26 @@ PrivateScreen::handleActionEvent (XEvent *event)
 
 		edgeWindow = None;
 
-		o[0].value ().set ((int) event->xcrossing.window);
-		o[1].value ().set ((int) activeWindow);
-		o[2].value ().set ((int) event->xcrossing.state);
-		o[3].value ().set ((int) event->xcrossing.x_root);
-		o[4].value ().set ((int) event->xcrossing.y_root);
-		o[5].value ().set ((int) event->xcrossing.root);
-
-		o[6].setName ("time", CompOption::TypeInt);
-		o[6].value ().set ((int) event->xcrossing.time);
-		
-		o.resize (7);
-
-		foreach (CompPlugin *p, CompPlugin::getPlugins ())
-		{
-		    CompOption::Vector &options = p->vTable->getOptions ();
-		    if (triggerEdgeLeaveBindings (options, state, edge, o))
-			return true;
-		}
+		crossingArgs.set (ActionArguments::SlotEventWindow,
+				  (int) event->xcrossing.window);
+		crossingArgs.set (ActionArguments::SlotWindow,
+				  (int) activeWindow);
+		crossingArgs.set (ActionArguments::SlotModifiers,
+				  (int) event->xcrossing.state);
+		crossingArgs.set (ActionArguments::SlotX,
+				  (int) event->xcrossing.x_root);
+		crossingArgs.set (ActionArguments::SlotY,
+				  (int) event->xcrossing.y_root);
+		crossingArgs.set (ActionArguments::SlotRoot,
+				  (int) event->xcrossing.root);
+		crossingArgs.set (ActionArguments::SlotTime,
+				  (int) event->xcrossing.time);
+
+		bindings = actionIndex.edge (edge);
+
+		if (triggerEdgeLeaveBindings (bindings, state, edge,
+					      crossingArgs.options ()))
+		    return true;
 	    }
 
 	    edge = 0;
@@ -778,19 +818,22 @@ PrivateScreen::handleActionEvent (XEvent *event)
 
 		edgeWindow = event->xcrossing.window;
 
-		o[0].value ().set ((int) event->xcrossing.window);
-		o[1].value ().set ((int) activeWindow);
-		o[2].value ().set ((int) event->xcrossing.state);
-		o[3].value ().set ((int) event->xcrossing.x_root);
-		o[4].value ().set ((int) event->xcrossing.y_root);
-		o[5].value ().set ((int) event->xcrossing.root);
-
-		o[6].setName ("time", CompOption::TypeInt);
-		o[6].value ().set ((int) event->xcrossing.time);
-		
-		o.resize (7);
-
-		if (triggerEdgeEnter (edge, state, o))
+		crossingArgs.set (ActionArguments::SlotEventWindow,
+				  (int) event->xcrossing.window);
+		crossingArgs.set (ActionArguments::SlotWindow,
+				  (int) activeWindow);
+		crossingArgs.set (ActionArguments::SlotModifiers,
+				  (int) event->xcrossing.state);
+		crossingArgs.set (ActionArguments::SlotX,
+				  (int) event->xcrossing.x_root);
+		crossingArgs.set (ActionArguments::SlotY,
+				  (int) event->xcrossing.y_root);
+		crossingArgs.set (ActionArguments::SlotRoot,
+				  (int) event->xcrossing.root);
+		crossingArgs.set (ActionArguments::SlotTime,
+				  (int) event->xcrossing.time);
+
+		if (triggerEdgeEnter (edge, state, crossingArgs.options ()))
 		    return true;
 	    }
 	}
@@ -829,21 +872,19 @@ PrivateScreen::handleActionEvent (XEvent *event)
 	    {
 		state = CompAction::StateTermEdgeDnd;
 
-		o[0].value ().set ((int) event->xclient.window);
-		o[1].value ().set ((int) activeWindow);
-		o[2].value ().set ((int) 0); /* fixme */
-		o[3].value ().set ((int) 0); /* fixme */
-		o[4].value ().set ((int) 0); /* fixme */
-		o[5].value ().set ((int) root);
-		
-		o.resize (6);
+		dndArgs.set (ActionArguments::SlotEventWindow,
+			     (int) event->xclient.window);
+		dndArgs.set (ActionArguments::SlotWindow, (int) activeWindow);
+		dndArgs.set (ActionArguments::SlotModifiers, (int) 0); /* fixme */
+		dndArgs.set (ActionArguments::SlotX, (int) 0); /* fixme */
+		dndArgs.set (ActionArguments::SlotY, (int) 0); /* fixme */
+		dndArgs.set (ActionArguments::SlotRoot, (int) root);
 
-		foreach (CompPlugin *p, CompPlugin::getPlugins ())
-		{
-		    CompOption::Vector &options = p->vTable->getOptions ();
-		    if (triggerEdgeLeaveBindings (options, state, edge, o))
-			return true;
-		}
+		bindings = actionIndex.edge (edge);
+
+		if (triggerEdgeLeaveBindings (bindings, state, edge,
+					      dndArgs.options ()))
+		    return true;
 	    }
 	}
 	else if (event->xclient.message_type == Atoms::xdndPosition)
@@ -875,16 +916,17 @@ PrivateScreen::handleActionEvent (XEvent *event)
 	    {
 		state = CompAction::StateInitEdgeDnd;
 
-		o[0].value ().set ((int) event->xclient.window);
-		o[1].value ().set ((int) activeWindow);
-		o[2].value ().set ((int) 0); /* fixme */
-		o[3].value ().set ((int) event->xclient.data.l[2] >> 16);
-		o[4].value ().set ((int) event->xclient.data.l[2] & 0xffff);
-		o[5].value ().set ((int) root);
-		
-		o.resize (6);
-
-		if (triggerEdgeEnter (edge, state, o))
+		dndArgs.set (ActionArguments::SlotEventWindow,
+			     (int) event->xclient.window);
+		dndArgs.set (ActionArguments::SlotWindow, (int) activeWindow);
+		dndArgs.set (ActionArguments::SlotModifiers, (int) 0); /* fixme */
+		dndArgs.set (ActionArguments::SlotX,
+			     (int) event->xclient.data.l[2] >> 16);
+		dndArgs.set (ActionArguments::SlotY,
+			     (int) event->xclient.data.l[2] & 0xffff);
+		dndArgs.set (ActionArguments::SlotRoot, (int) root);
+
+		if (triggerEdgeEnter (edge, state, dndArgs.options ()))
 		    return true;
 	    }
 
@@ -900,38 +942,33 @@ PrivateScreen::handleActionEvent (XEvent *event)
 	    {
 		XkbStateNotifyEvent *stateEvent = (XkbStateNotifyEvent *) event;
 
-		o[0].value ().set ((int) activeWindow);
-		o[1].value ().set ((int) activeWindow);
-		o[2].value ().set ((int) stateEvent->mods);
+		stateArgs.set (ActionArguments::SlotEventWindow,
+			       (int) activeWindow);
+		stateArgs.set (ActionArguments::SlotWindow, (int) activeWindow);
+		stateArgs.set (ActionArguments::SlotModifiers,
+			       (int) stateEvent->mods);
+		stateArgs.set (ActionArguments::SlotTime, (int) xkbEvent->time);
 
-		o[3] = CompOption ("time", CompOption::TypeInt);
-		o[3].value ().set ((int) xkbEvent->time);
-
-		o.resize (4);
+		if (stateEvent->event_type == KeyPress)
+		    bindings = actionIndex.modifierKeys ();
+		else
+		    bindings = actionIndex.all ();
 
-		foreach (CompPlugin *p, CompPlugin::getPlugins ())
-		{
-		    CompOption::Vector &options = p->vTable->getOptions ();
-		    if (triggerStateNotifyBindings (options, stateEvent, o))
-			return true;
-		}
+		if (triggerStateNotifyBindings (bindings, stateEvent,
+						stateArgs.options ()))
+		    return true;
 	    }
 	    else if (xkbEvent->xkb_type == XkbBellNotify)
 	    {
-		o[0].value ().set ((int) activeWindow);
-		o[1].value ().set ((int) activeWindow);
-
-		o[2] = CompOption ("time", CompOption::TypeInt);
-		o[2].value ().set ((int) xkbEvent->time);
+		bellArgs.set (ActionArguments::SlotEventWindow,
+			      (int) activeWindow);
+		bellArgs.set (ActionArguments::SlotWindow, (int) activeWindow);
+		bellArgs.set (ActionArguments::SlotTime, (int) xkbEvent->time);
 
-		o.resize (3);
+		bindings = actionIndex.bells ();
 
-		foreach (CompPlugin *p, CompPlugin::getPlugins ())
-		{
-		    CompOption::Vector &options = p->vTable->getOptions ();
-		    if (triggerBellNotifyBindings (options, o))
-			return true;
-		}
+		if (triggerBellNotifyBindings (bindings, bellArgs.options ()))
+		    return true;
 	    }
 	}
 	break;
@@ -1067,7 +1104,7 @@ printf("MAP\n");
 
 		    w->changeState (w->state () & ~CompWindowStateHiddenMask);
 
-		    priv->updateClientList ();
+		    priv->updateClientList (w);
 		}
 		else /* Closing */
 		    w->windowNotify (CompWindowNotifyClose);
@@ -1168,7 +1205,7 @@ printf("MAP\n");
 				CompWindowTypeDesktopMask))
 			w->setDesktop (0xffffffff);
 
-		    priv->updateClientList ();
+		    priv->updateClientList (w);
 
 		    matchPropertyChanged (w);
 		}
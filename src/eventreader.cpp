@@ -0,0 +1,260 @@
+/*
+ * Copyright © 2008 Dennis Kasprzyk
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the name of
+ * Dennis Kasprzyk not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior permission.
+ * Dennis Kasprzyk makes no representations about the suitability of this
+ * software for any purpose. It is provided "as is" without express or
+ * implied warranty.
+ *
+ * DENNIS KASPRZYK DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL DENNIS KASPRZYK BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION
+ * WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Dennis Kasprzyk <onestone@compiz-fusion.org>
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+
+#include "privateeventreader.h"
+
+static void
+signalFd (int fd)
+{
+    uint64_t one = 1;
+
+    if (write (fd, &one, sizeof (one)) < 0)
+	return;
+}
+
+static void
+drainFd (int fd)
+{
+    uint64_t count;
+
+    while (read (fd, &count, sizeof (count)) > 0);
+}
+
+EventReader::EventReader (xcb_connection_t *connection) :
+    connection (connection),
+    head (0),
+    tail (0),
+    running (false),
+    waitingForSpace (0)
+{
+    pthread_mutex_init (&mutex, NULL);
+
+    readyFd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+    spaceFd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+    quitFd  = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+EventReader::~EventReader ()
+{
+    Entry entry;
+
+    stop ();
+
+    while (pop (entry))
+	free (entry.event);
+
+    close (readyFd);
+    close (spaceFd);
+    close (quitFd);
+
+    pthread_mutex_destroy (&mutex);
+}
+
+bool
+EventReader::start ()
+{
+    if (running)
+	return true;
+
+    if (readyFd < 0 || spaceFd < 0 || quitFd < 0)
+	return false;
+
+    if (pthread_create (&thread, NULL, EventReader::run, this))
+	return false;
+
+    running = true;
+
+    return true;
+}
+
+void
+EventReader::stop ()
+{
+    if (!running)
+	return;
+
+    signalFd (quitFd);
+    pthread_join (thread, NULL);
+
+    drainFd (quitFd);
+    running = false;
+}
+
+int
+EventReader::fd () const
+{
+    return readyFd;
+}
+
+void
+EventReader::clearReady ()
+{
+    drainFd (readyFd);
+}
+
+void
+EventReader::lock ()
+{
+    pthread_mutex_lock (&mutex);
+}
+
+void
+EventReader::unlock ()
+{
+    pthread_mutex_unlock (&mutex);
+}
+
+unsigned int
+EventReader::depth () const
+{
+    return __atomic_load_n (&head, __ATOMIC_ACQUIRE) -
+	   __atomic_load_n (&tail, __ATOMIC_ACQUIRE);
+}
+
+bool
+EventReader::pop (Entry &entry)
+{
+    unsigned int t = tail;
+
+    if (t == __atomic_load_n (&head, __ATOMIC_ACQUIRE))
+	return false;
+
+    entry = ring[t % EVENT_RING_SIZE];
+    __atomic_store_n (&tail, t + 1, __ATOMIC_RELEASE);
+
+    if (__atomic_exchange_n (&waitingForSpace, 0, __ATOMIC_ACQ_REL))
+	signalFd (spaceFd);
+
+    return true;
+}
+
+void *
+EventReader::run (void *data)
+{
+    EventReader *reader = (EventReader *) data;
+
+    reader->readLoop ();
+
+    return NULL;
+}
+
+/* Moves as many events from the connection into the ring as fit,
+   reading the socket once. Returns how many were queued. */
+unsigned int
+EventReader::readBatch ()
+{
+    xcb_generic_event_t *event;
+    TimerQueue::Time    now = TimerQueue::now ();
+    unsigned int        h = head;
+    unsigned int        n = 0;
+    bool                fromSocket = true;
+
+    lock ();
+
+    while (h - __atomic_load_n (&tail, __ATOMIC_ACQUIRE) < EVENT_RING_SIZE)
+    {
+	if (fromSocket)
+	    event = xcb_poll_for_event (connection);
+	else
+	    event = xcb_poll_for_queued_event (connection);
+
+	fromSocket = false;
+
+	if (!event)
+	    break;
+
+	ring[h % EVENT_RING_SIZE].event    = event;
+	ring[h % EVENT_RING_SIZE].received = now;
+
+	h++;
+	n++;
+
+	__atomic_store_n (&head, h, __ATOMIC_RELEASE);
+    }
+
+    unlock ();
+
+    if (n)
+	signalFd (readyFd);
+
+    return n;
+}
+
+void
+EventReader::readLoop ()
+{
+    struct pollfd fds[2];
+    bool          full = false;
+
+    fds[0].fd     = quitFd;
+    fds[0].events = POLLIN;
+    fds[1].events = POLLIN;
+
+    for (;;)
+    {
+	/* when the ring is full we wait for the main thread to make
+	   room, the kernel buffers whatever the server sends meanwhile */
+	if (full)
+	{
+	    __atomic_store_n (&waitingForSpace, 1, __ATOMIC_RELEASE);
+
+	    if (depth () < EVENT_RING_SIZE)
+	    {
+		__atomic_store_n (&waitingForSpace, 0, __ATOMIC_RELEASE);
+		full = false;
+	    }
+	}
+
+	fds[1].fd = full ? spaceFd : xcb_get_file_descriptor (connection);
+
+	if (poll (fds, 2, -1) < 0)
+	    continue;
+
+	if (fds[0].revents)
+	    break;
+
+	if (full)
+	{
+	    drainFd (spaceFd);
+	    full = false;
+	}
+
+	if (xcb_connection_has_error (connection))
+	{
+	    signalFd (readyFd);
+	    break;
+	}
+
+	readBatch ();
+
+	full = depth () == EVENT_RING_SIZE;
+    }
+}
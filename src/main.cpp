@@ -38,26 +38,7 @@
 
 #include <core/core.h>
 #include "privatescreen.h"
-
-char *programName;
-char **programArgv;
-int  programArgc;
-
-char *backgroundImage = NULL;
-
-bool shutDown = false;
-bool restartSignal = false;
-
-CompWindow *lastFoundWindow = 0;
-
-bool replaceCurrentWm = false;
-bool indirectRendering = false;
-bool noDetection = false;
-bool useDesktopHints = false;
-bool debugOutput = false;
-bool useCow = true;
-
-unsigned int pluginClassHandlerIndex = 0;
+#include "privatepluginpreloader.h"
 
 static void
 usage (void)
@@ -72,6 +53,10 @@ usage (void)
 	    "[--no-detection] "
 	    "[--keep-desktop-hints]\n       "
 	    "[--use-root-window] "
+	    "[--no-event-coalescing] "
+	    "[--threaded-events]\n       "
+	    "[--benchmark-matches] "
+	    "[--benchmark-options]\n       "
 	    "[--debug] "
 	    "[--version] "
 	    "[--help] "
@@ -150,6 +135,22 @@ main (int argc, char **argv)
 	{
 	    useCow = false;
 	}
+	else if (!strcmp (argv[i], "--no-event-coalescing"))
+	{
+	    coalesceEvents = false;
+	}
+	else if (!strcmp (argv[i], "--threaded-events"))
+	{
+	    threadedEvents = true;
+	}
+	else if (!strcmp (argv[i], "--benchmark-matches"))
+	{
+	    benchmarkMatches = true;
+	}
+	else if (!strcmp (argv[i], "--benchmark-options"))
+	{
+	    benchmarkOptions = true;
+	}
 	else if (!strcmp (argv[i], "--replace"))
 	{
 	    replaceCurrentWm = true;
@@ -211,7 +212,10 @@ main (int argc, char **argv)
     }
 
     if (!screen->init (displayName))
+    {
+	pluginPreloader.finish ();
 	return 1;
+    }
 
     modHandler->updateModifierMappings ();
 
@@ -25,8 +25,15 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <dlfcn.h>
+
+#include <algorithm>
+#include <typeinfo>
 
 #include <boost/foreach.hpp>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
 #define foreach BOOST_FOREACH
 
 #include <core/core.h>
@@ -39,8 +46,53 @@
 #include "privatescreen.h"
 #include "privatewindow.h"
 
+#define MATCH_BENCHMARK_ROUNDS 1000
+
 const CompMatch CompMatch::emptyMatch;
 
+/* counted atomically like the value counters, evaluating a match must
+   not take a lock */
+static MatchStats matchStats;
+
+static inline void
+matchStatsCount (unsigned int &counter)
+{
+    __sync_fetch_and_add (&counter, 1);
+}
+
+MatchStats
+getMatchStats (bool reset)
+{
+    MatchStats stats;
+
+    if (reset)
+    {
+	stats.evaluations = __sync_fetch_and_and (&matchStats.evaluations, 0);
+	stats.cached      = __sync_fetch_and_and (&matchStats.cached, 0);
+    }
+    else
+    {
+	stats.evaluations = __sync_fetch_and_add (&matchStats.evaluations, 0);
+	stats.cached      = __sync_fetch_and_add (&matchStats.cached, 0);
+    }
+
+    return stats;
+}
+
+/* set while matchExpHandlerChanged updates the match options */
+static bool         matchHandlerChanging = false;
+static unsigned int matchesRebuilt = 0;
+
+/* what handler changes are put down to, see matchSetHandlerScope */
+static CompString   matchScopePlugin;
+static bool         matchScopeLoading = false;
+
+static std::vector<std::pair<CompString, MatchIndex::KeyHook> > matchKeyHooks;
+
+/* bumped whenever a match is created, changed or destroyed, the index
+   holds pointers to matches and is rebuilt when this moved on */
+static unsigned int matchChangeGeneration = 0;
+
 class CoreExp : public CompMatch::Expression {
     public:
 	virtual ~CoreExp () {};
@@ -122,19 +174,20 @@ CompScreen::matchInitExp (const CompString& str)
 }
 
 static void
-matchUpdateMatchOptions (CompOption::Vector& options)
+matchForEachMatchOption (CompOption::Vector                  &options,
+			 boost::function<void (CompMatch &)> f)
 {
     foreach (CompOption &option, options)
     {
 	switch (option.type ()) {
 	    case CompOption::TypeMatch:
-		option.value ().match ().update ();
+		f (option.value ().match ());
 		break;
 	    case CompOption::TypeList:
 		if (option.value ().listType () == CompOption::TypeMatch)
 		{
 		    foreach (CompOption::Value &value, option.value ().list ())
-			value.match ().update ();
+			f (value.match ());
 		}
 	    default:
 		break;
@@ -142,21 +195,53 @@ matchUpdateMatchOptions (CompOption::Vector& options)
     }
 }
 
+static void
+matchUpdateMatchOptions (CompOption::Vector& options)
+{
+    matchForEachMatchOption (options, boost::bind (&CompMatch::update, _1));
+}
+
 void
 CompScreen::matchExpHandlerChanged ()
 {
     WRAPABLE_HND_FUNC (11, matchExpHandlerChanged)
 
+    /* only matches with leaves a plugin may take are rebuilt, see
+       CompMatch::update */
+    matchHandlerChanging = true;
+    matchesRebuilt = 0;
+
     foreach (CompPlugin *p, CompPlugin::getPlugins ())
     {
 	CompOption::Vector &options = p->vTable->getOptions ();
 	matchUpdateMatchOptions (options);
     }
+
+    matchHandlerChanging = false;
+
+    priv->matchIndex.invalidate ();
+
+    compLogMessage ("core", CompLogLevelDebug,
+		    "match expression handlers changed%s%s, "
+		    "%u matches rebuilt",
+		    matchScopePlugin.empty () ? "" : " by ",
+		    matchScopePlugin.c_str (), matchesRebuilt);
+}
+
+void
+matchSetHandlerScope (const CompString &plugin,
+		      bool             loading)
+{
+    matchScopePlugin  = plugin;
+    matchScopeLoading = loading;
 }
 
 void
 CompScreen::matchPropertyChanged (CompWindow *w)
 {
+    /* before passing it on, plugins may evaluate matches in there */
+    w->priv->updateMatchGeneration ();
+
     WRAPABLE_HND_FUNC (12, matchPropertyChanged, w)
 }
 
@@ -426,6 +511,42 @@ matchOpsToString (MatchOp::List &list)
     return value;
 }
 
+static CompString
+matchExpKey (const CompString &value)
+{
+    return value.substr (0, value.find ('='));
+}
+
+/* the plugin whose shared object defines the expression's class. The
+   wrap chain doesn't tell which plugin answered, but the type info of
+   a plugin's classes lives in its own library. */
+static CompString
+matchExpProvider (CompMatch::Expression *e)
+{
+    Dl_info expInfo, pluginInfo;
+
+    if (!e)
+	return CompString ();
+
+    if (dynamic_cast <CoreExp *> (e))
+	return "core";
+
+    if (!dladdr (&typeid (*e), &expInfo))
+	return CompString ();
+
+    foreach (CompPlugin *p, CompPlugin::getPlugins ())
+    {
+	if (p->devType != "dlloader")
+	    continue;
+
+	if (dladdr (&typeid (*p->vTable), &pluginInfo) &&
+	    pluginInfo.dli_fbase == expInfo.dli_fbase)
+	    return p->vTable->name ();
+    }
+
+    return CompString ();
+}
+
 static void
 matchUpdateOps (MatchOp::List &list)
 {
@@ -439,7 +560,33 @@ matchUpdateOps (MatchOp::List &list)
 	    case MatchOp::TypeExp:
 		exp = dynamic_cast <MatchExpOp *> (op);
 		if (exp && screen)
+		{
 		    exp->e.reset (screen->matchInitExp (exp->value));
+		    exp->provider = matchExpProvider (exp->e.get ());
+		}
+		break;
+	    default:
+		break;
+	}
+    }
+}
+
+static void
+matchAddProviders (MatchOp::List  &list,
+		   CompStringList &providers)
+{
+    MatchExpOp *exp;
+    foreach (MatchOp *op, list)
+    {
+	switch (op->type ()) {
+	    case MatchOp::TypeGroup:
+		matchAddProviders (dynamic_cast <MatchGroupOp *> (op)->op,
+				   providers);
+		break;
+	    case MatchOp::TypeExp:
+		exp = dynamic_cast <MatchExpOp *> (op);
+		if (exp)
+		    providers.push_back (exp->provider);
 		break;
 	    default:
 		break;
@@ -447,6 +594,69 @@ matchUpdateOps (MatchOp::List &list)
     }
 }
 
+/* whether the plugin being loaded would take any of the leaves, asks
+   the handlers again for each of them */
+static bool
+matchClaimsLeaves (MatchOp::List    &list,
+		   const CompString &plugin)
+{
+    CompMatch::Expression *e;
+    MatchExpOp            *exp;
+    bool                  claimed;
+
+    foreach (MatchOp *op, list)
+    {
+	switch (op->type ()) {
+	    case MatchOp::TypeGroup:
+		if (matchClaimsLeaves (dynamic_cast <MatchGroupOp *> (op)->op,
+				       plugin))
+		    return true;
+		break;
+	    case MatchOp::TypeExp:
+		exp = dynamic_cast <MatchExpOp *> (op);
+		if (!exp || !screen)
+		    break;
+
+		e = screen->matchInitExp (exp->value);
+		claimed = (matchExpProvider (e) == plugin);
+		delete e;
+
+		if (claimed)
+		    return true;
+		break;
+	    default:
+		break;
+	}
+    }
+
+    return false;
+}
+
+/* whether an expression handler change can affect the match. Leaves
+   a plugin provides only change when that plugin goes away, any leaf
+   may change when one is loaded, core ones included, as plugins are
+   free to claim whatever they like. Without a plugin to put the change
+   down to, or with leaves nobody can tell the provider of, the match
+   is always rebuilt. */
+static bool
+matchNeedsRebuild (PrivateMatch *priv)
+{
+    CompStringList &providers = priv->providers;
+
+    if (matchScopePlugin.empty ())
+	return true;
+
+    if (std::find (providers.begin (), providers.end (),
+		   CompString ()) != providers.end ())
+	return true;
+
+    if (!matchScopeLoading)
+	return std::find (providers.begin (), providers.end (),
+			  matchScopePlugin) != providers.end ();
+
+    return matchClaimsLeaves (priv->op.op, matchScopePlugin);
+}
+
 static bool
 matchEvalOps (MatchOp::List &list,
 	      CompWindow    *w)
@@ -499,6 +709,604 @@ matchEvalOps (MatchOp::List &list,
     return result;
 }
 
+#define MATCH_EXIT_UNSET (~0u)
+
+static void
+matchCompileExp (MatchExpOp       *exp,
+		 MatchInstruction &i)
+{
+    CoreExp *core = dynamic_cast <CoreExp *> (exp->e.get ());
+
+    if (!exp->e.get ())
+    {
+	i.op = MatchInstruction::OpTrue;
+	return;
+    }
+
+    if (!core)
+    {
+	i.op      = MatchInstruction::OpCall;
+	i.arg.ptr = exp->e.get ();
+	return;
+    }
+
+    i.arg = core->priv;
+
+    switch (core->mType) {
+	case CoreExp::TypeXid:
+	    i.op = MatchInstruction::OpXid;
+	    break;
+	case CoreExp::TypeState:
+	    i.op = MatchInstruction::OpState;
+	    break;
+	case CoreExp::TypeOverride:
+	    /* override_redirect=0 tests the opposite, anything but 0 or 1
+	       never matches */
+	    if (core->priv.val == 1 || core->priv.val == 0)
+	    {
+		i.op = MatchInstruction::OpOverride;
+		i.negate ^= (core->priv.val == 0);
+	    }
+	    else
+	    {
+		i.op = MatchInstruction::OpTrue;
+		i.negate ^= true;
+	    }
+	    break;
+	case CoreExp::TypeRGBA:
+	    i.op = MatchInstruction::OpRGBA;
+	    i.negate ^= (core->priv.val == 0);
+	    break;
+	case CoreExp::TypeType:
+	    i.op = MatchInstruction::OpType;
+	    break;
+    }
+}
+
+/* appends the instructions for list, whatever leaves the list early
+   jumps to the instruction following them */
+static void
+matchCompileOps (MatchOp::List &list,
+		 MatchProgram  &program)
+{
+    unsigned int     start = program.size ();
+    bool             first = true;
+    MatchInstruction i;
+
+    foreach (MatchOp *op, list)
+    {
+	memset (&i, 0, sizeof (i));
+
+	if (op->flags & MATCH_OP_AND_MASK)
+	    i.guard = MatchInstruction::GuardAnd;
+	else if (!first)
+	    i.guard = MatchInstruction::GuardOr;
+	else
+	    i.guard = MatchInstruction::GuardNone;
+
+	i.exit = MATCH_EXIT_UNSET;
+	first  = false;
+
+	switch (op->type ()) {
+	    case MatchOp::TypeGroup:
+		i.op = MatchInstruction::OpGroup;
+		program.push_back (i);
+
+		matchCompileOps (dynamic_cast <MatchGroupOp *> (op)->op,
+				 program);
+
+		if (op->flags & MATCH_OP_NOT_MASK)
+		{
+		    memset (&i, 0, sizeof (i));
+		    i.op   = MatchInstruction::OpNot;
+		    i.exit = MATCH_EXIT_UNSET;
+		    program.push_back (i);
+		}
+		break;
+	    case MatchOp::TypeExp:
+		i.negate = (op->flags & MATCH_OP_NOT_MASK);
+		matchCompileExp (dynamic_cast <MatchExpOp *> (op), i);
+		program.push_back (i);
+		break;
+	    default:
+		i.op     = MatchInstruction::OpTrue;
+		i.negate = (op->flags & MATCH_OP_NOT_MASK);
+		program.push_back (i);
+		break;
+	}
+    }
+
+    /* nested lists resolved theirs already */
+    for (unsigned int n = start; n < program.size (); n++)
+	if (program[n].exit == MATCH_EXIT_UNSET)
+	    program[n].exit = program.size ();
+}
+
+static bool
+matchEvalProgram (const MatchProgram &program,
+		  CompWindow         *w)
+{
+    bool         result = false;
+    unsigned int pc = 0, n = program.size ();
+
+    while (pc < n)
+    {
+	const MatchInstruction &i = program[pc];
+
+	/* fast evaluation */
+	if ((i.guard == MatchInstruction::GuardAnd && !result) ||
+	    (i.guard == MatchInstruction::GuardOr && result))
+	{
+	    pc = i.exit;
+	    continue;
+	}
+
+	switch (i.op) {
+	    case MatchInstruction::OpGroup:
+		result = false;
+		break;
+	    case MatchInstruction::OpNot:
+		result = !result;
+		break;
+	    case MatchInstruction::OpTrue:
+		result = true;
+		break;
+	    case MatchInstruction::OpXid:
+		result = ((unsigned int) i.arg.val == w->id ());
+		break;
+	    case MatchInstruction::OpState:
+		result = (i.arg.uval & w->state ());
+		break;
+	    case MatchInstruction::OpOverride:
+		result = w->overrideRedirect ();
+		break;
+	    case MatchInstruction::OpRGBA:
+		result = w->alpha ();
+		break;
+	    case MatchInstruction::OpType:
+		result = (i.arg.uval & w->wmType ());
+		break;
+	    case MatchInstruction::OpCall:
+		result = ((CompMatch::Expression *) i.arg.ptr)->evaluate (w);
+		break;
+	}
+
+	if (i.negate)
+	    result = !result;
+
+	pc++;
+    }
+
+    return result;
+}
+
+MatchIndex::MatchIndex () :
+    valid (false),
+    generation (0),
+    matches (),
+    always (),
+    buckets (),
+    stamps (),
+    stamp (0)
+{
+}
+
+void
+MatchIndex::invalidate ()
+{
+    valid = false;
+}
+
+void
+MatchIndex::addKeyHook (const CompString &prefix,
+			KeyHook          hook)
+{
+    matchKeyHooks.push_back (std::make_pair (prefix, hook));
+    matchChangeGeneration++;
+}
+
+void
+MatchIndex::rebuild ()
+{
+    matches.clear ();
+    always.clear ();
+    buckets.clear ();
+
+    foreach (CompPlugin *p, CompPlugin::getPlugins ())
+	matchForEachMatchOption (p->vTable->getOptions (),
+				 boost::bind (&MatchIndex::add, this, _1));
+
+    stamps.assign (matches.size (), 0);
+    stamp      = 0;
+    valid      = true;
+    generation = matchChangeGeneration;
+}
+
+void
+MatchIndex::add (CompMatch &match)
+{
+    PrivateMatch parsed;
+    KeyList      keys;
+    unsigned int index = matches.size ();
+
+    matchAddFromString (parsed.op.op, match.toString ());
+    matchUpdateOps (parsed.op.op);
+
+    matches.push_back (&match);
+
+    if (!listKeys (parsed.op.op, keys))
+    {
+	always.push_back (index);
+	return;
+    }
+
+    /* no keys at all means the match can't match anything */
+    foreach (Key &key, keys)
+	buckets[key].push_back (index);
+}
+
+/* Fills keys so that a window only satisfies the list when it has one
+   of them. Returns false when there are no such keys. */
+bool
+MatchIndex::listKeys (MatchOp::List &list,
+		      KeyList       &keys)
+{
+    MatchOp::List::iterator it = list.begin ();
+
+    /* the list is only true if all operands of one of its '|' branches
+       are, so each branch is filed under the operand with fewest keys */
+    while (it != list.end ())
+    {
+	KeyList best, operand;
+	bool    found = false;
+
+	do
+	{
+	    operand.clear ();
+
+	    if (!((*it)->flags & MATCH_OP_NOT_MASK) &&
+		opKeys (*it, operand) &&
+		(!found || operand.size () < best.size ()))
+	    {
+		best.swap (operand);
+		found = true;
+	    }
+
+	    it++;
+	} while (it != list.end () && ((*it)->flags & MATCH_OP_AND_MASK));
+
+	if (!found)
+	    return false;
+
+	keys.insert (keys.end (), best.begin (), best.end ());
+    }
+
+    return true;
+}
+
+bool
+MatchIndex::opKeys (MatchOp *op,
+		    KeyList &keys)
+{
+    switch (op->type ()) {
+	case MatchOp::TypeGroup:
+	    return listKeys (dynamic_cast <MatchGroupOp *> (op)->op, keys);
+	case MatchOp::TypeExp:
+	    return leafKeys (dynamic_cast <MatchExpOp *> (op), keys);
+	default:
+	    break;
+    }
+
+    return false;
+}
+
+bool
+MatchIndex::leafKeys (MatchExpOp *exp,
+		      KeyList    &keys)
+{
+    CoreExp      *core;
+    unsigned int mask;
+
+    if (!exp || !exp->e)
+	return false;
+
+    core = dynamic_cast <CoreExp *> (exp->e.get ());
+    if (!core)
+    {
+	CompString key = matchExpKey (exp->value);
+
+	for (unsigned int i = 0; i < matchKeyHooks.size (); i++)
+	{
+	    if (key != matchKeyHooks[i].first || key == exp->value)
+		continue;
+
+	    keys.push_back (Key (KeyHookBase + i,
+				 boost::hash<CompString> () (
+				     exp->value.substr (key.size () + 1))));
+	    return true;
+	}
+
+	return false;
+    }
+
+    switch (core->mType) {
+	case CoreExp::TypeXid:
+	    keys.push_back (Key (KeyXid, (unsigned int) core->priv.val));
+	    return true;
+	case CoreExp::TypeState:
+	case CoreExp::TypeType:
+	    mask = core->priv.uval;
+	    for (unsigned int bit = 1; mask; bit <<= 1)
+	    {
+		if (mask & bit)
+		{
+		    keys.push_back (Key (core->mType == CoreExp::TypeState ?
+					 KeyState : KeyType, bit));
+		    mask &= ~bit;
+		}
+	    }
+	    return true;
+	default:
+	    break;
+    }
+
+    return false;
+}
+
+void
+MatchIndex::windowKeys (CompWindow *w,
+			KeyList    &keys)
+{
+    unsigned int type = w->wmType (), state = w->state ();
+
+    keys.push_back (Key (KeyXid, (unsigned int) w->id ()));
+
+    for (unsigned int bit = 1; type; bit <<= 1)
+	if (type & bit)
+	{
+	    keys.push_back (Key (KeyType, bit));
+	    type &= ~bit;
+	}
+
+    for (unsigned int bit = 1; state; bit <<= 1)
+	if (state & bit)
+	{
+	    keys.push_back (Key (KeyState, bit));
+	    state &= ~bit;
+	}
+
+    for (unsigned int i = 0; i < matchKeyHooks.size (); i++)
+	keys.push_back (Key (KeyHookBase + i,
+			     boost::hash<CompString> () (
+				 (*matchKeyHooks[i].second) (w))));
+}
+
+void
+MatchIndex::matching (CompWindow *w,
+		      List       &result)
+{
+    std::vector<unsigned int> candidates (always);
+    KeyList                   keys;
+
+    if (!valid || generation != matchChangeGeneration)
+	rebuild ();
+
+    if (++stamp == 0)
+    {
+	stamps.assign (matches.size (), 0);
+	stamp = 1;
+    }
+
+    windowKeys (w, keys);
+
+    foreach (Key &key, keys)
+    {
+	Buckets::iterator it = buckets.find (key);
+
+	if (it == buckets.end ())
+	    continue;
+
+	foreach (unsigned int index, it->second)
+	{
+	    if (stamps[index] != stamp)
+	    {
+		stamps[index] = stamp;
+		candidates.push_back (index);
+	    }
+	}
+    }
+
+    std::sort (candidates.begin (), candidates.end ());
+
+    foreach (unsigned int index, candidates)
+	if (matches[index]->evaluate (w))
+	    result.push_back (matches[index]);
+}
+
+void
+MatchOptions::matching (CompWindow               *w,
+			std::vector<CompMatch *> &result)
+{
+    if (screen)
+	screen->priv->matchIndex.matching (w, result);
+}
+
+void
+MatchOptions::addKeyHook (const char *prefix,
+			  CompString (*hook) (CompWindow *w))
+{
+    MatchIndex::addKeyHook (prefix, hook);
+}
+
+static void
+matchCollectStrings (CompOption::Vector      &options,
+		     std::vector<CompString> &strings)
+{
+    foreach (CompOption &option, options)
+    {
+	switch (option.type ()) {
+	    case CompOption::TypeMatch:
+		strings.push_back (option.value ().match ().toString ());
+		break;
+	    case CompOption::TypeList:
+		if (option.value ().listType () == CompOption::TypeMatch)
+		{
+		    foreach (CompOption::Value &value, option.value ().list ())
+			strings.push_back (value.match ().toString ());
+		}
+	    default:
+		break;
+	}
+    }
+}
+
+static long long
+matchBenchmarkNow ()
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+
+    return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void
+matchCollect (std::vector<CompMatch *> *matches,
+	      CompMatch                &match)
+{
+    matches->push_back (&match);
+}
+
+/* Finds the match options matching every window, once by evaluating all
+   of them and once through the index, and logs how long it took. */
+static void
+matchBenchmarkIndex (MatchIndex &index)
+{
+    MatchIndex::List all, linear, indexed;
+    unsigned int     mismatches = 0;
+    long long        elapsed[2] = { 0, 0 }, start;
+
+    foreach (CompPlugin *p, CompPlugin::getPlugins ())
+	matchForEachMatchOption (p->vTable->getOptions (),
+				 boost::bind (matchCollect, &all, _1));
+
+    foreach (CompWindow *w, screen->windows ())
+    {
+	linear.clear ();
+	foreach (CompMatch *match, all)
+	    if (match->evaluate (w))
+		linear.push_back (match);
+
+	indexed.clear ();
+	index.matching (w, indexed);
+
+	if (linear != indexed)
+	{
+	    compLogMessage ("core", CompLogLevelWarn,
+			    "match benchmark: index finds %u instead of %u "
+			    "matches for window 0x%lx",
+			    (unsigned int) indexed.size (),
+			    (unsigned int) linear.size (), w->id ());
+	    mismatches++;
+	}
+    }
+
+    start = matchBenchmarkNow ();
+    for (int i = 0; i < MATCH_BENCHMARK_ROUNDS; i++)
+	foreach (CompWindow *w, screen->windows ())
+	{
+	    linear.clear ();
+	    foreach (CompMatch *match, all)
+		if (match->evaluate (w))
+		    linear.push_back (match);
+	}
+    elapsed[0] = matchBenchmarkNow () - start;
+
+    start = matchBenchmarkNow ();
+    for (int i = 0; i < MATCH_BENCHMARK_ROUNDS; i++)
+	foreach (CompWindow *w, screen->windows ())
+	{
+	    indexed.clear ();
+	    index.matching (w, indexed);
+	}
+    elapsed[1] = matchBenchmarkNow () - start;
+
+    double queries = (double) screen->windows ().size () *
+		     MATCH_BENCHMARK_ROUNDS;
+
+    compLogMessage ("core", CompLogLevelInfo,
+		    "match benchmark: finding the matches of a window took "
+		    "%.1f ns linearly, %.1f ns indexed (%u mismatches)",
+		    elapsed[0] / queries, elapsed[1] / queries, mismatches);
+}
+
+/* Runs every match option of every active plugin against every window,
+   first walking the parsed expression tree and then through the compiled
+   program, and logs how long an evaluation took on average with each. */
+void
+matchBenchmark (MatchIndex &index)
+{
+    std::vector<CompString> strings;
+    unsigned int            windows = screen->windows ().size ();
+    unsigned int            mismatches = 0, matched[2] = { 0, 0 };
+    long long               elapsed[2] = { 0, 0 }, start;
+
+    foreach (CompPlugin *p, CompPlugin::getPlugins ())
+	matchCollectStrings (p->vTable->getOptions (), strings);
+
+    if (strings.empty () || !windows)
+    {
+	compLogMessage ("core", CompLogLevelInfo,
+			"match benchmark: nothing to evaluate");
+	return;
+    }
+
+    foreach (CompString &str, strings)
+    {
+	PrivateMatch match;
+
+	matchAddFromString (match.op.op, str);
+	matchUpdateOps (match.op.op);
+	matchCompileOps (match.op.op, match.program);
+
+	foreach (CompWindow *w, screen->windows ())
+	{
+	    if (matchEvalOps (match.op.op, w) !=
+		matchEvalProgram (match.program, w))
+	    {
+		compLogMessage ("core", CompLogLevelWarn,
+				"match benchmark: \"%s\" differs on "
+				"window 0x%lx", str.c_str (), w->id ());
+		mismatches++;
+	    }
+	}
+
+	start = matchBenchmarkNow ();
+	for (int i = 0; i < MATCH_BENCHMARK_ROUNDS; i++)
+	    foreach (CompWindow *w, screen->windows ())
+		matched[0] += matchEvalOps (match.op.op, w);
+	elapsed[0] += matchBenchmarkNow () - start;
+
+	start = matchBenchmarkNow ();
+	for (int i = 0; i < MATCH_BENCHMARK_ROUNDS; i++)
+	    foreach (CompWindow *w, screen->windows ())
+		matched[1] += matchEvalProgram (match.program, w);
+	elapsed[1] += matchBenchmarkNow () - start;
+    }
+
+    double evaluations = (double) strings.size () * windows *
+			 MATCH_BENCHMARK_ROUNDS;
+
+    compLogMessage ("core", CompLogLevelInfo,
+		    "match benchmark: %u matches on %u windows, tree %.1f ns, "
+		    "program %.1f ns per evaluation (%u/%u matched, "
+		    "%u mismatches)", (unsigned int) strings.size (), windows,
+		    elapsed[0] / evaluations, elapsed[1] / evaluations,
+		    matched[0], matched[1], mismatches);
+
+    matchBenchmarkIndex (index);
+}
+
 MatchOp::MatchOp () :
     flags (0)
 {
@@ -510,13 +1318,15 @@ MatchOp::~MatchOp ()
 
 MatchExpOp::MatchExpOp () :
     value (""),
-    e ()
+    e (),
+    provider ()
 {
 }
 
 MatchExpOp::MatchExpOp (const MatchExpOp &ex) :
     value (ex.value),
-    e (ex.e)
+    e (ex.e),
+    provider (ex.provider)
 {
     flags = ex.flags;
 }
@@ -571,7 +1381,11 @@ MatchGroupOp::operator= (const MatchGroupOp &gr)
 }
 
 PrivateMatch::PrivateMatch () :
-    op ()
+    op (),
+    program (),
+    providers (),
+    cacheable (false),
+    cache ()
 {
 }
 
@@ -579,6 +1393,7 @@ PrivateMatch::PrivateMatch () :
 CompMatch::CompMatch () :
     priv (new PrivateMatch ())
 {
+    matchChangeGeneration++;
 }
 
 CompMatch::CompMatch (const CompString str) :
@@ -597,20 +1412,77 @@ CompMatch::CompMatch (const CompMatch &match) :
 
 CompMatch::~CompMatch ()
 {
+    matchChangeGeneration++;
+
     delete priv;
 }
 
 void
 CompMatch::update ()
 {
+    /* an expression handler came or went, nothing to do if it
+       doesn't touch any of our leaves */
+    if (matchHandlerChanging)
+    {
+	if (!matchNeedsRebuild (priv))
+	    return;
+
+	matchesRebuilt++;
+    }
+
+    matchChangeGeneration++;
+
     matchResetOps (priv->op.op);
     matchUpdateOps (priv->op.op);
+
+    priv->providers.clear ();
+    matchAddProviders (priv->op.op, priv->providers);
+    priv->providers.sort ();
+    priv->providers.unique ();
+
+    priv->program.clear ();
+    matchCompileOps (priv->op.op, priv->program);
+
+    priv->cacheable = false;
+    foreach (MatchInstruction &i, priv->program)
+	if (i.op == MatchInstruction::OpCall)
+	    priv->cacheable = true;
+
+    priv->cache.clear ();
 }
 
 bool
 CompMatch::evaluate (CompWindow *window)
 {
-    return matchEvalOps (priv->op.op, window);
+    unsigned int generation;
+
+    matchStatsCount (matchStats.evaluations);
+
+    if (!priv->cacheable)
+	return matchEvalProgram (priv->program, window);
+
+    generation = PrivateWindow::matchGenerationOf (window);
+
+    MatchCache::iterator it = priv->cache.find (window);
+    if (it != priv->cache.end () && it->second.generation == generation)
+    {
+	matchStatsCount (matchStats.cached);
+	return it->second.value;
+    }
+
+    /* entries of windows that went away are never looked up again */
+    if (it == priv->cache.end () &&
+	priv->cache.size () >= 2 * screen->windows ().size () + 16)
+	priv->cache.clear ();
+
+    bool value = matchEvalProgram (priv->program, window);
+
+    MatchCacheEntry &entry = priv->cache[window];
+
+    entry.generation = generation;
+    entry.value      = value;
+
+    return value;
 }
 
 CompString
@@ -143,6 +143,7 @@ ModifierHandler::updateModifierMappings ()
 		(modMask[CompModNumLock]    & ~CompNoMask) |
 		(modMask[CompModScrollLock] & ~CompNoMask);
 
+	    screen->priv->actionIndex.invalidate ();
 	    screen->priv->updatePassiveKeyGrabs ();
 	}
     }
@@ -28,6 +28,9 @@
 #include <strings.h>
 #include <ctype.h>
 #include <math.h>
+#include <time.h>
+
+#include <new>
 
 #include <boost/foreach.hpp>
 #define foreach BOOST_FOREACH
@@ -35,6 +38,7 @@
 #include <core/core.h>
 #include <core/option.h>
 #include "privateoption.h"
+#include "privatescreen.h"
 
 CompOption::Vector noOptions (0);
 
@@ -152,41 +156,36 @@ CompOption::Value::set (const unsigned short *color)
 void
 CompOption::Value::set (const CompString& s)
 {
-    priv->reset ();
+    priv->string () = s;
     priv->type = CompOption::TypeString;
-    priv->string = s;
 }
 
 void
 CompOption::Value::set (const char *s)
 {
-    priv->reset ();
+    priv->string () = s;
     priv->type = CompOption::TypeString;
-    priv->string = CompString (s);
 }
 
 void
 CompOption::Value::set (const CompMatch& m)
 {
-    priv->reset ();
+    priv->match () = m;
     priv->type = CompOption::TypeMatch;
-    priv->match = m;
 }
 
 void
 CompOption::Value::set (const CompAction& a)
 {
-    priv->reset ();
+    priv->action () = a;
     priv->type = CompOption::TypeAction;
-    priv->action = a;
 }
 
 void
 CompOption::Value::set (CompOption::Type type, const Vector& l)
 {
-    priv->reset ();
+    priv->list () = l;
     priv->type = CompOption::TypeList;
-    priv->list = l;
     priv->listType = type;
 }
 
@@ -251,7 +250,7 @@ CompOption::Value::s ()
     if (!priv->checkType (CompOption::TypeString))
 	return "";
 
-    return priv->string;
+    return priv->string ();
 }
 
 CompMatch &
@@ -259,7 +258,7 @@ CompOption::Value::match ()
 {
     priv->checkType (CompOption::TypeMatch);
 
-    return priv->match;
+    return priv->match ();
 }
 
 CompAction &
@@ -271,7 +270,7 @@ CompOption::Value::action ()
 	compLogMessage ("core", CompLogLevelWarn,
 			"CompOption::Value not an action");
 
-    return priv->action;
+    return priv->action ();
 }
 
 CompOption::Type
@@ -287,7 +286,7 @@ CompOption::Value::list ()
 {
     priv->checkType (CompOption::TypeList);
 
-    return priv->list;
+    return priv->list ();
 }
 
 CompOption::Value::operator bool ()
@@ -368,26 +367,26 @@ CompOption::Value::operator== (const CompOption::Value &val)
 	    break;
 
 	case CompOption::TypeString:
-	    return priv->string.compare (val.priv->string) == 0;
+	    return priv->string ().compare (val.priv->string ()) == 0;
 	    break;
 
 	case CompOption::TypeMatch:
-	    return priv->match == val.priv->match;
+	    return priv->match () == val.priv->match ();
 	    break;
 
 	case CompOption::TypeAction:
-	    return priv->action == val.priv->action;
+	    return priv->action () == val.priv->action ();
 	    break;
 
 	case CompOption::TypeList:
 	    if (priv->listType != val.priv->listType)
 		return false;
 
-	    if (priv->list.size () != val.priv->list.size ())
+	    if (priv->list ().size () != val.priv->list ().size ())
 		return false;
 
-	    for (unsigned int i = 0; i < priv->list.size (); i++)
-		if (priv->list[i] != val.priv->list[i])
+	    for (unsigned int i = 0; i < priv->list ().size (); i++)
+		if (priv->list ()[i] != val.priv->list ()[i])
 		    return false;
 
 	    return true;
@@ -409,32 +408,263 @@ CompOption::Value::operator!= (const CompOption::Value &val)
 CompOption::Value &
 CompOption::Value::operator= (const CompOption::Value &val)
 {
-    delete priv;
-    priv = new PrivateValue (*val.priv);
+    /* assigned in place, a value keeps what it holds if it can */
+    *priv = *val.priv;
 
     return *this;
 }
 
+/* counted atomically, plugins may create values on threads of their
+   own and a lock would cost more than the allocations it counts */
+static ValueStats valueStats;
+
+static inline void
+valueStatsCount (unsigned int &counter)
+{
+    __sync_fetch_and_add (&counter, 1);
+}
+
+static unsigned int
+valueStatsRead (unsigned int &counter,
+		bool         reset)
+{
+    if (reset)
+	return __sync_fetch_and_and (&counter, 0);
+
+    return __sync_fetch_and_add (&counter, 0);
+}
+
+ValueStats
+getValueStats (bool reset)
+{
+    ValueStats stats;
+
+    stats.allocated = valueStatsRead (valueStats.allocated, reset);
+    stats.reused    = valueStatsRead (valueStats.reused, reset);
+    stats.stored    = valueStatsRead (valueStats.stored, reset);
+
+    return stats;
+}
+
+#define VALUE_POOL_SIZE 1024
+
+/* freed PrivateValues, linked through their first bytes. Per thread, so
+   values plugins create on threads of their own don't need a lock */
+static __thread void         *valuePool = NULL;
+static __thread unsigned int valuePoolSize = 0;
+
+void *
+PrivateValue::operator new (size_t size)
+{
+    void *p = valuePool;
+
+    if (!p)
+    {
+	valueStatsCount (valueStats.allocated);
+	return ::operator new (size);
+    }
+
+    valuePool = *reinterpret_cast<void **> (p);
+    valuePoolSize--;
+    valueStatsCount (valueStats.reused);
+
+    return p;
+}
+
+void
+PrivateValue::operator delete (void *p)
+{
+    if (!p)
+	return;
+
+    if (valuePoolSize >= VALUE_POOL_SIZE)
+    {
+	::operator delete (p);
+	return;
+    }
+
+    *reinterpret_cast<void **> (p) = valuePool;
+    valuePool = p;
+    valuePoolSize++;
+}
+
 PrivateValue::PrivateValue () :
     type (CompOption::TypeUnset),
-    string (""),
-    action (),
-    match (),
     listType (CompOption::TypeUnset),
-    list ()
+    stored (StoredNone)
 {
     memset (&value, 0, sizeof (ValueUnion));
 }
 
 PrivateValue::PrivateValue (const PrivateValue& p) :
-    type (p.type),
-    string (p.string),
-    action (p.action),
-    match (p.match),
-    listType (p.listType),
-    list (p.list)
+    type (CompOption::TypeUnset),
+    listType (CompOption::TypeUnset),
+    stored (StoredNone)
+{
+    *this = p;
+}
+
+PrivateValue::~PrivateValue ()
+{
+    release ();
+}
+
+PrivateValue &
+PrivateValue::operator= (const PrivateValue &p)
 {
+    if (this == &p)
+	return *this;
+
+    if (stored == p.stored)
+    {
+	switch (stored) {
+	    case StoredString:
+		string () = *reinterpret_cast<const CompString *>
+		    (p.storage.string);
+		break;
+	    case StoredAction:
+		action () = *reinterpret_cast<const CompAction *>
+		    (p.storage.action);
+		break;
+	    case StoredMatch:
+		match () = *reinterpret_cast<const CompMatch *>
+		    (p.storage.match);
+		break;
+	    case StoredList:
+		list () = *reinterpret_cast<const CompOption::Value::Vector *>
+		    (p.storage.list);
+		break;
+	    default:
+		break;
+	}
+    }
+    else
+    {
+	release ();
+
+	/* copy constructed, not default constructed and assigned */
+	switch (p.stored) {
+	    case StoredString:
+		new (storage.string) CompString (
+		    *reinterpret_cast<const CompString *> (p.storage.string));
+		break;
+	    case StoredAction:
+		new (storage.action) CompAction (
+		    *reinterpret_cast<const CompAction *> (p.storage.action));
+		break;
+	    case StoredMatch:
+		new (storage.match) CompMatch (
+		    *reinterpret_cast<const CompMatch *> (p.storage.match));
+		break;
+	    case StoredList:
+		new (storage.list) CompOption::Value::Vector (
+		    *reinterpret_cast<const CompOption::Value::Vector *>
+		    (p.storage.list));
+		break;
+	    default:
+		break;
+	}
+
+	if (p.stored != StoredNone)
+	    valueStatsCount (valueStats.stored);
+
+	stored = p.stored;
+    }
+
+    type     = p.type;
+    listType = p.listType;
     memcpy (&value, &p.value, sizeof (ValueUnion));
+
+    return *this;
+}
+
+void
+PrivateValue::store (Stored what)
+{
+    release ();
+
+    switch (what) {
+	case StoredString:
+	    new (storage.string) CompString ();
+	    break;
+	case StoredAction:
+	    new (storage.action) CompAction ();
+	    break;
+	case StoredMatch:
+	    new (storage.match) CompMatch ();
+	    break;
+	case StoredList:
+	    new (storage.list) CompOption::Value::Vector ();
+	    break;
+	default:
+	    break;
+    }
+
+    if (what != StoredNone)
+	valueStatsCount (valueStats.stored);
+
+    stored = what;
+}
+
+void
+PrivateValue::release ()
+{
+    switch (stored) {
+	case StoredString:
+	    reinterpret_cast<CompString *> (storage.string)->~CompString ();
+	    break;
+	case StoredAction:
+	    reinterpret_cast<CompAction *> (storage.action)->~CompAction ();
+	    break;
+	case StoredMatch:
+	    reinterpret_cast<CompMatch *> (storage.match)->~CompMatch ();
+	    break;
+	case StoredList:
+	    reinterpret_cast<CompOption::Value::Vector *>
+		(storage.list)->~vector ();
+	    listType = CompOption::TypeBool;
+	    break;
+	default:
+	    break;
+    }
+
+    stored = StoredNone;
+}
+
+CompString &
+PrivateValue::string ()
+{
+    if (stored != StoredString)
+	store (StoredString);
+
+    return *reinterpret_cast<CompString *> (storage.string);
+}
+
+CompAction &
+PrivateValue::action ()
+{
+    if (stored != StoredAction)
+	store (StoredAction);
+
+    return *reinterpret_cast<CompAction *> (storage.action);
+}
+
+CompMatch &
+PrivateValue::match ()
+{
+    if (stored != StoredMatch)
+	store (StoredMatch);
+
+    return *reinterpret_cast<CompMatch *> (storage.match);
+}
+
+CompOption::Value::Vector &
+PrivateValue::list ()
+{
+    if (stored != StoredList)
+	store (StoredList);
+
+    return *reinterpret_cast<CompOption::Value::Vector *> (storage.list);
 }
 
 bool
@@ -461,23 +691,7 @@ PrivateValue::checkType (CompOption::Type refType)
 void
 PrivateValue::reset ()
 {
-    switch (type) {
-	case CompOption::TypeString:
-	    string = "";
-	    break;
-	case CompOption::TypeMatch:
-	    match = CompMatch ();
-	    break;
-	case CompOption::TypeAction:
-	    action = CompAction ();
-	    break;
-	case CompOption::TypeList:
-	    list.clear ();
-	    listType = CompOption::TypeBool;
-	    break;
-	default:
-	    break;
-    }
+    release ();
     type = CompOption::TypeBool;
 }
 
@@ -744,6 +958,10 @@ CompOption::set (CompOption::Value &val)
 	    screen->removeAction (&priv->value.action ());
     }
 
+    /* dispatch looks actions up by their bindings */
+    if (isAction () && screen)
+	screen->priv->actionIndex.invalidate ();
+
     switch (priv->type)
     {
 	case CompOption::TypeInt:
@@ -962,3 +1180,72 @@ PrivateOption::PrivateOption (const PrivateOption &p) :
 {
 }
 
+
+#define OPTION_BENCHMARK_ENTRIES 1000
+#define OPTION_BENCHMARK_ROUNDS  100
+
+static long long
+optionBenchmarkNow ()
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+
+    return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Sets a large string list option back and forth the way the setOption
+   of a plugin does after setOptionForPlugin found it, and logs how long
+   that took and how many allocations of value storage it needed. */
+void
+optionBenchmark ()
+{
+    CompOption::Vector        options (1);
+    CompOption::Value::Vector lists[2];
+    CompOption::Value         values[2];
+    ValueStats                before, after;
+    long long                 start, elapsed;
+    unsigned int              allocations, copies;
+
+    options[0].setName ("benchmark_list", CompOption::TypeList);
+
+    for (unsigned int i = 0; i < OPTION_BENCHMARK_ENTRIES; i++)
+    {
+	CompOption::Value entry (compPrintf ("entry-%u", i));
+
+	lists[0].push_back (entry);
+	lists[1].push_back (entry);
+    }
+
+    lists[1].back ().set ("changed");
+
+    values[0].set (CompOption::TypeString, lists[0]);
+    values[1].set (CompOption::TypeString, lists[1]);
+    options[0].value ().set (CompOption::TypeString, lists[1]);
+
+    before = getValueStats ();
+    start  = optionBenchmarkNow ();
+
+    for (unsigned int i = 0; i < OPTION_BENCHMARK_ROUNDS; i++)
+    {
+	CompOption *o = CompOption::findOption (options, "benchmark_list");
+
+	CompOption::setOption (*o, values[i % 2]);
+    }
+
+    elapsed     = optionBenchmarkNow () - start;
+    after       = getValueStats ();
+    allocations = (after.allocated - before.allocated) +
+		  (after.stored - before.stored);
+    copies      = OPTION_BENCHMARK_ROUNDS * (OPTION_BENCHMARK_ENTRIES + 1);
+
+    compLogMessage ("core", CompLogLevelInfo,
+		    "option benchmark: setting a list of %u strings took "
+		    "%.1f us, %.2f allocations per value copied, "
+		    "%u bytes per value",
+		    OPTION_BENCHMARK_ENTRIES,
+		    elapsed / (OPTION_BENCHMARK_ROUNDS * 1000.0),
+		    (double) allocations / copies,
+		    (unsigned int) (sizeof (CompOption::Value) +
+				    sizeof (PrivateValue)));
+}
@@ -27,7 +27,6 @@
 #include <stdlib.h>
 #include <string.h>
 #include <dlfcn.h>
-#include <dirent.h>
 #include <errno.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -38,6 +37,9 @@
 
 #include <core/core.h>
 #include "privatescreen.h"
+#include "privateatoms.h"
+#include "privatepluginregistry.h"
+#include "privatepluginpreloader.h"
 
 CompPlugin::Map pluginsMap;
 CompPlugin::List plugins;
@@ -154,17 +156,23 @@ dlloaderLoadPlugin (CompPlugin *p,
 	return false;
     }
 
+    pluginPreloader.opening (file);
+
     dlhand = dlopen (file.c_str (), RTLD_LAZY);
+
     if (dlhand)
     {
 	PluginGetInfoProc getInfo;
 	char		  *error;
-	char              sym[1024];
+	CompString        sym;
 
 	dlerror ();
 
-	snprintf (sym, 1024, "getCompPluginVTable20090315_%s", name);
-	getInfo = (PluginGetInfoProc) dlsym (dlhand, sym);
+	sym = pluginRegistry.symbol (file, fileInfo);
+	if (sym.empty ())
+	    sym = compPrintf ("getCompPluginVTable20090315_%s", name);
+
+	getInfo = (PluginGetInfoProc) dlsym (dlhand, sym.c_str ());
 
 	error = dlerror ();
 	if (error)
@@ -187,6 +195,10 @@ dlloaderLoadPlugin (CompPlugin *p,
 		p->devPrivate.ptr = dlhand;
 		p->devType	  = "dlloader";
 		loaded            = true;
+
+		/* files in the current directory aren't worth keeping */
+		if (path)
+		    pluginRegistry.loaded (file, fileInfo, name, sym);
 	    }
 	}
     }
@@ -215,46 +227,13 @@ dlloaderUnloadPlugin (CompPlugin *p)
 	cloaderUnloadPlugin (p);
 }
 
-static int
-dlloaderFilter (const struct dirent *name)
-{
-    int length = strlen (name->d_name);
-
-    if (length < 7)
-	return 0;
-
-    if (strncmp (name->d_name, "lib", 3) ||
-	strncmp (name->d_name + length - 3, ".so", 3))
-	return 0;
-
-    return 1;
-}
-
 static CompStringList
 dlloaderListPlugins (const char *path)
 {
-    struct dirent **nameList;
-    char	  name[1024];
-    int		  length, nFile, i;
-
     CompStringList rv = cloaderListPlugins (path);
 
-    if (!path)
-	path = ".";
-
-    nFile = scandir (path, &nameList, dlloaderFilter, alphasort);
-    if (!nFile)
-	return rv;
-
-    for (i = 0; i < nFile; i++)
-    {
-	length = strlen (nameList[i]->d_name);
-
-	strncpy (name, nameList[i]->d_name + 3, length - 6);
-	name[length - 6] = '\0';
-
-	rv.push_back (CompString (name));
-    }
+    foreach (const CompString &name, pluginRegistry.list (path))
+	rv.push_back (name);
 
     return rv;
 }
@@ -265,27 +244,33 @@ ListPluginsProc  loaderListPlugins  = dlloaderListPlugins;
 
 
 static bool
-initPlugin (CompPlugin *p)
+initPluginScoped (CompPlugin *p)
 {
+    CompString name = p->vTable->name ();
 
     if (!p->vTable->init ())
     {
 	compLogMessage ("core", CompLogLevelError,
-			"InitPlugin '%s' failed", p->vTable->name ().c_str ());
+			"InitPlugin '%s' failed", name.c_str ());
 	return false;
     }
 
+    /* one round trip for every atom the plugin registered so far */
+    Atoms::flush ();
+
     if (screen)
     {
 	if (!p->vTable->initScreen (screen))
 	{
-	    compLogMessage (p->vTable->name ().c_str (), CompLogLevelError,
+	    compLogMessage (name.c_str (), CompLogLevelError,
                             "initScreen failed");
+	    matchSetHandlerScope (name, false);
 	    p->vTable->fini ();
 	    return false;
 	}
 	if (!screen->initPluginForScreen (p))
 	{
+	    matchSetHandlerScope (name, false);
 	    p->vTable->fini ();
 	    return false;
 	}
@@ -294,9 +279,25 @@ initPlugin (CompPlugin *p)
     return true;
 }
 
+/* expression handlers a plugin adds or drops while it is initialized
+   or finalized are put down to it, so only the matches it can affect
+   are rebuilt */
+static bool
+initPlugin (CompPlugin *p)
+{
+    bool status;
+
+    matchSetHandlerScope (p->vTable->name (), true);
+    status = initPluginScoped (p);
+    matchSetHandlerScope (CompString (), false);
+
+    return status;
+}
+
 static void
 finiPlugin (CompPlugin *p)
 {
+    matchSetHandlerScope (p->vTable->name (), false);
 
     if (screen)
     {
@@ -305,6 +306,8 @@ finiPlugin (CompPlugin *p)
     }
 
     p->vTable->fini ();
+
+    matchSetHandlerScope (CompString (), false);
 }
 
 bool
@@ -316,6 +319,9 @@ CompScreen::initPluginForScreen (CompPlugin *p)
     CompWindowList::iterator it, fail;
     CompWindow               *w;
 
+    priv->matchIndex.invalidate ();
+    priv->actionIndex.invalidate ();
+
     it = fail = priv->windows.begin ();
     for (;it != priv->windows.end (); it++)
     {
@@ -344,6 +350,9 @@ CompScreen::finiPluginForScreen (CompPlugin *p)
 {
     WRAPABLE_HND_FUNC (3, finiPluginForScreen, p)
 
+    priv->matchIndex.invalidate ();
+    priv->actionIndex.invalidate ();
+
     foreach (CompWindow *w, priv->windows)
 	p->vTable->finiWindow (w);
 }
@@ -502,6 +511,15 @@ CompPlugin::push (CompPlugin *p)
 	return false;
     }
 
+    /* plugins store their ABI version while they're initialized */
+    if (screen)
+    {
+	CompString pluginName = p->vTable->name ();
+
+	pluginRegistry.setABI (pluginName.c_str (),
+			       getPluginABI (pluginName.c_str ()));
+    }
+
     return true;
 }
 
@@ -584,6 +602,8 @@ CompPlugin::availablePlugins ()
 		list.push_back (s);
     }
 
+    pluginRegistry.save ();
+
     return list;
 }
 
@@ -0,0 +1,212 @@
+/*
+ * Copyright © 2008 Dennis Kasprzyk
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the name of
+ * Dennis Kasprzyk not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior permission.
+ * Dennis Kasprzyk makes no representations about the suitability of this
+ * software for any purpose. It is provided "as is" without express or
+ * implied warranty.
+ *
+ * DENNIS KASPRZYK DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL DENNIS KASPRZYK BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION
+ * WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Dennis Kasprzyk <onestone@compiz-fusion.org>
+ */
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/foreach.hpp>
+#define foreach BOOST_FOREACH
+
+#include <core/core.h>
+#include "privatepluginpreloader.h"
+#include "privatepluginregistry.h"
+
+PluginPreloader pluginPreloader;
+
+/* reads the whole file once, the loader maps it from the page cache */
+static void
+preloaderReadFile (const char *file)
+{
+    char buffer[65536];
+    int  fd;
+
+    fd = open (file, O_RDONLY);
+    if (fd < 0)
+	return;
+
+    posix_fadvise (fd, 0, 0, POSIX_FADV_WILLNEED);
+
+    while (read (fd, buffer, sizeof (buffer)) > 0)
+	;
+
+    close (fd);
+}
+
+PluginPreloader::PluginPreloader () :
+    jobs (),
+    running (false),
+    cancelled (false),
+    nPreloaded (0),
+    nReady (0)
+{
+    pthread_mutex_init (&mutex, NULL);
+}
+
+PluginPreloader::~PluginPreloader ()
+{
+    finish ();
+
+    pthread_mutex_destroy (&mutex);
+}
+
+void
+PluginPreloader::start (const CompStringList &names)
+{
+    std::vector<const char *> paths;
+    CompString                homePath;
+    char                      *home;
+
+    if (running || !jobs.empty ())
+	return;
+
+    /* the directories CompPlugin::load searches, in the same order */
+    home = getenv ("HOME");
+    if (home)
+    {
+	homePath = compPrintf ("%s/%s", home, HOME_PLUGINDIR);
+	paths.push_back (homePath.c_str ());
+    }
+
+    paths.push_back (PLUGINDIR);
+    paths.push_back (NULL);
+
+    foreach (const CompString &name, names)
+    {
+	if (name == "core")
+	    continue;
+
+	foreach (const char *path, paths)
+	{
+	    Job job;
+
+	    if (!pluginRegistry.contains (path, name.c_str ()))
+		continue;
+
+	    job.file  = path ? CompString (path) + "/" : CompString ();
+	    job.file += "lib" + name + ".so";
+	    job.done  = false;
+
+	    jobs.push_back (job);
+	    break;
+	}
+    }
+
+    nPreloaded = jobs.size ();
+    cancelled  = false;
+
+    if (jobs.empty ())
+	return;
+
+    if (pthread_create (&thread, NULL, run, this) != 0)
+    {
+	compLogMessage ("core", CompLogLevelWarn,
+			"Couldn't start plugin preloading thread");
+	jobs.clear ();
+	nPreloaded = 0;
+	return;
+    }
+
+    running = true;
+}
+
+void *
+PluginPreloader::run (void *data)
+{
+    static_cast<PluginPreloader *> (data)->readAll ();
+
+    return NULL;
+}
+
+void
+PluginPreloader::readAll ()
+{
+    /* the jobs aren't added or removed while the thread runs, only
+       their state changes and that is guarded by the mutex */
+    bool stop;
+
+    for (unsigned int i = 0; i < jobs.size (); i++)
+    {
+	pthread_mutex_lock (&mutex);
+	stop = cancelled;
+	pthread_mutex_unlock (&mutex);
+
+	if (stop)
+	    break;
+
+	preloaderReadFile (jobs[i].file.c_str ());
+
+	pthread_mutex_lock (&mutex);
+	jobs[i].done = true;
+	pthread_mutex_unlock (&mutex);
+    }
+}
+
+void
+PluginPreloader::opening (const CompString &file)
+{
+    /* never waits, a file that isn't read yet is still read by the
+       loader itself */
+    foreach (Job &job, jobs)
+    {
+	if (job.file != file)
+	    continue;
+
+	pthread_mutex_lock (&mutex);
+	if (job.done)
+	    nReady++;
+	pthread_mutex_unlock (&mutex);
+
+	return;
+    }
+}
+
+void
+PluginPreloader::finish ()
+{
+    if (running)
+    {
+	pthread_mutex_lock (&mutex);
+	cancelled = true;
+	pthread_mutex_unlock (&mutex);
+
+	pthread_join (thread, NULL);
+	running = false;
+    }
+
+    jobs.clear ();
+}
+
+unsigned int
+PluginPreloader::preloaded () const
+{
+    return nPreloaded;
+}
+
+unsigned int
+PluginPreloader::ready () const
+{
+    return nReady;
+}
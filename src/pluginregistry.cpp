@@ -0,0 +1,399 @@
+/*
+ * Copyright © 2008 Dennis Kasprzyk
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the name of
+ * Dennis Kasprzyk not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior permission.
+ * Dennis Kasprzyk makes no representations about the suitability of this
+ * software for any purpose. It is provided "as is" without express or
+ * implied warranty.
+ *
+ * DENNIS KASPRZYK DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL DENNIS KASPRZYK BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION
+ * WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Dennis Kasprzyk <onestone@compiz-fusion.org>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <boost/foreach.hpp>
+#define foreach BOOST_FOREACH
+
+#include <core/core.h>
+#include "privatepluginregistry.h"
+
+#define PLUGIN_REGISTRY_VERSION 1
+
+PluginRegistry pluginRegistry;
+
+static int
+pluginFilter (const struct dirent *name)
+{
+    int length = strlen (name->d_name);
+
+    if (length < 7)
+	return 0;
+
+    if (strncmp (name->d_name, "lib", 3) ||
+	strncmp (name->d_name + length - 3, ".so", 3))
+	return 0;
+
+    return 1;
+}
+
+static CompString
+pluginFile (const CompString &path,
+	    const CompString &name)
+{
+    return path + "/lib" + name + ".so";
+}
+
+static CompString
+pluginDirectory (const char *path)
+{
+    char cwd[PATH_MAX];
+
+    if (path)
+	return path;
+
+    if (getcwd (cwd, sizeof (cwd)))
+	return cwd;
+
+    return ".";
+}
+
+/* creates dir and any of its parents that don't exist yet */
+static void
+makeDirectories (const CompString &dir,
+		 mode_t           mode)
+{
+    size_t pos = 0;
+
+    while ((pos = dir.find ('/', pos + 1)) != CompString::npos)
+	mkdir (dir.substr (0, pos).c_str (), mode);
+
+    mkdir (dir.c_str (), mode);
+}
+
+void
+PluginRegistry::Directory::clear ()
+{
+    names.clear ();
+    lookup.clear ();
+}
+
+void
+PluginRegistry::Directory::add (const CompString &name)
+{
+    names.push_back (name);
+    lookup.insert (name);
+}
+
+PluginRegistry::PluginRegistry () :
+    initialized (false),
+    dirty (false)
+{
+}
+
+CompString
+PluginRegistry::fileName ()
+{
+    const char *cache = getenv ("XDG_CACHE_HOME");
+    const char *home = getenv ("HOME");
+
+    if (cache && *cache)
+	return CompString (cache) + "/compiz/plugin-registry";
+
+    if (home && *home)
+	return CompString (home) + "/.cache/compiz/plugin-registry";
+
+    return "";
+}
+
+void
+PluginRegistry::read ()
+{
+    CompString file = fileName ();
+    CompString path;
+    Directory  *directory = NULL;
+    FILE       *fp;
+    char       line[PATH_MAX + 64];
+    int        version = 0;
+
+    initialized = true;
+
+    if (file.empty () || !(fp = fopen (file.c_str (), "r")))
+	return;
+
+    if (!fgets (line, sizeof (line), fp) ||
+	sscanf (line, "# compiz plugin registry %d", &version) != 1 ||
+	version != PLUGIN_REGISTRY_VERSION)
+    {
+	compLogMessage ("core", CompLogLevelDebug,
+			"Ignoring plugin registry %s of version %d",
+			file.c_str (), version);
+	fclose (fp);
+	dirty = true;
+	return;
+    }
+
+    while (fgets (line, sizeof (line), fp))
+    {
+	long      mtime, scanned;
+	long long size;
+	int       abi, fields, offset = 0;
+	char      name[256], symbol[256];
+
+	line[strcspn (line, "\n")] = '\0';
+
+	if (sscanf (line, "directory %ld %ld %n",
+		    &mtime, &scanned, &offset) == 2 && offset)
+	{
+	    path      = line + offset;
+	    directory = &directories[path];
+
+	    directory->mtime   = mtime;
+	    directory->scanned = scanned;
+	    directory->clear ();
+	}
+	else if (directory &&
+		 (fields = sscanf (line, "plugin %255s %ld %lld %d %255s",
+				   name, &mtime, &size, &abi, symbol)) >= 1)
+	{
+	    directory->add (name);
+
+	    if (fields == 5)
+	    {
+		Plugin &plugin = plugins[pluginFile (path, name)];
+
+		plugin.name   = name;
+		plugin.mtime  = mtime;
+		plugin.size   = size;
+		plugin.abi    = abi;
+		plugin.symbol = symbol;
+	    }
+	}
+    }
+
+    fclose (fp);
+}
+
+/* the listing of a directory, scanned again if it changed. Without
+   validate a listing we already have is returned as it is. */
+PluginRegistry::Directory &
+PluginRegistry::directory (const char *path,
+			   bool       validate)
+{
+    CompString    key;
+    struct stat   info;
+    struct dirent **nameList;
+    int           length, nFile, i;
+
+    if (!initialized)
+	read ();
+
+    key = pluginDirectory (path);
+
+    Directory &d = directories[key];
+
+    if (!validate && d.scanned)
+	return d;
+
+    if (stat (key.c_str (), &info) != 0)
+    {
+	d.clear ();
+	d.mtime   = 0;
+	d.scanned = 0;
+
+	return d;
+    }
+
+    /* a change in the second of the last scan doesn't show in mtime */
+    if (d.scanned && info.st_mtime == d.mtime && d.mtime < d.scanned)
+	return d;
+
+    compLogMessage ("core", CompLogLevelDebug,
+		    "Scanning plugin directory %s", key.c_str ());
+
+    d.clear ();
+
+    nFile = scandir (key.c_str (), &nameList, pluginFilter, alphasort);
+    for (i = 0; i < nFile; i++)
+    {
+	length = strlen (nameList[i]->d_name);
+
+	d.add (CompString (nameList[i]->d_name + 3, length - 6));
+	free (nameList[i]);
+    }
+
+    if (nFile >= 0)
+	free (nameList);
+
+    d.mtime   = info.st_mtime;
+    d.scanned = time (NULL);
+    dirty     = true;
+
+    return d;
+}
+
+const CompStringList &
+PluginRegistry::list (const char *path)
+{
+    return directory (path).names;
+}
+
+bool
+PluginRegistry::contains (const char *path,
+			  const char *name)
+{
+    Directory   &d = directory (path, false);
+    struct stat info;
+
+    if (d.lookup.find (name) != d.lookup.end ())
+	return true;
+
+    /* the listing may be older than the file, have it scanned again
+       next time if it is */
+    if (stat (pluginFile (pluginDirectory (path), name).c_str (),
+	      &info) != 0)
+	return false;
+
+    d.scanned = 0;
+
+    return true;
+}
+
+CompString
+PluginRegistry::symbol (const CompString  &file,
+			const struct stat &info)
+{
+    Plugins::iterator it = plugins.find (file);
+
+    if (it == plugins.end () ||
+	it->second.mtime != info.st_mtime ||
+	it->second.size != info.st_size)
+	return "";
+
+    return it->second.symbol;
+}
+
+void
+PluginRegistry::loaded (const CompString  &file,
+			const struct stat &info,
+			const char        *name,
+			const CompString  &symbol)
+{
+    Plugin &plugin = plugins[file];
+
+    files[name] = file;
+
+    if (plugin.mtime == info.st_mtime && plugin.size == info.st_size &&
+	plugin.symbol == symbol)
+	return;
+
+    plugin.name   = name;
+    plugin.mtime  = info.st_mtime;
+    plugin.size   = info.st_size;
+    plugin.abi    = 0;
+    plugin.symbol = symbol;
+
+    dirty = true;
+}
+
+void
+PluginRegistry::setABI (const char *name,
+			int        abi)
+{
+    std::map<CompString, CompString>::iterator it = files.find (name);
+
+    if (it == files.end ())
+	return;
+
+    Plugin &plugin = plugins[it->second];
+
+    if (plugin.abi == abi)
+	return;
+
+    plugin.abi = abi;
+    dirty      = true;
+}
+
+void
+PluginRegistry::save ()
+{
+    CompString file = fileName ();
+    CompString tmp, dir;
+    FILE       *fp;
+
+    if (!dirty || file.empty ())
+	return;
+
+    dirty = false;
+
+    /* neither may the cache directory or any of its parents */
+    dir = file.substr (0, file.rfind ('/'));
+    makeDirectories (dir, 0700);
+
+    tmp = compPrintf ("%s.%d", file.c_str (), getpid ());
+
+    fp = fopen (tmp.c_str (), "w");
+    if (!fp)
+    {
+	compLogMessage ("core", CompLogLevelWarn,
+			"Couldn't write plugin registry %s: %s",
+			tmp.c_str (), strerror (errno));
+	return;
+    }
+
+    fprintf (fp, "# compiz plugin registry %d\n", PLUGIN_REGISTRY_VERSION);
+
+    /* plugins are only written with their directory, the ones that
+       went away are dropped here */
+    for (Directories::iterator it = directories.begin ();
+	 it != directories.end (); it++)
+    {
+	Directory &d = it->second;
+
+	if (d.names.empty ())
+	    continue;
+
+	fprintf (fp, "directory %ld %ld %s\n",
+		 (long) d.mtime, (long) d.scanned, it->first.c_str ());
+
+	foreach (CompString &name, d.names)
+	{
+	    Plugins::iterator p = plugins.find (pluginFile (it->first, name));
+
+	    if (p == plugins.end ())
+		fprintf (fp, "plugin %s\n", name.c_str ());
+	    else
+		fprintf (fp, "plugin %s %ld %lld %d %s\n", name.c_str (),
+			 (long) p->second.mtime, (long long) p->second.size,
+			 p->second.abi, p->second.symbol.c_str ());
+	}
+    }
+
+    if (fclose (fp) != 0 || rename (tmp.c_str (), file.c_str ()) != 0)
+    {
+	compLogMessage ("core", CompLogLevelWarn,
+			"Couldn't write plugin registry %s: %s",
+			file.c_str (), strerror (errno));
+	unlink (tmp.c_str ());
+    }
+}
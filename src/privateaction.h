@@ -28,6 +28,8 @@
 #ifndef _PRIVATEACTION_H
 #define _PRIVATEACTION_H
 
+#include <core/option.h>
+
 class PrivateAction {
     public:
 	PrivateAction ();
@@ -50,4 +52,51 @@ class PrivateAction {
 	CompPrivate priv;
 };
 
+/*
+ * The arguments core hands to the actions it triggers for an event.
+ * Callbacks get them as an option vector, the slots remember where each
+ * argument is in it so core's own callbacks can read them without
+ * searching the vector by name. Any other vector, or one of these a
+ * callback resized, is still searched by name.
+ */
+class ActionArguments {
+    public:
+	typedef enum {
+	    SlotEventWindow,
+	    SlotWindow,
+	    SlotModifiers,
+	    SlotX,
+	    SlotY,
+	    SlotRoot,
+	    SlotButton,
+	    SlotKeycode,
+	    SlotTime,
+	    SlotNum
+	} Slot;
+
+	/* the first nCommon slots followed by the extra ones */
+	ActionArguments (unsigned int nCommon,
+			 Slot         extra1 = SlotNum,
+			 Slot         extra2 = SlotNum);
+	~ActionArguments ();
+
+	CompOption::Vector & options ();
+
+	void set (Slot slot, int value);
+
+	static int get (CompOption::Vector &options,
+			Slot               slot,
+			int                defaultValue = 0);
+
+    private:
+	ActionArguments (const ActionArguments &);
+	ActionArguments & operator= (const ActionArguments &);
+
+	void add (Slot slot);
+
+	CompOption::Vector vector;
+	unsigned int       count;
+	int                index[SlotNum];
+};
+
 #endif
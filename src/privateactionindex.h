@@ -0,0 +1,117 @@
+/*
+ * Copyright © 2008 Dennis Kasprzyk
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the name of
+ * Dennis Kasprzyk not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior permission.
+ * Dennis Kasprzyk makes no representations about the suitability of this
+ * software for any purpose. It is provided "as is" without express or
+ * implied warranty.
+ *
+ * DENNIS KASPRZYK DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL DENNIS KASPRZYK BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION
+ * WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Dennis Kasprzyk <onestone@compiz-fusion.org>
+ */
+
+#ifndef _PRIVATEACTIONINDEX_H
+#define _PRIVATEACTIONINDEX_H
+
+#include <vector>
+
+#include <core/option.h>
+#include <boost/unordered_map.hpp>
+
+#define REAL_MOD_MASK (ShiftMask | ControlMask | Mod1Mask | Mod2Mask | \
+		       Mod3Mask | Mod4Mask | Mod5Mask | CompNoMask)
+
+/* one list of edge bindings for each bit of an edge mask */
+#define ACTION_INDEX_EDGE_BITS 32
+
+/*
+ * The action options of all active plugins filed by the key, button
+ * or edge they are bound to, so an event only looks at the actions
+ * it could trigger.
+ *
+ * Only the bindings are indexed, whether an action is of the right
+ * type, in the right state and has a callback is still checked when
+ * it is triggered. Bindings are kept with their position in plugin and
+ * option order, results from several lookups can be merged back into
+ * that order. The index is rebuilt the first time it is used after
+ * being invalidated, which has to happen whenever an action option is
+ * set, a plugin comes or goes or the modifier mapping changes.
+ */
+class ActionIndex {
+    public:
+	struct Binding {
+	    unsigned int seq;
+	    CompOption   *option;
+	};
+
+	typedef std::vector<Binding> Bindings;
+
+	ActionIndex ();
+
+	void invalidate ();
+	void update ();
+
+	/* all action options of every plugin, in plugin order */
+	const std::vector<Bindings> & plugins () const;
+
+	/* keycode 0 looks up bindings to modifiers only, compared with
+	   all of their modifiers instead of the non-ignored ones */
+	const Bindings & keys (int keycode, unsigned int mods) const;
+	const Bindings & modifierKeys () const;
+	const Bindings & modifiedKeys () const;
+
+	const Bindings & buttons (int button, unsigned int mods) const;
+	const Bindings & buttonReleases (int button) const;
+
+	/* edge is the mask of a single screen edge */
+	const Bindings & edge (unsigned int mask) const;
+	const Bindings & bells () const;
+
+	/* every action option, in plugin and option order */
+	const Bindings & all () const;
+
+	static void merge (const Bindings &a,
+			   const Bindings &b,
+			   Bindings       &result);
+
+    private:
+	typedef std::pair<int, unsigned int> Key;
+	typedef boost::unordered_map<Key, Bindings> Map;
+
+	const Bindings & find (const Map &map, const Key &key) const;
+
+	void add (CompOption &option, unsigned int modMask);
+
+	bool                  valid;
+	unsigned int          count;
+
+	std::vector<Bindings> pluginBindings;
+
+	Map                   keyMap;
+	Bindings              modifierKeyBindings;
+	Bindings              modifiedKeyBindings;
+
+	Map                   buttonMap;
+	Map                   buttonReleaseMap;
+
+	Bindings              edgeBindings[ACTION_INDEX_EDGE_BITS];
+	Bindings              bellBindings;
+	Bindings              allBindings;
+
+	Bindings              none;
+};
+
+#endif
@@ -0,0 +1,94 @@
+/*
+ * Copyright © 2008 Dennis Kasprzyk
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the name of
+ * Dennis Kasprzyk not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior permission.
+ * Dennis Kasprzyk makes no representations about the suitability of this
+ * software for any purpose. It is provided "as is" without express or
+ * implied warranty.
+ *
+ * DENNIS KASPRZYK DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL DENNIS KASPRZYK BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION
+ * WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Dennis Kasprzyk <onestone@compiz-fusion.org>
+ */
+
+#ifndef _PRIVATEEVENTREADER_H
+#define _PRIVATEEVENTREADER_H
+
+#include <pthread.h>
+#include <xcb/xcb.h>
+
+#include "privatetimer.h"
+
+#define EVENT_RING_SIZE 4096
+
+/*
+ * Thread that keeps draining the X connection while the main thread is
+ * busy dispatching. Events are handed over through a single producer,
+ * single consumer ring; the main thread waits on fd () for new ones.
+ *
+ * The reader only takes events off the connection while holding lock (),
+ * and only as many as fit into the ring. The main thread holds the same
+ * lock when it picks up events XCB queued while waiting for a reply, so
+ * the order of events is always preserved. Popping off the ring is lock
+ * free.
+ */
+class EventReader {
+    public:
+	struct Entry {
+	    xcb_generic_event_t *event;
+	    TimerQueue::Time    received;
+	};
+
+	EventReader (xcb_connection_t *connection);
+	~EventReader ();
+
+	bool start ();
+	void stop ();
+
+	int fd () const;
+
+	bool pop (Entry &entry);
+	unsigned int depth () const;
+
+	void lock ();
+	void unlock ();
+
+	void clearReady ();
+
+    private:
+	static void * run (void *data);
+
+	void readLoop ();
+	unsigned int readBatch ();
+
+    private:
+	xcb_connection_t *connection;
+
+	Entry        ring[EVENT_RING_SIZE];
+	unsigned int head;
+	unsigned int tail;
+
+	pthread_t       thread;
+	pthread_mutex_t mutex;
+	bool            running;
+
+	int readyFd;
+	int spaceFd;
+	int quitFd;
+
+	unsigned int waitingForSpace;
+};
+
+#endif
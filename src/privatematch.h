@@ -28,8 +28,13 @@
 #ifndef _PRIVATEMATCH_H
 #define _PRIVATEMATCH_H
 
+#include <vector>
+#include <map>
+
 #include <core/match.h>
+#include <core/matchindex.h>
 #include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
 
 #define MATCH_OP_AND_MASK (1 << 0)
 #define MATCH_OP_NOT_MASK (1 << 1)
@@ -62,6 +67,10 @@ class MatchExpOp : public MatchOp {
 	CompString	      value;
 
 	boost::shared_ptr<CompMatch::Expression> e;
+
+	/* name of the plugin e came from, "core" for core expressions
+	   and empty if that couldn't be told */
+	CompString	      provider;
 };
 
 class MatchGroupOp : public MatchOp {
@@ -77,12 +86,147 @@ class MatchGroupOp : public MatchOp {
 	MatchOp::List op;
 };
 
+/*
+ * A match compiled into a flat list of instructions that all work on a
+ * single result. Before it runs, an instruction may test the result so
+ * far and jump to the end of its group ('&' leaves a group when the
+ * result is false, '|' when it is true). Expressions core knows about
+ * are tested inline, everything else is called through the expression
+ * object a plugin handed us.
+ */
+class MatchInstruction {
+    public:
+	typedef enum {
+	    OpGroup,
+	    OpNot,
+	    OpTrue,
+	    OpXid,
+	    OpState,
+	    OpOverride,
+	    OpRGBA,
+	    OpType,
+	    OpCall
+	} Op;
+
+	typedef enum {
+	    GuardNone,
+	    GuardAnd,
+	    GuardOr
+	} Guard;
+
+	unsigned char op;
+	unsigned char guard;
+	bool          negate;
+	unsigned int  exit;
+	CompPrivate   arg;
+};
+
+typedef std::vector<MatchInstruction> MatchProgram;
+
+/* result of a match for a window, valid as long as the window's match
+   generation is the one it was computed for */
+struct MatchCacheEntry {
+    unsigned int generation;
+    bool         value;
+};
+
+typedef boost::unordered_map<CompWindow *, MatchCacheEntry> MatchCache;
+
+struct MatchStats {
+    MatchStats () :
+	evaluations (0),
+	cached (0) {}
+
+    unsigned int evaluations;
+    unsigned int cached;
+};
+
+/* a copy of the counters, zeroed afterwards if reset is true */
+MatchStats getMatchStats (bool reset = false);
+
+/* expression handler changes until the next call are put down to
+   loading or unloading the named plugin, an empty name means they
+   may come from anywhere */
+void matchSetHandlerScope (const CompString &plugin,
+			   bool             loading);
+
 class PrivateMatch {
     public:
 	PrivateMatch ();
 
     public:
-	MatchGroupOp op;
+	MatchGroupOp   op;
+	MatchProgram   program;
+
+	/* names of the plugins our leaves came from, each once, see
+	   matchNeedsRebuild */
+	CompStringList providers;
+
+	/* only matches calling out to plugin expressions are worth
+	   caching, core tests are cheaper than the lookup */
+	bool         cacheable;
+	MatchCache   cache;
 };
 
+/*
+ * The match options of all active plugins, filed under what a window
+ * needs to have for them to match it: a type or state bit, an xid or,
+ * for leaves a key hook was added for, the value the hook reads off the
+ * window. Each '|' branch of a match is filed under the most selective
+ * of its leaves, matches with a branch none of whose leaves tells windows
+ * apart are evaluated for every window. The index is rebuilt from the
+ * plugin options the first time it is asked after being invalidated or
+ * after any CompMatch changed or went away, so it never holds on to a
+ * match a plugin replaced behind our back.
+ */
+class MatchIndex {
+    public:
+	typedef std::vector<CompMatch *> List;
+
+	/* A hook asserts that leaves "<prefix>=<value>" match exactly the
+	   windows it returns <value> for. */
+	typedef CompString (*KeyHook) (CompWindow *w);
+
+	MatchIndex ();
+
+	void invalidate ();
+
+	/* appends the indexed matches that match w, in option order */
+	void matching (CompWindow *w, List &result);
+
+	static void addKeyHook (const CompString &prefix, KeyHook hook);
+
+    private:
+	typedef enum {
+	    KeyXid,
+	    KeyType,
+	    KeyState,
+	    KeyHookBase
+	} KeyKind;
+
+	typedef std::pair<unsigned int, unsigned long> Key;
+	typedef std::vector<Key> KeyList;
+	typedef boost::unordered_map<Key, std::vector<unsigned int> > Buckets;
+
+	void rebuild ();
+	void add (CompMatch &match);
+
+	bool listKeys (MatchOp::List &list, KeyList &keys);
+	bool opKeys (MatchOp *op, KeyList &keys);
+	bool leafKeys (MatchExpOp *exp, KeyList &keys);
+	void windowKeys (CompWindow *w, KeyList &keys);
+
+	bool                      valid;
+	unsigned int              generation;
+	List                      matches;
+	std::vector<unsigned int> always;
+	Buckets                   buckets;
+
+	/* matches already picked as candidates in the current query */
+	std::vector<unsigned int> stamps;
+	unsigned int              stamp;
+};
+
+void matchBenchmark (MatchIndex &index);
+
 #endif
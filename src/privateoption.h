@@ -63,23 +63,77 @@ typedef union {
     unsigned short c[4];
 } ValueUnion;
 
+/*
+ * A value only ever holds one of a string, a match, an action or a list,
+ * that one is constructed in place in the storage below and the others
+ * don't exist. Asking for one that isn't stored (which the accessors of
+ * CompOption::Value already warn about) replaces the stored one with a
+ * default constructed instance.
+ */
 class PrivateValue {
     public:
 	PrivateValue ();
 	PrivateValue (const PrivateValue&);
+	~PrivateValue ();
+
+	PrivateValue & operator= (const PrivateValue &);
+
+	/* values are created and dropped all the time, freed ones are
+	   kept around for reuse */
+	static void * operator new (size_t size);
+	static void operator delete (void *p);
 
 	void reset ();
 	bool checkType (CompOption::Type refType);
 
+	CompString & string ();
+	CompAction & action ();
+	CompMatch & match ();
+	CompOption::Value::Vector & list ();
+
 	CompOption::Type          type;
 	ValueUnion                value;
-	CompString                string;
-	CompAction                action;
-	CompMatch                 match;
 	CompOption::Type          listType;
-	CompOption::Value::Vector list;
+
+    private:
+	typedef enum {
+	    StoredNone,
+	    StoredString,
+	    StoredAction,
+	    StoredMatch,
+	    StoredList
+	} Stored;
+
+	void store (Stored what);
+	void release ();
+
+	Stored stored;
+	union {
+	    char   string[sizeof (CompString)];
+	    char   action[sizeof (CompAction)];
+	    char   match[sizeof (CompMatch)];
+	    char   list[sizeof (CompOption::Value::Vector)];
+	    void   *alignPointer;
+	    double alignDouble;
+	} storage;
+};
+
+struct ValueStats {
+    ValueStats () :
+	allocated (0),
+	reused (0),
+	stored (0) {}
+
+    unsigned int allocated;
+    unsigned int reused;
+    unsigned int stored;
 };
 
+/* a copy of the counters, zeroed afterwards if reset is true */
+ValueStats getValueStats (bool reset = false);
+
+void optionBenchmark ();
+
 class PrivateOption
 {
     public:
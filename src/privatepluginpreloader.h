@@ -0,0 +1,86 @@
+/*
+ * Copyright © 2008 Dennis Kasprzyk
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the name of
+ * Dennis Kasprzyk not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior permission.
+ * Dennis Kasprzyk makes no representations about the suitability of this
+ * software for any purpose. It is provided "as is" without express or
+ * implied warranty.
+ *
+ * DENNIS KASPRZYK DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL DENNIS KASPRZYK BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION
+ * WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Dennis Kasprzyk <onestone@compiz-fusion.org>
+ */
+
+#ifndef _PRIVATEPLUGINPRELOADER_H
+#define _PRIVATEPLUGINPRELOADER_H
+
+#include <vector>
+#include <pthread.h>
+
+#include <core/core.h>
+
+/*
+ * Reads the files of the plugins core is going to load on a thread of
+ * its own, while the main thread connects to the X server and sets up
+ * the screen, so dlopen () finds them in the page cache. Nothing but
+ * reading happens on the thread: plugin constructors run when the main
+ * thread opens the file, as they would without preloading.
+ *
+ * The files are looked up in the plugin registry before the thread is
+ * started.
+ */
+class PluginPreloader {
+    public:
+	PluginPreloader ();
+	~PluginPreloader ();
+
+	/* starts reading the files of the named plugins in that order */
+	void start (const CompStringList &names);
+
+	/* core is about to open file, counted if it was read already */
+	void opening (const CompString &file);
+
+	/* stops reading and waits for the thread */
+	void finish ();
+
+	unsigned int preloaded () const;
+
+	/* files opened after the thread was done reading them */
+	unsigned int ready () const;
+
+    private:
+	struct Job {
+	    CompString file;
+	    bool       done;
+	};
+
+	static void * run (void *data);
+
+	void readAll ();
+
+	std::vector<Job> jobs;
+
+	pthread_t       thread;
+	pthread_mutex_t mutex;
+	bool            running;
+	bool            cancelled;
+
+	unsigned int nPreloaded;
+	unsigned int nReady;
+};
+
+extern PluginPreloader pluginPreloader;
+
+#endif
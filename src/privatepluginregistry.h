@@ -0,0 +1,113 @@
+/*
+ * Copyright © 2008 Dennis Kasprzyk
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the name of
+ * Dennis Kasprzyk not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior permission.
+ * Dennis Kasprzyk makes no representations about the suitability of this
+ * software for any purpose. It is provided "as is" without express or
+ * implied warranty.
+ *
+ * DENNIS KASPRZYK DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL DENNIS KASPRZYK BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION
+ * WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Dennis Kasprzyk <onestone@compiz-fusion.org>
+ */
+
+#ifndef _PRIVATEPLUGINREGISTRY_H
+#define _PRIVATEPLUGINREGISTRY_H
+
+#include <map>
+#include <set>
+#include <sys/stat.h>
+
+#include <core/core.h>
+
+/*
+ * What the plugin directories held and what was learned about each
+ * plugin file core loaded, kept in the user's cache directory across
+ * runs so listing and loading plugins doesn't have to scan directories.
+ *
+ * A directory is scanned again when its mtime changed, or when it was
+ * modified in the second it was scanned in and could have changed
+ * unnoticed. A plugin file is only trusted while its mtime and size are
+ * the ones recorded. The file is plain text, one record per line, and
+ * meant to be read by settings tools as well.
+ */
+class PluginRegistry {
+    public:
+	struct Plugin {
+	    CompString   name;
+	    time_t       mtime;
+	    off_t        size;
+	    int          abi;
+	    CompString   symbol;
+	};
+
+	PluginRegistry ();
+
+	/* names of the plugins in a directory, NULL is the current one */
+	const CompStringList & list (const char *path);
+
+	/* whether a directory has a file for the plugin, from the last
+	   listing of it if it has one and from the file itself if that
+	   doesn't have the plugin */
+	bool contains (const char *path,
+		       const char *name);
+
+	/* the vtable symbol recorded for a plugin file, empty if the
+	   file is unknown or changed since */
+	CompString symbol (const CompString  &file,
+			   const struct stat &info);
+
+	void loaded (const CompString  &file,
+		     const struct stat &info,
+		     const char        *name,
+		     const CompString  &symbol);
+
+	void setABI (const char *name,
+		     int        abi);
+
+	/* writes the registry if anything changed */
+	void save ();
+
+    private:
+	struct Directory {
+	    void clear ();
+	    void add (const CompString &name);
+
+	    time_t               mtime;
+	    time_t               scanned;
+	    CompStringList       names;
+	    std::set<CompString> lookup;
+	};
+
+	typedef std::map<CompString, Directory> Directories;
+	typedef std::map<CompString, Plugin>    Plugins;
+
+	void read ();
+	CompString fileName ();
+	Directory & directory (const char *path,
+			       bool       validate = true);
+
+	bool        initialized;
+	bool        dirty;
+	Directories    directories;
+	Plugins        plugins;
+
+	/* file each plugin was last loaded from */
+	std::map<CompString, CompString> files;
+};
+
+extern PluginRegistry pluginRegistry;
+
+#endif
@@ -26,19 +26,109 @@
 #ifndef _PRIVATEREGION_H
 #define _PRIVATEREGION_H
 
+#include <X11/Xutil.h>
+#include <X11/Xregion.h>
+
 #include <core/rect.h>
 #include <core/region.h>
 
+/* boxes kept inline before BoxArray goes to the heap, most regions
+   (windows, outputs, damage) have only a handful of rectangles */
+#define REGION_INLINE_BOXES 8
+
+/*
+ * Growable array of boxes with inline storage for small counts.
+ */
+class BoxArray {
+    public:
+	BoxArray ();
+	BoxArray (const BoxArray &a);
+	~BoxArray ();
+
+	BoxArray & operator= (const BoxArray &a);
+
+	unsigned int size () const { return mSize; }
+	bool empty () const { return !mSize; }
+
+	BOX * data () { return mData; }
+	const BOX * data () const { return mData; }
+
+	BOX & operator[] (unsigned int i) { return mData[i]; }
+	const BOX & operator[] (unsigned int i) const { return mData[i]; }
+
+	BOX & back () { return mData[mSize - 1]; }
+
+	void clear () { mSize = 0; }
+	void resize (unsigned int size);
+	void reserve (unsigned int capacity);
+
+	void push_back (short x1, short y1, short x2, short y2);
+
+	void swap (BoxArray &a);
+
+    private:
+	BOX          *mData;
+	unsigned int mSize;
+	unsigned int mCapacity;
+	BOX          mInline[REGION_INLINE_BOXES];
+};
+
+struct RegionStats {
+    RegionStats () :
+	allocations (0),
+	heapArrays (0),
+	shared (0),
+	detached (0) {}
+
+    /* PrivateRegions created, and box arrays that went to the heap */
+    unsigned int allocations;
+    unsigned int heapArrays;
+
+    /* copies that shared storage, and shared storage copied on write */
+    unsigned int shared;
+    unsigned int detached;
+};
+
+/* a copy of the counters, zeroed afterwards if reset is true */
+RegionStats getRegionStats (bool reset = false);
+
+/*
+ * Region stored the way Xlib stores it: boxes sorted in bands of equal
+ * y1 and y2, ordered by x within a band, bands with identical spans
+ * merged. That allows handing out an Xlib Region that simply points at
+ * our boxes.
+ *
+ * Copies of a CompRegion share one PrivateRegion until one of them is
+ * modified, see detach ().
+ */
 class PrivateRegion {
     public:
 	PrivateRegion ();
-	~PrivateRegion ();
+	PrivateRegion (const PrivateRegion &r);
 
-	void makeReal ();
+	/* copies the content only, the reference count stays ours */
+	PrivateRegion & operator= (const PrivateRegion &r);
+
+	static PrivateRegion * empty ();
+
+	PrivateRegion * ref ();
+	static void unref (PrivateRegion *r);
+
+	static PrivateRegion * detach (PrivateRegion *r);
+
+	void setRect (const CompRect &r);
+	void setExtents ();
+
+	const Region handle ();
 
     public:
-	Region region;
-	REGION box;
+	BoxArray rects;
+	BOX      extents;
+
+	/* Xlib view of rects, see handle () */
+	REGION   view;
+
+	unsigned int refCount;
 };
 
 #endif
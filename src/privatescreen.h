@@ -35,13 +35,101 @@
 #include <core/timer.h>
 #include <core/plugin.h>
 
+#include <deque>
+#include <map>
+#include <boost/shared_ptr.hpp>
+
+#include <X11/Xproto.h>
+
 #include "core_options.h"
+#include "privatetimer.h"
+#include "privatewindowindex.h"
+#include "privateactionindex.h"
+#include "privatematch.h"
 
 CompPlugin::VTable * getCoreVTable ();
 
+/* Xlibint.h defines min and max macros which break the STL, so only
+   declare the one function we need from it */
+extern "C" {
+    typedef Bool (*WireToEventProc) (Display *, XEvent *, xEvent *);
+
+    WireToEventProc XESetWireToEvent (Display         *dpy,
+				      int             eventNumber,
+				      WireToEventProc proc);
+}
+
 extern bool shutDown;
 extern bool restartSignal;
 
+#define MAX_POLL_EVENTS 16
+
+/* watch handles start at 1, so 0 identifies the timer fd */
+#define TIMER_FD_HANDLE 0
+
+#define STATS_INTERVAL 10000
+
+/* in 32 bit units, enough for every property read on window creation */
+#define PREFETCH_PROPERTY_LENGTH 1024
+
+/* distance between neighbouring stack keys after a renumbering */
+#define STACK_KEY_SPACING (1ULL << 32)
+
+/*
+ * Stacking layers, bottom to top. Every window in the stack is in
+ * exactly one of them, override redirect windows are kept apart as
+ * we never stack relative to them.
+ */
+enum StackLayerId {
+    StackLayerDesktop = 0,
+    StackLayerBelow,
+    StackLayerNormal,
+    StackLayerAbove,
+    StackLayerDock,
+    StackLayerFullscreen,
+    StackLayerOverrideRedirect,
+    StackLayerCount
+};
+
+#define STACK_LAYER_MASK(layer) (1 << (layer))
+#define STACK_LAYER_MANAGED \
+    (STACK_LAYER_MASK (StackLayerOverrideRedirect) - 1)
+
+/* windows of one layer ordered bottom to top by their stack key */
+typedef std::map<unsigned long long, CompWindow *> StackLayer;
+
+struct CompTimerStats {
+    CompTimerStats () :
+	start (TimerQueue::now ()),
+	wakeups (0),
+	expirations (0),
+	savedPerSecond (0.0f) {}
+
+    TimerQueue::Time start;
+    unsigned int     wakeups;
+    unsigned int     expirations;
+    float            savedPerSecond;
+};
+
+struct CompEventStats {
+    CompEventStats () :
+	read (0),
+	dispatched (0),
+	maxQueueDepth (0),
+	maxEventAge (0)
+    {
+	memset (coalesced, 0, sizeof (coalesced));
+    }
+
+    unsigned int read;
+    unsigned int dispatched;
+    unsigned int coalesced[LASTEvent];
+
+    /* only used with the event reader thread */
+    unsigned int     maxQueueDepth;
+    TimerQueue::Time maxEventAge;
+};
+
 typedef struct _CompWatchFd {
     int               fd;
     FdWatchCallBack   callBack;
@@ -53,6 +141,13 @@ extern bool	  useDesktopHints;
 
 extern bool inHandleEvent;
 
+extern bool coalesceEvents;
+extern bool threadedEvents;
+extern bool benchmarkMatches;
+extern bool benchmarkOptions;
+
+class EventReader;
+
 extern CompScreen *targetScreen;
 extern CompOutput *targetOutput;
 
@@ -95,6 +190,82 @@ struct CompStartupSequence {
     unsigned int		viewportY;
 };
 
+/* Decoded reply of a GetProperty request. For format 32 properties
+   item () returns the 32 bit value, not Xlib's long. */
+class PropertyReply {
+    public:
+	PropertyReply ();
+
+	const void * data () const;
+	unsigned long item (unsigned int i) const;
+
+	/* NUL terminated copy of a format 8 property, free() it */
+	char * copyString () const;
+
+    public:
+	Atom          type;
+	int           format;
+	unsigned long n;
+
+	boost::shared_ptr<xcb_get_property_reply_t> reply;
+};
+
+/* Requests issued ahead of CompWindow construction */
+struct WindowPrefetch {
+    typedef std::map<Atom, xcb_get_property_cookie_t> PropertyMap;
+
+    WindowPrefetch () :
+	attributes (),
+	geometry (),
+	properties () {}
+
+    xcb_get_window_attributes_cookie_t attributes;
+    xcb_get_geometry_cookie_t          geometry;
+    PropertyMap                        properties;
+};
+
+struct CachedProperty {
+    CachedProperty () :
+	length (0),
+	reply () {}
+
+    /* length the property was read with, in 32 bit units */
+    unsigned long length;
+
+    boost::shared_ptr<xcb_get_property_reply_t> reply;
+};
+
+struct CompPropertyStats {
+    CompPropertyStats () :
+	hits (0),
+	prefetched (0),
+	roundTrips (0) {}
+
+    unsigned int hits;
+    unsigned int prefetched;
+    unsigned int roundTrips;
+};
+
+/*
+ * Window list property on the root window (_NET_CLIENT_LIST and
+ * _NET_CLIENT_LIST_STACKING). ids is kept up to date as windows come
+ * and go, flush writes it out when it differs from what the server
+ * has, appending when only new ids were added at the end.
+ */
+class ClientListProperty {
+    public:
+	void insert (unsigned int pos, Window id);
+	void erase (unsigned int pos);
+
+	void flush (Display *dpy, Window root, Atom atom, Window none);
+
+    public:
+	std::vector<Window> ids;
+
+    private:
+	std::vector<Window> server;
+};
+
 class PrivateScreen : public CoreOptions {
 
     public:
@@ -129,38 +300,66 @@ class PrivateScreen : public CoreOptions {
 
 	void processEvents ();
 
+	bool readEvents (bool fromSocket);
+
+	void readReaderEvents ();
+
+	bool eventsPending ();
+
+	xcb_generic_event_t * waitForWindowEvent (Window id, uint8_t type);
+
+	bool hasPendingWindowEvent (Window id, uint8_t type);
+
+	void handleError (xcb_generic_error_t *error);
+	void handleQueuedErrors ();
+
+	bool convertEvent (xcb_generic_event_t *event, XEvent *xevent);
+
+	void dispatchEvent (xcb_generic_event_t *event);
+
+	void readEventBatch ();
+
+	void discardPointerEvents ();
+
 	void removeDestroyed ();
 
 	void updatePassiveGrabs ();
 
 	int doPoll (int timeout);
 
-	void handleTimers (struct timeval *tv);
+	void updateTimerFd ();
+
+	void handleTimers ();
+
+	bool handleStatsTimeout ();
 
 	void addTimer (CompTimer *timer);
 	void removeTimer (CompTimer *timer);
 
 	void updatePlugins ();
 
-	bool triggerButtonPressBindings (CompOption::Vector &options,
-					 XButtonEvent       *event,
-					 CompOption::Vector &arguments);
+	void startupPhase (const char *name);
+	void reportStartup ();
+
+	bool triggerButtonPressBindings (const ActionIndex::Bindings &bindings,
+					 XButtonEvent                *event,
+					 CompOption::Vector          &arguments);
 
-	bool triggerButtonReleaseBindings (CompOption::Vector &options,
-					   XButtonEvent       *event,
-					   CompOption::Vector &arguments);
+	bool triggerButtonReleaseBindings (const ActionIndex::Bindings &bindings,
+					   XButtonEvent                *event,
+					   CompOption::Vector          &arguments);
 
-	bool triggerKeyPressBindings (CompOption::Vector &options,
-				      XKeyEvent          *event,
-				      CompOption::Vector &arguments);
+	bool triggerKeyPressBindings (const ActionIndex::Bindings &bindings,
+				      XKeyEvent                   *event,
+				      CompOption::Vector          &arguments);
 
-	bool triggerKeyReleaseBindings (CompOption::Vector &options,
-					XKeyEvent          *event,
-					CompOption::Vector &arguments);
+	bool triggerKeyReleaseBindings (const ActionIndex::Bindings &bindings,
+					XKeyEvent                   *event,
+					CompOption::Vector          &arguments);
 
-	bool triggerStateNotifyBindings (CompOption::Vector  &options,
-					 XkbStateNotifyEvent *event,
-					 CompOption::Vector  &arguments);
+	bool triggerStateNotifyBindings (const ActionIndex::Bindings &bindings,
+					 XkbStateNotifyEvent         *event,
+					 CompOption::Vector          &arguments);
 
 	bool triggerEdgeEnter (unsigned int       edge,
 			       CompAction::State  state,
@@ -228,10 +427,39 @@ class PrivateScreen : public CoreOptions {
 
 	CompRect computeWorkareaForBox (const CompRect &box);
 
+	void markStruts (const CompStruts *struts);
+
+	void updateStrutIndex (CompWindow *w);
+
 	void updateScreenInfo ();
 
 	Window getActiveWindow (Window root);
 
+	void prefetchWindow (Window id);
+
+	void finishPrefetch (Window id);
+
+	void adoptWindows (Window       *children,
+			   unsigned int nchildren);
+
+	Visual * findVisual (VisualID id);
+
+	bool getWindowAttributes (Window            id,
+				  XWindowAttributes *attrib);
+
+	void watchProperties (Window id);
+
+	void forgetProperties (Window id);
+
+	void invalidateProperty (Window id,
+				 Atom   property);
+
+	bool getWindowProperty (Window        id,
+				Atom          property,
+				Atom          type,
+				unsigned long length,
+				PropertyReply &prop);
+
 	int getWmState (Window id);
 
 	void setWmState (int state, Window id);
@@ -262,7 +490,15 @@ class PrivateScreen : public CoreOptions {
 
 	void eraseWindowFromMap (Window id);
 
-	void updateClientList ();
+	void setStackKey (CompWindow *w);
+	void renumberStack ();
+	void updateStackLayer (CompWindow *w);
+
+	static bool compareStackingOrder (const CompWindow *w1,
+					  const CompWindow *w2);
+
+	void updateClientList (CompWindow *w);
+	void flushClientList ();
 
 	CompGroup * addGroup (Window id);
 
@@ -298,13 +534,32 @@ class PrivateScreen : public CoreOptions {
 	CompFileWatchList   fileWatch;
 	CompFileWatchHandle lastFileWatchHandle;
 
-	std::list<CompTimer *> timers;
-	struct timeval               lastTimeout;
+	TimerQueue timers;
+
+	/* windows whose struts take away from some work area */
+	std::list<CompWindow *> strutWindows;
+
+	/* outputs whose work area may have changed since the last
+	   updateWorkarea, all of them unless workareasMarked */
+	std::vector<bool> dirtyWorkareas;
+	bool              workareasMarked;
 
 	std::list<CompWatchFd *> watchFds;
 	CompWatchFdHandle        lastWatchFdHandle;
-	struct pollfd            *watchPollFds;
-	int                      nWatchFds;
+	int                      epollFd;
+	int                      timerFd;
+	TimerQueue::Time         timerFdDeadline;
+	CompTimerStats           timerStats;
+	CompTimer                statsTimer;
+
+	EventReader                        *eventReader;
+	std::deque<xcb_generic_event_t *>  xcbEvents;
+	std::vector<xcb_generic_event_t *> eventBatch;
+	unsigned int                       eventBatchPos;
+	CompEventStats                     eventStats;
+
+	/* Xlib's converter for each event type, looked up once */
+	WireToEventProc wireToEventProcs[128];
 
 	std::map<CompString, CompPrivate> valueMap;
 
@@ -328,6 +583,13 @@ class PrivateScreen : public CoreOptions {
 
 	std::vector<XineramaScreenInfo> screenInfo;
 
+	std::map<Window, WindowPrefetch> prefetches;
+
+	typedef std::map<Atom, CachedProperty> PropertyCache;
+
+	std::map<Window, PropertyCache> propertyCache;
+	CompPropertyStats               propertyStats;
+
 	SnDisplay *snDisplay;
 
 	unsigned int lastPing;
@@ -347,13 +609,21 @@ class PrivateScreen : public CoreOptions {
 	CompTimer               edgeDelayTimer;
 	CompDelayedEdgeSettings edgeDelaySettings;
 
+	ActionIndex actionIndex;
+
 	CompOption::Value plugin;
 	bool	          dirtyPluginList;
 
+	/* when each phase of startup ended, reported once the first
+	   plugin list is loaded */
+	std::vector<std::pair<const char *, long long> > startupPhases;
+
 	CompScreen  *screen;
 
 	CompWindowList windows;
-	CompWindow::Map windowsMap;
+	WindowIndex    clientIndex;
+	WindowIndex    frameIndex;
+	StackLayer     stackLayers[StackLayerCount];
 
 	Colormap colormap;
 	int      screenNum;
@@ -372,6 +642,9 @@ class PrivateScreen : public CoreOptions {
 	int          desktopWindowCount;
 	unsigned int mapNum;
 	unsigned int activeNum;
+	unsigned int matchGeneration;
+
+	MatchIndex   matchIndex;
 
 	CompOutput::vector outputDevs;
 	int	           currentOutputDev;
@@ -404,8 +677,8 @@ class PrivateScreen : public CoreOptions {
 	CompWindowVector clientList;            /* clients in mapping order */
 	CompWindowVector clientListStacking;    /* clients in stacking order */
 
-	std::vector<Window> clientIdList;        /* client ids in mapping order */
-	std::vector<Window> clientIdListStacking;/* client ids in stacking order */
+	ClientListProperty clientIdList;        /* client ids in mapping order */
+	ClientListProperty clientIdListStacking;/* client ids in stacking order */
 
 	std::list<ButtonGrab> buttonGrabs;
 	std::list<KeyGrab>    keyGrabs;
@@ -0,0 +1,111 @@
+/*
+ * Copyright © 2008 Dennis Kasprzyk
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the name of
+ * Dennis Kasprzyk not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior permission.
+ * Dennis Kasprzyk makes no representations about the suitability of this
+ * software for any purpose. It is provided "as is" without express or
+ * implied warranty.
+ *
+ * DENNIS KASPRZYK DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL DENNIS KASPRZYK BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION
+ * WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Dennis Kasprzyk <onestone@compiz-fusion.org>
+ */
+
+#ifndef _PRIVATESTACKSEARCH_H
+#define _PRIVATESTACKSEARCH_H
+
+/* Searches over an array of stack layers, each a map from stack key to
+   window. They are templates on the predicate so it can be inlined into
+   the walk instead of going through a boost::function for every window
+   visited. */
+
+/* topmost window of the layers in mask with a stack key between low and
+   high (both excluded) that passes check, each layer is only walked
+   down to the best window found so far */
+template <typename Layer, typename Check>
+typename Layer::mapped_type
+stackLayerSearchDown (Layer              *layers,
+		      unsigned int       nLayer,
+		      unsigned int       mask,
+		      unsigned long long low,
+		      unsigned long long high,
+		      const Check        &check)
+{
+    typename Layer::mapped_type found = NULL;
+    unsigned long long          bound = low;
+
+    for (unsigned int i = 0; i < nLayer; i++)
+    {
+	if (!(mask & (1 << i)))
+	    continue;
+
+	Layer                    &layer = layers[i];
+	typename Layer::iterator it = layer.lower_bound (high);
+
+	while (it != layer.begin ())
+	{
+	    --it;
+
+	    if (it->first <= bound)
+		break;
+
+	    if (check (it->second))
+	    {
+		found = it->second;
+		bound = it->first;
+		break;
+	    }
+	}
+    }
+
+    return found;
+}
+
+/* same as stackLayerSearchDown but for the bottommost window */
+template <typename Layer, typename Check>
+typename Layer::mapped_type
+stackLayerSearchUp (Layer              *layers,
+		    unsigned int       nLayer,
+		    unsigned int       mask,
+		    unsigned long long low,
+		    unsigned long long high,
+		    const Check        &check)
+{
+    typename Layer::mapped_type found = NULL;
+    unsigned long long          bound = high;
+
+    for (unsigned int i = 0; i < nLayer; i++)
+    {
+	if (!(mask & (1 << i)))
+	    continue;
+
+	Layer                    &layer = layers[i];
+	typename Layer::iterator it = layer.upper_bound (low);
+
+	for (; it != layer.end () && it->first < bound; ++it)
+	{
+	    if (check (it->second))
+	    {
+		found = it->second;
+		bound = it->first;
+		break;
+	    }
+	}
+    }
+
+    return found;
+}
+
+#endif
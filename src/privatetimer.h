@@ -0,0 +1,96 @@
+/*
+ * Copyright © 2008 Dennis Kasprzyk
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the name of
+ * Dennis Kasprzyk not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior permission.
+ * Dennis Kasprzyk makes no representations about the suitability of this
+ * software for any purpose. It is provided "as is" without express or
+ * implied warranty.
+ *
+ * DENNIS KASPRZYK DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL DENNIS KASPRZYK BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION
+ * WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Dennis Kasprzyk <onestone@compiz-fusion.org>
+ */
+
+#ifndef _PRIVATETIMER_H
+#define _PRIVATETIMER_H
+
+#include <vector>
+#include <boost/unordered_map.hpp>
+
+#include <core/timer.h>
+
+/*
+ * Queue of active timers keyed on absolute monotonic deadlines.
+ *
+ * Every queued timer lives in two indexed binary heaps: one ordered by
+ * its minimum deadline (which timers are allowed to fire) and one
+ * ordered by its maximum deadline (when we have to wake up at the
+ * latest). Insertion and removal are O(log n), nothing has to be
+ * touched when time passes.
+ */
+class TimerQueue {
+    public:
+	/* milliseconds on CLOCK_MONOTONIC */
+	typedef long long Time;
+
+	TimerQueue ();
+	~TimerQueue ();
+
+	static Time now ();
+
+	bool empty () const;
+	unsigned int size () const;
+	bool contains (CompTimer *timer) const;
+
+	void insert (CompTimer *timer, Time now);
+	void remove (CompTimer *timer);
+
+	CompTimer * top () const;
+	Time minDeadline () const;
+	Time maxDeadline () const;
+
+	int minLeft (CompTimer *timer, Time now) const;
+	int maxLeft (CompTimer *timer, Time now) const;
+
+    private:
+	struct Entry {
+	    CompTimer    *timer;
+	    Time         minDeadline;
+	    Time         maxDeadline;
+	    unsigned int serial;
+	    unsigned int minPos;
+	    unsigned int maxPos;
+	};
+
+	typedef std::vector<Entry *> Heap;
+	typedef boost::unordered_map<CompTimer *, Entry *> Index;
+
+	typedef Time         Entry::*Key;
+	typedef unsigned int Entry::*Pos;
+
+	static bool less (const Entry *a, const Entry *b, Key key);
+
+	void siftUp (Heap &heap, unsigned int i, Key key, Pos pos);
+	void siftDown (Heap &heap, unsigned int i, Key key, Pos pos);
+	void erase (Heap &heap, unsigned int i, Key key, Pos pos);
+
+    private:
+	Heap         minHeap;
+	Heap         maxHeap;
+	Index        index;
+	unsigned int serial;
+};
+
+#endif
@@ -57,6 +57,8 @@ class PrivateWindow {
 
 	bool restack (Window aboveId);
 
+	unsigned int getStackLayer ();
+
 	bool initializeSyncCounter ();
 
 	bool isGroupTransient (Window clientLeader);
@@ -67,6 +69,38 @@ class PrivateWindow {
 
 	static bool avoidStackingRelativeTo (CompWindow *w);
 
+	template <typename Check>
+	static CompWindow * stackSearchDown (unsigned int       layers,
+					     unsigned long long low,
+					     unsigned long long high,
+					     const Check        &check);
+
+	template <typename Check>
+	static CompWindow * stackSearchUp (unsigned int       layers,
+					   unsigned long long low,
+					   unsigned long long high,
+					   const Check        &check);
+
+	static bool stackCheckType (unsigned int mask,
+				    CompWindow   *w);
+
+	static bool stackableSibling (CompWindow *w,
+				      CompWindow *sibling);
+
+	static bool siblingBelowCheck (CompWindow   *w,
+				       Window       clientLeader,
+				       unsigned int type,
+				       bool         aboveFs,
+				       CompWindow   *below);
+
+	static bool lowestSiblingStop (CompWindow   *w,
+				       Window       clientLeader,
+				       unsigned int type,
+				       CompWindow   *below);
+
+	static bool invalidSiblingBelow (CompWindow *w,
+					 CompWindow *sibling);
+
 	static CompWindow * findSiblingBelow (CompWindow *w,
 					      bool       aboveFs);
 
@@ -145,6 +179,8 @@ class PrivateWindow {
 
 	void updateNormalHints ();
 
+	XWMHints * getWmHints ();
+
 	void updateWmHints ();
 
 	void updateClassHints ();
@@ -191,6 +227,9 @@ class PrivateWindow {
 
 	static unsigned int windowTypeFromString (const char *str);
 
+	void updateMatchGeneration ();
+	static unsigned int matchGenerationOf (CompWindow *w);
+
 	static int compareWindowActiveness (CompWindow *w1,
 					    CompWindow *w2);
 
@@ -208,8 +247,16 @@ class PrivateWindow {
 	Window	             id;
 	Window	             frame;
 	Window               wrapper;
+
+	/* this window's node in the screen's stacking list, its
+	   ordering key there (0 while not stacked) and its layer */
+	CompWindowList::iterator stackPos;
+	unsigned long long       stackKey;
+	unsigned int             stackLayer;
+
 	unsigned int         mapNum;
 	unsigned int         activeNum;
+	unsigned int         matchGeneration;
 	XWindowAttributes    attrib;
 	CompWindow::Geometry geometry;
 	CompWindow::Geometry serverGeometry;
@@ -0,0 +1,70 @@
+/*
+ * Copyright © 2008 Dennis Kasprzyk
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the name of
+ * Dennis Kasprzyk not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior permission.
+ * Dennis Kasprzyk makes no representations about the suitability of this
+ * software for any purpose. It is provided "as is" without express or
+ * implied warranty.
+ *
+ * DENNIS KASPRZYK DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL DENNIS KASPRZYK BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION
+ * WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Dennis Kasprzyk <onestone@compiz-fusion.org>
+ */
+
+#ifndef _PRIVATEWINDOWINDEX_H
+#define _PRIVATEWINDOWINDEX_H
+
+#include <X11/Xlib.h>
+
+class CompWindow;
+
+/*
+ * Open addressing hash from X window ids to CompWindow.
+ *
+ * Linear probing over a power of two table kept at most half full,
+ * removal shifts the following entries back instead of leaving
+ * tombstones so lookups never degrade over a long session. None is
+ * used as the empty slot marker and can't be stored.
+ */
+class WindowIndex {
+    public:
+	WindowIndex ();
+	~WindowIndex ();
+
+	CompWindow * find (Window id) const;
+
+	void insert (Window id, CompWindow *w);
+	void remove (Window id);
+	void clear ();
+
+	unsigned int size () const;
+
+    private:
+	struct Slot {
+	    Window     id;
+	    CompWindow *window;
+	};
+
+	unsigned int slot (Window id) const;
+	void grow ();
+
+    private:
+	Slot         *slots;
+	unsigned int mask;
+	unsigned int shift;
+	unsigned int count;
+};
+
+#endif
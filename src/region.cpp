@@ -24,6 +24,14 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <new>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include <X11/Xlib-xcb.h>
 #include <X11/Xutil.h>
@@ -37,78 +45,665 @@ const CompRegion infiniteRegion (CompRect (MINSHORT, MINSHORT,
 				           MAXSHORT * 2, MAXSHORT * 2));
 const CompRegion emptyRegion;
 
-CompRegion::CompRegion ()
+/* counted atomically like the match and value counters */
+static RegionStats regionStats;
+
+static inline void
+regionStatsCount (unsigned int &counter)
 {
-    priv = new PrivateRegion ();
+    __sync_fetch_and_add (&counter, 1);
 }
 
-CompRegion::CompRegion (const CompRegion &c)
+static unsigned int
+regionStatsRead (unsigned int &counter,
+		 bool         reset)
 {
-    priv = new PrivateRegion ();
-    priv->box = c.priv->box;
-    if (priv->box.rects)
-	priv->box.rects = &priv->box.extents;
-    if (c.priv->region)
+    if (reset)
+	return __sync_fetch_and_and (&counter, 0);
+
+    return __sync_fetch_and_add (&counter, 0);
+}
+
+RegionStats
+getRegionStats (bool reset)
+{
+    RegionStats stats;
+
+    stats.allocations = regionStatsRead (regionStats.allocations, reset);
+    stats.heapArrays  = regionStatsRead (regionStats.heapArrays, reset);
+    stats.shared      = regionStatsRead (regionStats.shared, reset);
+    stats.detached    = regionStatsRead (regionStats.detached, reset);
+
+    return stats;
+}
+
+/* Band algorithms below follow Xlib's miRegionOp and friends. */
+
+typedef void (*OverlapFunc) (BoxArray  &dest,
+			     const BOX *r1,
+			     const BOX *r1End,
+			     const BOX *r2,
+			     const BOX *r2End,
+			     short     y1,
+			     short     y2);
+
+typedef void (*NonOverlapFunc) (BoxArray  &dest,
+				const BOX *r,
+				const BOX *rEnd,
+				short     y1,
+				short     y2);
+
+/* whether two bands of n boxes cover the same x spans */
+static inline bool
+sameSpans (const BOX    *a,
+	   const BOX    *b,
+	   unsigned int n)
+{
+    unsigned int i = 0;
+
+#ifdef __SSE2__
+    /* two boxes per compare, only x1 and x2 (the low 4 bytes of each
+       box) have to match */
+    for (; i + 2 <= n; i += 2)
+    {
+	__m128i va = _mm_loadu_si128 ((const __m128i *) (a + i));
+	__m128i vb = _mm_loadu_si128 ((const __m128i *) (b + i));
+
+	if ((_mm_movemask_epi8 (_mm_cmpeq_epi16 (va, vb)) & 0x0f0f) != 0x0f0f)
+	    return false;
+    }
+#endif
+
+    for (; i < n; i++)
+	if (a[i].x1 != b[i].x1 || a[i].x2 != b[i].x2)
+	    return false;
+
+    return true;
+}
+
+/* Merges the band starting at curStart into the one starting at
+   prevStart if they touch and have the same spans. Returns the start of
+   the last band. */
+static unsigned int
+coalesce (BoxArray     &boxes,
+	  unsigned int prevStart,
+	  unsigned int curStart)
+{
+    unsigned int end = boxes.size ();
+    unsigned int prevNum = curStart - prevStart;
+    unsigned int curNum = 0;
+    unsigned int i;
+    short        bandY1 = boxes[curStart].y1;
+
+    for (i = curStart; i != end && boxes[i].y1 == bandY1; i++)
+	curNum++;
+
+    /* more than one band was added, the next coalescing job starts at
+       the last one */
+    if (i != end)
+    {
+	unsigned int last = end - 1;
+
+	while (boxes[last - 1].y1 == boxes[last].y1)
+	    last--;
+
+	curStart = last;
+    }
+
+    if (curNum != prevNum || !curNum)
+	return curStart;
+
+    i -= curNum;
+
+    if (boxes[prevStart].y2 != boxes[i].y1)
+	return curStart;
+
+    if (!sameSpans (boxes.data () + prevStart, boxes.data () + i, curNum))
+	return curStart;
+
+    for (unsigned int j = 0; j < curNum; j++)
+	boxes[prevStart + j].y2 = boxes[i + j].y2;
+
+    if (i + curNum == end)
+	curStart = prevStart;
+    else
+	memmove (boxes.data () + i, boxes.data () + i + curNum,
+		 (end - i - curNum) * sizeof (BOX));
+
+    boxes.resize (end - curNum);
+
+    return curStart;
+}
+
+static inline const BOX *
+bandEnd (const BOX *r,
+	 const BOX *rEnd)
+{
+    const BOX *e = r;
+
+    while (e != rEnd && e->y1 == r->y1)
+	e++;
+
+    return e;
+}
+
+static void
+regionOp (BoxArray       &dest,
+	  const BoxArray &reg1,
+	  const BoxArray &reg2,
+	  OverlapFunc    overlap,
+	  NonOverlapFunc nonOverlap1,
+	  NonOverlapFunc nonOverlap2)
+{
+    const BOX    *r1 = reg1.data ();
+    const BOX    *r2 = reg2.data ();
+    const BOX    *r1End = r1 + reg1.size ();
+    const BOX    *r2End = r2 + reg2.size ();
+    const BOX    *r1BandEnd, *r2BandEnd;
+    short        ybot, ytop, top, bot;
+    unsigned int prevBand = 0, curBand;
+
+    dest.clear ();
+    dest.reserve (2 * (reg1.size () + reg2.size ()));
+
+    ybot = MIN (r1->y1, r2->y1);
+
+    do
+    {
+	curBand = dest.size ();
+
+	r1BandEnd = bandEnd (r1, r1End);
+	r2BandEnd = bandEnd (r2, r2End);
+
+	/* the part of a band that only one region covers */
+	if (r1->y1 < r2->y1)
+	{
+	    top = MAX (r1->y1, ybot);
+	    bot = MIN (r1->y2, r2->y1);
+
+	    if (top != bot && nonOverlap1)
+		(*nonOverlap1) (dest, r1, r1BandEnd, top, bot);
+
+	    ytop = r2->y1;
+	}
+	else if (r2->y1 < r1->y1)
+	{
+	    top = MAX (r2->y1, ybot);
+	    bot = MIN (r2->y2, r1->y1);
+
+	    if (top != bot && nonOverlap2)
+		(*nonOverlap2) (dest, r2, r2BandEnd, top, bot);
+
+	    ytop = r1->y1;
+	}
+	else
+	{
+	    ytop = r1->y1;
+	}
+
+	if (dest.size () != curBand)
+	    prevBand = coalesce (dest, prevBand, curBand);
+
+	/* and the part both cover */
+	ybot = MIN (r1->y2, r2->y2);
+	curBand = dest.size ();
+
+	if (ybot > ytop)
+	    (*overlap) (dest, r1, r1BandEnd, r2, r2BandEnd, ytop, ybot);
+
+	if (dest.size () != curBand)
+	    prevBand = coalesce (dest, prevBand, curBand);
+
+	if (r1->y2 == ybot)
+	    r1 = r1BandEnd;
+	if (r2->y2 == ybot)
+	    r2 = r2BandEnd;
+    } while (r1 != r1End && r2 != r2End);
+
+    curBand = dest.size ();
+
+    if (r1 != r1End)
+    {
+	if (nonOverlap1)
+	{
+	    do
+	    {
+		r1BandEnd = bandEnd (r1, r1End);
+		(*nonOverlap1) (dest, r1, r1BandEnd, MAX (r1->y1, ybot),
+				r1->y2);
+		r1 = r1BandEnd;
+	    } while (r1 != r1End);
+	}
+    }
+    else if (r2 != r2End && nonOverlap2)
+    {
+	do
+	{
+	    r2BandEnd = bandEnd (r2, r2End);
+	    (*nonOverlap2) (dest, r2, r2BandEnd, MAX (r2->y1, ybot),
+			    r2->y2);
+	    r2 = r2BandEnd;
+	} while (r2 != r2End);
+    }
+
+    if (dest.size () != curBand)
+	coalesce (dest, prevBand, curBand);
+}
+
+static void
+copyNonOverlap (BoxArray  &dest,
+		const BOX *r,
+		const BOX *rEnd,
+		short     y1,
+		short     y2)
+{
+    for (; r != rEnd; r++)
+	dest.push_back (r->x1, y1, r->x2, y2);
+}
+
+static inline void
+mergeBox (BoxArray  &dest,
+	  const BOX *r,
+	  short     y1,
+	  short     y2)
+{
+    if (!dest.empty ()       &&
+	dest.back ().y1 == y1 &&
+	dest.back ().y2 == y2 &&
+	dest.back ().x2 >= r->x1)
+    {
+	if (dest.back ().x2 < r->x2)
+	    dest.back ().x2 = r->x2;
+    }
+    else
+    {
+	dest.push_back (r->x1, y1, r->x2, y2);
+    }
+}
+
+static void
+unionOverlap (BoxArray  &dest,
+	      const BOX *r1,
+	      const BOX *r1End,
+	      const BOX *r2,
+	      const BOX *r2End,
+	      short     y1,
+	      short     y2)
+{
+    while (r1 != r1End && r2 != r2End)
+    {
+	if (r1->x1 < r2->x1)
+	    mergeBox (dest, r1++, y1, y2);
+	else
+	    mergeBox (dest, r2++, y1, y2);
+    }
+
+    for (; r1 != r1End; r1++)
+	mergeBox (dest, r1, y1, y2);
+
+    for (; r2 != r2End; r2++)
+	mergeBox (dest, r2, y1, y2);
+}
+
+static void
+intersectOverlap (BoxArray  &dest,
+		  const BOX *r1,
+		  const BOX *r1End,
+		  const BOX *r2,
+		  const BOX *r2End,
+		  short     y1,
+		  short     y2)
+{
+    while (r1 != r1End && r2 != r2End)
+    {
+	short x1 = MAX (r1->x1, r2->x1);
+	short x2 = MIN (r1->x2, r2->x2);
+
+	if (x1 < x2)
+	    dest.push_back (x1, y1, x2, y2);
+
+	if (r1->x2 < r2->x2)
+	{
+	    r1++;
+	}
+	else if (r2->x2 < r1->x2)
+	{
+	    r2++;
+	}
+	else
+	{
+	    r1++;
+	    r2++;
+	}
+    }
+}
+
+static void
+subtractOverlap (BoxArray  &dest,
+		 const BOX *r1,
+		 const BOX *r1End,
+		 const BOX *r2,
+		 const BOX *r2End,
+		 short     y1,
+		 short     y2)
+{
+    short x1 = r1->x1;
+
+    while (r1 != r1End && r2 != r2End)
+    {
+	if (r2->x2 <= x1)
+	{
+	    /* subtrahend entirely to the left */
+	    r2++;
+	}
+	else if (r2->x1 <= x1)
+	{
+	    /* subtrahend covers the left edge */
+	    x1 = r2->x2;
+	    if (x1 >= r1->x2)
+	    {
+		if (++r1 != r1End)
+		    x1 = r1->x1;
+	    }
+	    else
+	    {
+		r2++;
+	    }
+	}
+	else if (r2->x1 < r1->x2)
+	{
+	    /* subtrahend splits the minuend */
+	    dest.push_back (x1, y1, r2->x1, y2);
+
+	    x1 = r2->x2;
+	    if (x1 >= r1->x2)
+	    {
+		if (++r1 != r1End)
+		    x1 = r1->x1;
+	    }
+	    else
+	    {
+		r2++;
+	    }
+	}
+	else
+	{
+	    /* minuend done */
+	    if (r1->x2 > x1)
+		dest.push_back (x1, y1, r1->x2, y2);
+
+	    if (++r1 != r1End)
+		x1 = r1->x1;
+	}
+    }
+
+    while (r1 != r1End)
+    {
+	dest.push_back (x1, y1, r1->x2, y2);
+
+	if (++r1 != r1End)
+	    x1 = r1->x1;
+    }
+}
+
+static void
+unionRegion (PrivateRegion       &dest,
+	     const PrivateRegion &r1,
+	     const PrivateRegion &r2)
+{
+    if (r2.rects.empty () ||
+	(r1.rects.size () == 1 &&
+	 r1.extents.x1 <= r2.extents.x1 && r1.extents.x2 >= r2.extents.x2 &&
+	 r1.extents.y1 <= r2.extents.y1 && r1.extents.y2 >= r2.extents.y2))
+    {
+	dest.rects   = r1.rects;
+	dest.extents = r1.extents;
+	return;
+    }
+
+    if (r1.rects.empty () ||
+	(r2.rects.size () == 1 &&
+	 r2.extents.x1 <= r1.extents.x1 && r2.extents.x2 >= r1.extents.x2 &&
+	 r2.extents.y1 <= r1.extents.y1 && r2.extents.y2 >= r1.extents.y2))
+    {
+	dest.rects   = r2.rects;
+	dest.extents = r2.extents;
+	return;
+    }
+
+    regionOp (dest.rects, r1.rects, r2.rects,
+	      unionOverlap, copyNonOverlap, copyNonOverlap);
+    dest.setExtents ();
+}
+
+static void
+intersectRegion (PrivateRegion       &dest,
+		 const PrivateRegion &r1,
+		 const PrivateRegion &r2)
+{
+    if (r1.rects.empty () || r2.rects.empty () ||
+	!EXTENTCHECK (&r1.extents, &r2.extents))
+    {
+	dest.rects.clear ();
+    }
+    else if (r1.rects.size () == 1 && r2.rects.size () == 1)
+    {
+	dest.rects.clear ();
+	dest.rects.push_back (MAX (r1.extents.x1, r2.extents.x1),
+			      MAX (r1.extents.y1, r2.extents.y1),
+			      MIN (r1.extents.x2, r2.extents.x2),
+			      MIN (r1.extents.y2, r2.extents.y2));
+    }
+    else
+    {
+	regionOp (dest.rects, r1.rects, r2.rects, intersectOverlap, NULL, NULL);
+    }
+
+    dest.setExtents ();
+}
+
+static void
+subtractRegion (PrivateRegion       &dest,
+		const PrivateRegion &r1,
+		const PrivateRegion &r2)
+{
+    if (r1.rects.empty () || r2.rects.empty () ||
+	!EXTENTCHECK (&r1.extents, &r2.extents))
+    {
+	dest.rects   = r1.rects;
+	dest.extents = r1.extents;
+	return;
+    }
+
+    regionOp (dest.rects, r1.rects, r2.rects,
+	      subtractOverlap, copyNonOverlap, NULL);
+    dest.setExtents ();
+}
+
+static void
+translateRegion (PrivateRegion &r,
+		 int           dx,
+		 int           dy)
+{
+    BOX          *b = r.rects.data ();
+    unsigned int n = r.rects.size ();
+    unsigned int i = 0;
+
+    if (!n)
+	return;
+
+#ifdef __SSE2__
+    /* BOX is x1, x2, y1, y2 */
+    __m128i d = _mm_setr_epi16 (dx, dx, dy, dy, dx, dx, dy, dy);
+
+    for (; i + 2 <= n; i += 2)
+    {
+	__m128i v = _mm_loadu_si128 ((const __m128i *) (b + i));
+
+	_mm_storeu_si128 ((__m128i *) (b + i), _mm_add_epi16 (v, d));
+    }
+#endif
+
+    for (; i < n; i++)
+    {
+	b[i].x1 += dx;
+	b[i].x2 += dx;
+	b[i].y1 += dy;
+	b[i].y2 += dy;
+    }
+
+    r.extents.x1 += dx;
+    r.extents.x2 += dx;
+    r.extents.y1 += dy;
+    r.extents.y2 += dy;
+}
+
+/* XShrinkRegion's Compress: combines the region with copies of itself
+   shifted by up to dx along one axis, in log2 (dx) steps */
+static void
+compressRegion (PrivateRegion &r,
+		unsigned int  dx,
+		bool          xdir,
+		bool          grow)
+{
+    PrivateRegion s (r), t, tmp;
+    unsigned int  shift = 1;
+
+    while (dx)
+    {
+	if (dx & shift)
+	{
+	    if (xdir)
+		translateRegion (r, -(int) shift, 0);
+	    else
+		translateRegion (r, 0, -(int) shift);
+
+	    if (grow)
+		unionRegion (tmp, r, s);
+	    else
+		intersectRegion (tmp, r, s);
+
+	    r.rects.swap (tmp.rects);
+	    r.extents = tmp.extents;
+
+	    dx -= shift;
+	    if (!dx)
+		break;
+	}
+
+	t = s;
+
+	if (xdir)
+	    translateRegion (s, -(int) shift, 0);
+	else
+	    translateRegion (s, 0, -(int) shift);
+
+	if (grow)
+	    unionRegion (tmp, s, t);
+	else
+	    intersectRegion (tmp, s, t);
+
+	s.rects.swap (tmp.rects);
+	s.extents = tmp.extents;
+
+	shift <<= 1;
+    }
+}
+
+static void
+shrinkRegion (PrivateRegion &r,
+	      int           dx,
+	      int           dy)
+{
+    bool grow;
+
+    if (!dx && !dy)
+	return;
+
+    if (dx)
+    {
+	grow = dx < 0;
+	if (grow)
+	    dx = -dx;
+
+	compressRegion (r, 2 * dx, true, grow);
+    }
+
+    if (dy)
     {
-	priv->region = XCreateRegion ();
-	XUnionRegion (CompRegion ().handle (), c.priv->region, priv->region);
+	grow = dy < 0;
+	if (grow)
+	    dy = -dy;
+
+	compressRegion (r, 2 * dy, false, grow);
     }
+
+    translateRegion (r, dx, dy);
+}
+
+CompRegion::CompRegion ()
+{
+    priv = PrivateRegion::empty ()->ref ();
+}
+
+CompRegion::CompRegion (const CompRegion &c)
+{
+    priv = c.priv->ref ();
 }
 
 CompRegion::CompRegion ( int x, int y, int w, int h)
 {
     priv = new PrivateRegion ();
-    priv->box.extents = CompRect (x, y, w, h).region ()->extents;
-    priv->box.numRects = 1;
-    priv->box.rects = &priv->box.extents;
+    priv->setRect (CompRect (x, y, w, h));
 }
 
 CompRegion::CompRegion (const CompRect &r)
 {
     priv = new PrivateRegion ();
-    priv->box.extents = r.region ()->extents;
-    priv->box.numRects = 1;
-    priv->box.rects = &priv->box.extents;
+    priv->setRect (r);
 }
 
 CompRegion::~CompRegion ()
 {
-    delete priv;
+    PrivateRegion::unref (priv);
 }
 
+/* The returned region points into this one and is only valid until it
+   changes, it must not be modified. */
 const Region
 CompRegion::handle () const
 {
-    return (priv->region)? priv->region : &priv->box;
+    return priv->handle ();
 }
 
 CompRegion &
 CompRegion::operator= (const CompRegion &c)
 {
-    priv->box = c.priv->box;
-    if (priv->box.rects)
-	priv->box.rects = &priv->box.extents;
-    if (c.priv->region)
-    {
-	if (!priv->region)
-	    priv->region = XCreateRegion ();
-	XUnionRegion (CompRegion ().handle (), c.priv->region, priv->region);
-    }
-    else
-    {
-	if (priv->region)
-	{
-	    XDestroyRegion (priv->region);
-	    priv->region = NULL;
-	}
-    }
+    PrivateRegion *old = priv;
+
+    priv = c.priv->ref ();
+    PrivateRegion::unref (old);
+
     return *this;
 }
 
 bool
 CompRegion::operator== (const CompRegion &c) const
 {
-    return XEqualRegion (handle (), c.handle ());
+    const BoxArray &r1 = priv->rects;
+    const BoxArray &r2 = c.priv->rects;
+
+    if (priv == c.priv)
+	return true;
+
+    if (r1.size () != r2.size ())
+	return false;
+
+    if (r1.empty ())
+	return true;
+
+    return !memcmp (&priv->extents, &c.priv->extents, sizeof (BOX)) &&
+	   !memcmp (r1.data (), r2.data (), r1.size () * sizeof (BOX));
 }
 
 bool
@@ -120,52 +715,132 @@ CompRegion::operator!= (const CompRegion &c) const
 CompRect
 CompRegion::boundingRect () const
 {
-    BOX b = handle ()->extents;
+    BOX b = priv->extents;
     return CompRect (b.x1, b.y1, b.x2 - b.x1, b.y2 - b.y1);
 }
 
 bool
 CompRegion::contains (const CompPoint &p) const
 {
-    return XPointInRegion (handle (), p.x (), p.y ());
+    const BoxArray &r = priv->rects;
+    int            x = p.x (), y = p.y ();
+
+    if (r.empty () ||
+	x < priv->extents.x1 || x >= priv->extents.x2 ||
+	y < priv->extents.y1 || y >= priv->extents.y2)
+	return false;
+
+    for (unsigned int i = 0; i < r.size () && r[i].y1 <= y; i++)
+	if (y < r[i].y2 && x >= r[i].x1 && x < r[i].x2)
+	    return true;
+
+    return false;
 }
 
-bool
-CompRegion::contains (const CompRect &r) const
+/* Xlib's XRectInRegion */
+static int
+rectIn (const PrivateRegion &reg,
+	int                 rx1,
+	int                 ry1,
+	int                 rx2,
+	int                 ry2)
 {
-    int result;
+    const BoxArray &r = reg.rects;
+    bool           partIn = false, partOut = false;
+    int            x = rx1, y = ry1;
+
+    if (r.empty ()                ||
+	reg.extents.x2 <= rx1     ||
+	reg.extents.x1 >= rx2     ||
+	reg.extents.y2 <= ry1     ||
+	reg.extents.y1 >= ry2)
+	return RectangleOut;
+
+    for (unsigned int i = 0; i < r.size (); i++)
+    {
+	const BOX &b = r[i];
 
-    result = XRectInRegion (handle (), r.x (), r.y (), r.width (), r.height ());
+	if (b.y2 <= y)
+	    continue;
 
-    return result == RectangleIn;
+	if (b.y1 > y)
+	{
+	    partOut = true;
+	    if (partIn || b.y1 >= ry2)
+		break;
+	    y = b.y1;
+	}
+
+	if (b.x2 <= x)
+	    continue;
+
+	if (b.x1 > x)
+	{
+	    partOut = true;
+	    if (partIn)
+		break;
+	}
+
+	if (b.x1 < rx2)
+	{
+	    partIn = true;
+	    if (partOut)
+		break;
+	}
+
+	if (b.x2 >= rx2)
+	{
+	    y = b.y2;
+	    if (y >= ry2)
+		break;
+	    x = rx1;
+	}
+	else
+	{
+	    partOut = true;
+	    break;
+	}
+    }
+
+    if (!partIn)
+	return RectangleOut;
+
+    return y < ry2 ? RectanglePart : RectangleIn;
 }
 
 bool
-CompRegion::contains (int x, int y, int width, int height) const
+CompRegion::contains (const CompRect &r) const
 {
-    int result;
-
-    result = XRectInRegion (handle (), x, y, width, height);
+    return rectIn (*priv, r.x1 (), r.y1 (), r.x2 (), r.y2 ()) == RectangleIn;
+}
 
-    return result == RectangleIn;
+bool
+CompRegion::contains (int x, int y, int width, int height) const
+{
+    return rectIn (*priv, x, y, x + width, y + height) == RectangleIn;
 }
 
 CompRegion
 CompRegion::intersected (const CompRegion &r) const
 {
-    CompRegion reg (r);
-    reg.priv->makeReal ();
-    XIntersectRegion (reg.handle (), handle (), reg.handle ());
+    CompRegion reg;
+
+    if (priv == r.priv)
+	return *this;
+
+    if (priv->rects.empty () || r.priv->rects.empty ())
+	return reg;
+
+    reg.priv = PrivateRegion::detach (reg.priv);
+    intersectRegion (*reg.priv, *priv, *r.priv);
+
     return reg;
 }
 
 CompRegion
 CompRegion::intersected (const CompRect &r) const
 {
-    CompRegion reg (r);
-    reg.priv->makeReal ();
-    XIntersectRegion (reg.handle (), handle (), reg.handle ());
-    return reg;
+    return intersected (CompRegion (r));
 }
 
 bool
@@ -177,45 +852,34 @@ CompRegion::intersects (const CompRegion &r) const
 bool
 CompRegion::intersects (const CompRect &r) const
 {
-    int result;
-    result = XRectInRegion (handle (), r.x (), r.y (), r.width (), r.height ());
-
-    return result != RectangleOut;
+    return rectIn (*priv, r.x1 (), r.y1 (), r.x2 (), r.y2 ()) != RectangleOut;
 }
 
 bool
 CompRegion::isEmpty () const
 {
-    return XEmptyRegion (handle ());
+    return priv->rects.empty ();
 }
 
 int
 CompRegion::numRects () const
 {
-    return handle ()->numRects;
+    return priv->rects.size ();
 }
 
 CompRect::vector
 CompRegion::rects () const
 {
     CompRect::vector rv;
-    if (!numRects ())
-	return rv;
-    if (!priv->region)
-    {
-	rv.push_back (CompRect (priv->box.extents.x1,
-		                priv->box.extents.y1,
-				priv->box.extents.x2 - priv->box.extents.x1,
-				priv->box.extents.y2 - priv->box.extents.y1));
-	return rv;
-    }
 
-    BOX b;
-    for (int i = 0; i < priv->region->numRects; i++)
+    rv.reserve (priv->rects.size ());
+
+    for (unsigned int i = 0; i < priv->rects.size (); i++)
     {
-	b = priv->region->rects[i];
+	const BOX &b = priv->rects[i];
 	rv.push_back (CompRect (b.x1, b.y1, b.x2 - b.x1, b.y2 - b.y1));
     }
+
     return rv;
 }
 
@@ -223,25 +887,34 @@ CompRegion
 CompRegion::subtracted (const CompRegion &r) const
 {
     CompRegion rv;
-    rv.priv->makeReal ();
-    XSubtractRegion (handle (), r.handle (), rv.handle ());
+
+    if (priv == r.priv)
+	return rv;
+
+    if (priv->rects.empty () || r.priv->rects.empty () ||
+	!EXTENTCHECK (&priv->extents, &r.priv->extents))
+	return *this;
+
+    rv.priv = PrivateRegion::detach (rv.priv);
+    subtractRegion (*rv.priv, *priv, *r.priv);
+
     return rv;
 }
 
 CompRegion
 CompRegion::subtracted (const CompRect &r) const
 {
-    CompRegion rv;
-    rv.priv->makeReal ();
-    XSubtractRegion (handle (), r.region (), rv.handle ());
-    return rv;
+    return subtracted (CompRegion (r));
 }
 
 void
 CompRegion::translate (int dx, int dy)
 {
-    priv->makeReal ();
-    XOffsetRegion (handle (), dx, dy);
+    if ((!dx && !dy) || priv->rects.empty ())
+	return;
+
+    priv = PrivateRegion::detach (priv);
+    translateRegion (*priv, dx, dy);
 }
 
 void
@@ -269,8 +942,11 @@ CompRegion::translated (const CompPoint &p) const
 void
 CompRegion::shrink (int dx, int dy)
 {
-    priv->makeReal ();
-    XShrinkRegion (handle (), dx, dy);
+    if ((!dx && !dy) || priv->rects.empty ())
+	return;
+
+    priv = PrivateRegion::detach (priv);
+    shrinkRegion (*priv, dx, dy);
 }
 
 void
@@ -299,26 +975,40 @@ CompRegion
 CompRegion::united (const CompRegion &r) const
 {
     CompRegion rv;
-    rv.priv->makeReal ();
-    XUnionRegion (handle (), r.handle (), rv.handle ());
+
+    if (priv == r.priv || r.priv->rects.empty ())
+	return *this;
+
+    if (priv->rects.empty ())
+	return r;
+
+    rv.priv = PrivateRegion::detach (rv.priv);
+    unionRegion (*rv.priv, *priv, *r.priv);
+
     return rv;
 }
 
 CompRegion
 CompRegion::united (const CompRect &r) const
 {
-    CompRegion rv;
-    rv.priv->makeReal ();
-    XUnionRegion (handle (), r.region (), rv.handle ());
-    return rv;
+    return united (CompRegion (r));
 }
 
 CompRegion
 CompRegion::xored (const CompRegion &r) const
 {
-    CompRegion rv;
-    rv.priv->makeReal ();
-    XXorRegion (handle (), r.handle (), rv.handle ());
+    PrivateRegion a, b;
+    CompRegion    rv;
+
+    if (priv == r.priv)
+	return rv;
+
+    rv.priv = PrivateRegion::detach (rv.priv);
+
+    subtractRegion (a, *priv, *r.priv);
+    subtractRegion (b, *r.priv, *priv);
+    unionRegion (*rv.priv, a, b);
+
     return rv;
 }
 
@@ -419,31 +1109,230 @@ CompRegion::operator|= (const CompRegion &r)
 }
 
 
-PrivateRegion::PrivateRegion ()
+PrivateRegion::PrivateRegion () :
+    rects (),
+    refCount (1)
+{
+    extents.x1 = 0;
+    extents.x2 = 0;
+    extents.y1 = 0;
+    extents.y2 = 0;
+
+    regionStatsCount (regionStats.allocations);
+}
+
+PrivateRegion::PrivateRegion (const PrivateRegion &r) :
+    rects (r.rects),
+    extents (r.extents),
+    refCount (1)
+{
+    regionStatsCount (regionStats.allocations);
+}
+
+PrivateRegion &
+PrivateRegion::operator= (const PrivateRegion &r)
+{
+    /* view is filled in by handle (), it would point at r's boxes */
+    rects   = r.rects;
+    extents = r.extents;
+
+    return *this;
+}
+
+/* shared by all default constructed regions, never freed */
+PrivateRegion *
+PrivateRegion::empty ()
 {
-    region = NULL;
-    box.numRects = 0;
-    box.extents.x1 = 0;
-    box.extents.y1 = 0;
-    box.extents.x2 = 0;
-    box.extents.y2 = 0;
-    box.rects = NULL;
-    box.size = 0;
+    static PrivateRegion *region = new PrivateRegion ();
+
+    return region;
 }
 
-PrivateRegion::~PrivateRegion ()
+PrivateRegion *
+PrivateRegion::ref ()
 {
-    if (region)
-	XDestroyRegion (region);
+    refCount++;
+    regionStatsCount (regionStats.shared);
+
+    return this;
 }
 
 void
-PrivateRegion::makeReal ()
+PrivateRegion::unref (PrivateRegion *r)
+{
+    if (!--r->refCount)
+	delete r;
+}
+
+/* Returns a region with the same content that may be modified, which
+   is r itself unless it is shared. Takes over the caller's reference. */
+PrivateRegion *
+PrivateRegion::detach (PrivateRegion *r)
 {
-    if (region)
+    PrivateRegion *copy;
+
+    if (r->refCount == 1)
+	return r;
+
+    copy = new PrivateRegion (*r);
+    r->refCount--;
+
+    regionStatsCount (regionStats.detached);
+
+    return copy;
+}
+
+/* degenerate rectangles make empty regions */
+void
+PrivateRegion::setRect (const CompRect &r)
+{
+    const BOX &b = r.region ()->extents;
+
+    rects.clear ();
+
+    if (b.x1 < b.x2 && b.y1 < b.y2)
+	rects.push_back (b.x1, b.y1, b.x2, b.y2);
+
+    setExtents ();
+}
+
+void
+PrivateRegion::setExtents ()
+{
+    unsigned int n = rects.size ();
+
+    if (!n)
+    {
+	extents.x1 = extents.x2 = 0;
+	extents.y1 = extents.y2 = 0;
 	return;
-    region = XCreateRegion ();
-    if (box.numRects)
-	XUnionRegion (CompRegion ().handle (), &box, region);
+    }
+
+    /* bands are sorted by y, only x needs looking at every box */
+    extents.x1 = rects[0].x1;
+    extents.y1 = rects[0].y1;
+    extents.x2 = rects[n - 1].x2;
+    extents.y2 = rects[n - 1].y2;
+
+    for (unsigned int i = 0; i < n; i++)
+    {
+	if (rects[i].x1 < extents.x1)
+	    extents.x1 = rects[i].x1;
+	if (rects[i].x2 > extents.x2)
+	    extents.x2 = rects[i].x2;
+    }
 }
 
+const Region
+PrivateRegion::handle ()
+{
+    view.size     = rects.size ();
+    view.numRects = rects.size ();
+    view.rects    = rects.data ();
+    view.extents  = extents;
+
+    return &view;
+}
+
+BoxArray::BoxArray () :
+    mData (mInline),
+    mSize (0),
+    mCapacity (REGION_INLINE_BOXES)
+{
+}
+
+BoxArray::BoxArray (const BoxArray &a) :
+    mData (mInline),
+    mSize (0),
+    mCapacity (REGION_INLINE_BOXES)
+{
+    *this = a;
+}
+
+BoxArray::~BoxArray ()
+{
+    if (mData != mInline)
+	free (mData);
+}
+
+BoxArray &
+BoxArray::operator= (const BoxArray &a)
+{
+    if (this == &a)
+	return *this;
+
+    mSize = 0;
+    reserve (a.mSize);
+
+    memcpy (mData, a.mData, a.mSize * sizeof (BOX));
+    mSize = a.mSize;
+
+    return *this;
+}
+
+void
+BoxArray::reserve (unsigned int capacity)
+{
+    BOX *data;
+
+    if (capacity <= mCapacity)
+	return;
+
+    if (capacity < 2 * mCapacity)
+	capacity = 2 * mCapacity;
+
+    data = (BOX *) malloc (capacity * sizeof (BOX));
+    if (!data)
+	throw std::bad_alloc ();
+
+    regionStatsCount (regionStats.heapArrays);
+
+    memcpy (data, mData, mSize * sizeof (BOX));
+
+    if (mData != mInline)
+	free (mData);
+
+    mData     = data;
+    mCapacity = capacity;
+}
+
+void
+BoxArray::resize (unsigned int size)
+{
+    reserve (size);
+    mSize = size;
+}
+
+void
+BoxArray::push_back (short x1, short y1, short x2, short y2)
+{
+    BOX *b;
+
+    if (mSize == mCapacity)
+	reserve (mSize + 1);
+
+    b = &mData[mSize++];
+
+    b->x1 = x1;
+    b->x2 = x2;
+    b->y1 = y1;
+    b->y2 = y2;
+}
+
+void
+BoxArray::swap (BoxArray &a)
+{
+    if (mData != mInline && a.mData != a.mInline)
+    {
+	std::swap (mData, a.mData);
+	std::swap (mSize, a.mSize);
+	std::swap (mCapacity, a.mCapacity);
+    }
+    else
+    {
+	BoxArray tmp (a);
+
+	a     = *this;
+	*this = tmp;
+    }
+}
@@ -37,15 +37,21 @@
 #include <sys/time.h>
 #include <unistd.h>
 #include <assert.h>
+#include <errno.h>
 #include <limits.h>
 #include <poll.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
 #include <algorithm>
+#include <deque>
+#include <set>
 
 #include <boost/bind.hpp>
 #include <boost/foreach.hpp>
 #define foreach BOOST_FOREACH
 
 #include <X11/Xlib.h>
+#include <X11/Xlib-xcb.h>
 #include <X11/Xatom.h>
 #include <X11/Xproto.h>
 #include <X11/extensions/Xrandr.h>
@@ -60,6 +66,12 @@
 #include <core/atoms.h>
 #include "privatescreen.h"
 #include "privatewindow.h"
+#include "privateeventreader.h"
+#include "privateregion.h"
+#include "privatematch.h"
+#include "privateoption.h"
+#include "privatepluginregistry.h"
+#include "privatepluginpreloader.h"
 
 bool inHandleEvent = false;
 
@@ -110,22 +122,36 @@ CompScreen::freePluginClassIndex (unsigned int index)
 	screen->pluginClasses.resize (screenPluginClassIndices.size ());
 }
 
-#define TIMEVALDIFF(tv1, tv2)						   \
-    ((tv1)->tv_sec == (tv2)->tv_sec || (tv1)->tv_usec >= (tv2)->tv_usec) ? \
-    ((((tv1)->tv_sec - (tv2)->tv_sec) * 1000000) +			   \
-     ((tv1)->tv_usec - (tv2)->tv_usec)) / 1000 :			   \
-    ((((tv1)->tv_sec - 1 - (tv2)->tv_sec) * 1000000) +			   \
-     (1000000 + (tv1)->tv_usec - (tv2)->tv_usec)) / 1000
-
 void
 CompScreen::eventLoop ()
 {
-    struct timeval    tv;
-    CompTimer         *t;
-    int               time;
     CompWatchFdHandle watchFdHandle;
+    int               fd = ConnectionNumber (priv->dpy);
+
+    if (threadedEvents)
+    {
+	priv->eventReader = new EventReader (priv->connection);
+
+	if (priv->eventReader->start ())
+	{
+	    fd = priv->eventReader->fd ();
+	}
+	else
+	{
+	    compLogMessage ("core", CompLogLevelWarn,
+			    "Couldn't start event reader thread");
+	    delete priv->eventReader;
+	    priv->eventReader = NULL;
+	}
+    }
+
+    watchFdHandle = addWatchFd (fd, POLLIN, NULL);
+
+    if (benchmarkMatches)
+	matchBenchmark (priv->matchIndex);
 
-    watchFdHandle = addWatchFd (ConnectionNumber (priv->dpy), POLLIN, NULL);
+    if (benchmarkOptions)
+	optionBenchmark ();
 
     for (;;)
     {
@@ -133,44 +159,25 @@ CompScreen::eventLoop ()
 	    break;
 
 	priv->processEvents ();
+	priv->handleTimers ();
+	priv->flushClientList ();
 
-	if (!priv->timers.empty ())
-	{
-	    gettimeofday (&tv, 0);
-	    priv->handleTimers (&tv);
-
-	    if (priv->timers.front ()->mMinLeft > 0)
-	    {
-		std::list<CompTimer *>::iterator it = priv->timers.begin ();
-
-		t = (*it);
-		time = t->mMaxLeft;
-		while (it != priv->timers.end ())
-		{
-		    t = (*it);
-		    if (t->mMinLeft >= time)
-			break;
-		    if (t->mMaxLeft < time)
-			time = t->mMaxLeft;
-		    it++;
-		}
-
-		if (time < 5)
-		    usleep (time * 1000);
-		else
-		    priv->doPoll (time);
+	/* timer callbacks may have made XCB read events off the
+	   connection, those would never wake up epoll_wait */
+	if (priv->eventsPending ())
+	    continue;
 
-		gettimeofday (&tv, 0);
-		priv->handleTimers (&tv);
-	    }
-	}
-	else
-	{
-	    priv->doPoll (-1);
-	}
+	priv->updateTimerFd ();
+	priv->doPoll (-1);
     }
 
     removeWatchFd (watchFdHandle);
+
+    if (priv->eventReader)
+    {
+	delete priv->eventReader;
+	priv->eventReader = NULL;
+    }
 }
 
 CompFileWatchHandle
@@ -227,36 +234,13 @@ CompScreen::getFileWatches () const
 void
 PrivateScreen::addTimer (CompTimer *timer)
 {
-    std::list<CompTimer *>::iterator it;
-
-    it = std::find (timers.begin (), timers.end (), timer);
-
-    if (it != timers.end ())
-	return;
-
-    for (it = timers.begin (); it != timers.end (); it++)
-    {
-	if ((int) timer->mMinTime < (*it)->mMinLeft)
-	    break;
-    }
-
-    timer->mMinLeft = timer->mMinTime;
-    timer->mMaxLeft = timer->mMaxTime;
-
-    timers.insert (it, timer);
+    timers.insert (timer, TimerQueue::now ());
 }
 
 void
 PrivateScreen::removeTimer (CompTimer *timer)
 {
-    std::list<CompTimer *>::iterator it;
-
-    it = std::find (timers.begin (), timers.end (), timer);
-
-    if (it == timers.end ())
-	return;
-
-    timers.erase (it);
+    timers.remove (timer);
 }
 
 CompWatchFdHandle
@@ -264,7 +248,8 @@ CompScreen::addWatchFd (int             fd,
 			short int       events,
 			FdWatchCallBack callBack)
 {
-    CompWatchFd *watchFd = new CompWatchFd ();
+    struct epoll_event event;
+    CompWatchFd        *watchFd = new CompWatchFd ();
 
     if (!watchFd)
 	return 0;
@@ -276,15 +261,20 @@ CompScreen::addWatchFd (int             fd,
     if (priv->lastWatchFdHandle == MAXSHORT)
 	priv->lastWatchFdHandle = 1;
 
-    priv->watchFds.push_front (watchFd);
-
-    priv->nWatchFds++;
+    /* poll and epoll event bits are the same on linux */
+    event.events   = events;
+    event.data.u64 = watchFd->handle;
 
-    priv->watchPollFds = (struct pollfd *) realloc (priv->watchPollFds,
-			  priv->nWatchFds * sizeof (struct pollfd));
+    if (epoll_ctl (priv->epollFd, EPOLL_CTL_ADD, fd, &event) < 0)
+    {
+	compLogMessage ("core", CompLogLevelWarn,
+			"Couldn't watch file descriptor %d: %s",
+			fd, strerror (errno));
+	delete watchFd;
+	return 0;
+    }
 
-    priv->watchPollFds[priv->nWatchFds - 1].fd     = fd;
-    priv->watchPollFds[priv->nWatchFds - 1].events = events;
+    priv->watchFds.push_front (watchFd);
 
     return watchFd->handle;
 }
@@ -294,10 +284,8 @@ CompScreen::removeWatchFd (CompWatchFdHandle handle)
 {
     std::list<CompWatchFd *>::iterator it;
     CompWatchFd                        *w;
-    int                                i;
 
-    for (it = priv->watchFds.begin(), i = priv->nWatchFds - 1;
-	 it != priv->watchFds.end (); it++, i--)
+    for (it = priv->watchFds.begin(); it != priv->watchFds.end (); it++)
     {
 	if ((*it)->handle == handle)
 	    break;
@@ -309,11 +297,7 @@ CompScreen::removeWatchFd (CompWatchFdHandle handle)
     w = (*it);
     priv->watchFds.erase (it);
 
-    priv->nWatchFds--;
-
-    if (i < priv->nWatchFds)
-	memmove (&priv->watchPollFds[i], &priv->watchPollFds[i + 1],
-		 (priv->nWatchFds - i) * sizeof (struct pollfd));
+    epoll_ctl (priv->epollFd, EPOLL_CTL_DEL, w->fd, NULL);
 
     delete w;
 }
@@ -375,62 +359,206 @@ CompScreen::eraseValue (CompString key)
 int
 PrivateScreen::doPoll (int timeout)
 {
-    int rv;
+    struct epoll_event events[MAX_POLL_EVENTS];
+    int                rv, i;
+
+    rv = epoll_wait (epollFd, events, MAX_POLL_EVENTS, timeout);
 
-    rv = poll (watchPollFds, nWatchFds, timeout);
-    if (rv)
+    for (i = 0; i < rv; i++)
     {
 	std::list<CompWatchFd *>::iterator it;
-	int                                i;
+	CompWatchFdHandle                  handle = events[i].data.u64;
 
-	for (it = watchFds.begin (), i = nWatchFds - 1; it != watchFds.end ();
-	    it++, i--)
+	if (handle == TIMER_FD_HANDLE)
 	{
-	    if (watchPollFds[i].revents != 0 && (*it)->callBack)
-		(*it)->callBack (watchPollFds[i].revents);
+	    uint64_t expirations;
+
+	    /* only drain it, handleTimers checks the clock itself */
+	    while (read (timerFd, &expirations, sizeof (expirations)) > 0);
+
+	    continue;
 	}
+
+	/* look the watch up by handle, an earlier callback might have
+	   removed it */
+	for (it = watchFds.begin (); it != watchFds.end (); it++)
+	    if ((*it)->handle == handle)
+		break;
+
+	if (it != watchFds.end () && (*it)->callBack)
+	    (*it)->callBack (events[i].events);
     }
 
     return rv;
 }
 
 void
-PrivateScreen::handleTimers (struct timeval *tv)
+PrivateScreen::updateTimerFd ()
 {
-    CompTimer                        *t;
-    int		                     timeDiff;
-    std::list<CompTimer *>::iterator it;
+    struct itimerspec value;
+    TimerQueue::Time  deadline = 0;
 
-    timeDiff = TIMEVALDIFF (tv, &lastTimeout);
+    /* Waking up at the earliest maximum deadline and then firing every
+       timer whose minimum deadline has passed is the greedy interval
+       stabbing solution, so all timers whose windows overlap that point
+       share one wakeup and none of them fires outside of its window. */
+    if (!timers.empty ())
+	deadline = timers.maxDeadline ();
+
+    if (deadline == timerFdDeadline)
+	return;
 
-    /* handle clock rollback */
-    if (timeDiff < 0)
-	timeDiff = 0;
+    memset (&value, 0, sizeof (value));
 
-    for (it = timers.begin (); it != timers.end (); it++)
+    /* an absolute expiration in the past fires right away, a zero
+       one disarms the timer */
+    if (deadline)
     {
-	t = (*it);
-	t->mMinLeft -= timeDiff;
-	t->mMaxLeft -= timeDiff;
+	value.it_value.tv_sec  = deadline / 1000;
+	value.it_value.tv_nsec = (deadline % 1000) * 1000000;
     }
 
-    while (timers.begin () != timers.end () &&
-	   timers.front ()->mMinLeft <= 0)
+    timerfd_settime (timerFd, TFD_TIMER_ABSTIME, &value, NULL);
+    timerFdDeadline = deadline;
+}
+
+void
+PrivateScreen::handleTimers ()
+{
+    TimerQueue::Time now = TimerQueue::now ();
+    CompTimer        *t;
+    unsigned int     expired = 0;
+
+    while (!timers.empty () && timers.minDeadline () <= now)
     {
-	t = timers.front ();
-	timers.pop_front ();
+	t = timers.top ();
+	timers.remove (t);
+
+	expired++;
 
 	t->mActive = false;
 	if (t->mCallBack ())
 	{
-	    addTimer (t);
+	    /* re-arm relative to this wakeup rather than to the time the
+	       callback returned, so timers that expired together stay in
+	       phase and keep sharing wakeups */
+	    if (!timers.contains (t))
+		timers.insert (t, now);
 	    t->mActive = true;
 	}
     }
 
-    lastTimeout = *tv;
+    if (expired)
+    {
+	timerStats.wakeups++;
+	timerStats.expirations += expired;
+    }
+}
+
+static const char *
+eventTypeName (int type)
+{
+    static const char *names[LASTEvent] = {
+	"", "", "KeyPress", "KeyRelease", "ButtonPress", "ButtonRelease",
+	"MotionNotify", "EnterNotify", "LeaveNotify", "FocusIn", "FocusOut",
+	"KeymapNotify", "Expose", "GraphicsExpose", "NoExpose",
+	"VisibilityNotify", "CreateNotify", "DestroyNotify", "UnmapNotify",
+	"MapNotify", "MapRequest", "ReparentNotify", "ConfigureNotify",
+	"ConfigureRequest", "GravityNotify", "ResizeRequest",
+	"CirculateNotify", "CirculateRequest", "PropertyNotify",
+	"SelectionClear", "SelectionRequest", "SelectionNotify",
+	"ColormapNotify", "ClientMessage", "MappingNotify", "GenericEvent"
+    };
+
+    if (type < 0 || type >= LASTEvent)
+	return "Unknown";
+
+    return names[type];
 }
 
+bool
+PrivateScreen::handleStatsTimeout ()
+{
+    TimerQueue::Time now = TimerQueue::now ();
+    float            seconds = (now - timerStats.start) / 1000.0f;
+    CompString       coalesced;
+    unsigned int     reads;
+    unsigned int     i;
+    MatchStats       matchStats;
+    ValueStats       valueStats;
+    RegionStats      regionStats;
+
+    if (seconds <= 0.0f)
+	return true;
+
+    matchStats = getMatchStats (true);
+    valueStats = getValueStats (true);
+    regionStats = getRegionStats (true);
+
+    timerStats.savedPerSecond =
+	(timerStats.expirations - timerStats.wakeups) / seconds;
+
+    compLogMessage ("core", CompLogLevelDebug,
+		    "%u timer expirations in %u wakeups, "
+		    "%.1f wakeups/s saved by coalescing",
+		    timerStats.expirations, timerStats.wakeups,
+		    timerStats.savedPerSecond);
+
+    timerStats.start       = now;
+    timerStats.wakeups     = 0;
+    timerStats.expirations = 0;
+
+    for (i = 0; i < LASTEvent; i++)
+    {
+	if (!eventStats.coalesced[i])
+	    continue;
+
+	coalesced += compPrintf (" %s:%u", eventTypeName (i),
+				 eventStats.coalesced[i]);
+    }
+
+    compLogMessage ("core", CompLogLevelDebug,
+		    "%u events read, %u dispatched, merged:%s",
+		    eventStats.read, eventStats.dispatched,
+		    coalesced.empty () ? " none" : coalesced.c_str ());
+
+    if (eventReader)
+	compLogMessage ("core", CompLogLevelDebug,
+			"event reader queue depth %u, oldest event %lld ms",
+			eventStats.maxQueueDepth, eventStats.maxEventAge);
+
+    eventStats = CompEventStats ();
+
+    reads = propertyStats.hits + propertyStats.prefetched +
+	    propertyStats.roundTrips;
+
+    compLogMessage ("core", CompLogLevelDebug,
+		    "%u property reads, %.1f%% cache hits, "
+		    "%u round trips saved, %u prefetched",
+		    reads, reads ? 100.0f * propertyStats.hits / reads : 0.0f,
+		    propertyStats.hits, propertyStats.prefetched);
+
+    propertyStats = CompPropertyStats ();
+
+    compLogMessage ("core", CompLogLevelDebug,
+		    "%u regions allocated, %u box arrays on the heap, "
+		    "%u copies shared, %u copied on write",
+		    regionStats.allocations, regionStats.heapArrays,
+		    regionStats.shared, regionStats.detached);
+
+    compLogMessage ("core", CompLogLevelDebug,
+		    "%u match evaluations, %.1f%% answered from cache",
+		    matchStats.evaluations,
+		    matchStats.evaluations ?
+		    100.0f * matchStats.cached / matchStats.evaluations : 0.0f);
+
+    compLogMessage ("core", CompLogLevelDebug,
+		    "%u values allocated, %u reused, "
+		    "%u strings, matches, actions or lists stored",
+		    valueStats.allocated, valueStats.reused, valueStats.stored);
+
+    return true;
+}
 
 void
 CompScreen::fileWatchAdded (CompFileWatch *watch)
@@ -448,6 +576,9 @@ CompScreen::setOptionForPlugin (const char        *plugin,
     WRAPABLE_HND_FUNC_RETURN (4, bool, setOptionForPlugin,
 			      plugin, name, value)
 
+    /* the option may hold different matches afterwards */
+    priv->matchIndex.invalidate ();
+
     CompPlugin *p = CompPlugin::find (plugin);
     if (p)
 	return p->vTable->setOption (name, value);
@@ -538,6 +669,11 @@ CompScreen::checkForError (Display *dpy)
 
     XSync (dpy, false);
 
+    /* Xlib doesn't see the errors anymore, they are queued with the
+       events until we handle them */
+    if (screen && screen->priv->dpy == dpy)
+	screen->priv->handleQueuedErrors ();
+
     e = errors;
     errors = 0;
 
@@ -731,59 +867,596 @@ PrivateScreen::setOption (const CompString  &name,
     return rv;
 }
 
+/* Window an event is about, for the structure events that is the
+   window that changed rather than the one that was notified. */
+static Window
+eventWindow (xcb_generic_event_t *event)
+{
+    switch (event->response_type & ~0x80) {
+    case XCB_KEY_PRESS:
+    case XCB_KEY_RELEASE:
+    case XCB_BUTTON_PRESS:
+    case XCB_BUTTON_RELEASE:
+    case XCB_MOTION_NOTIFY:
+    case XCB_ENTER_NOTIFY:
+    case XCB_LEAVE_NOTIFY:
+	return ((xcb_motion_notify_event_t *) event)->event;
+    case XCB_FOCUS_IN:
+    case XCB_FOCUS_OUT:
+	return ((xcb_focus_in_event_t *) event)->event;
+    case XCB_EXPOSE:
+	return ((xcb_expose_event_t *) event)->window;
+    case XCB_VISIBILITY_NOTIFY:
+	return ((xcb_visibility_notify_event_t *) event)->window;
+    case XCB_CREATE_NOTIFY:
+	return ((xcb_create_notify_event_t *) event)->window;
+    case XCB_DESTROY_NOTIFY:
+	return ((xcb_destroy_notify_event_t *) event)->window;
+    case XCB_UNMAP_NOTIFY:
+	return ((xcb_unmap_notify_event_t *) event)->window;
+    case XCB_MAP_NOTIFY:
+	return ((xcb_map_notify_event_t *) event)->window;
+    case XCB_MAP_REQUEST:
+	return ((xcb_map_request_event_t *) event)->window;
+    case XCB_REPARENT_NOTIFY:
+	return ((xcb_reparent_notify_event_t *) event)->window;
+    case XCB_CONFIGURE_NOTIFY:
+	return ((xcb_configure_notify_event_t *) event)->window;
+    case XCB_CONFIGURE_REQUEST:
+	return ((xcb_configure_request_event_t *) event)->window;
+    case XCB_GRAVITY_NOTIFY:
+	return ((xcb_gravity_notify_event_t *) event)->window;
+    case XCB_RESIZE_REQUEST:
+	return ((xcb_resize_request_event_t *) event)->window;
+    case XCB_CIRCULATE_NOTIFY:
+    case XCB_CIRCULATE_REQUEST:
+	return ((xcb_circulate_notify_event_t *) event)->window;
+    case XCB_PROPERTY_NOTIFY:
+	return ((xcb_property_notify_event_t *) event)->window;
+    case XCB_SELECTION_CLEAR:
+	return ((xcb_selection_clear_event_t *) event)->owner;
+    case XCB_SELECTION_REQUEST:
+	return ((xcb_selection_request_event_t *) event)->owner;
+    case XCB_SELECTION_NOTIFY:
+	return ((xcb_selection_notify_event_t *) event)->requestor;
+    case XCB_COLORMAP_NOTIFY:
+	return ((xcb_colormap_notify_event_t *) event)->window;
+    case XCB_CLIENT_MESSAGE:
+	return ((xcb_client_message_event_t *) event)->window;
+    default:
+	break;
+    }
+
+    return None;
+}
+
 void
 PrivateScreen::processEvents ()
 {
-    XEvent event;
-
     /* remove destroyed windows */
     removeDestroyed ();
 
     if (dirtyPluginList)
 	updatePlugins ();
 
-    while (XPending (dpy))
+    while (eventsPending ())
     {
-	XNextEvent (dpy, &event);
+	readEventBatch ();
 
-	switch (event.type) {
-	case ButtonPress:
-	case ButtonRelease:
-	    pointerX = event.xbutton.x_root;
-	    pointerY = event.xbutton.y_root;
-	    break;
-	case KeyPress:
-	case KeyRelease:
-	    pointerX = event.xkey.x_root;
-	    pointerY = event.xkey.y_root;
-	    break;
-	case MotionNotify:
-	    pointerX = event.xmotion.x_root;
-	    pointerY = event.xmotion.y_root;
+	while (eventBatchPos < eventBatch.size ())
+	{
+	    xcb_generic_event_t *event = eventBatch[eventBatchPos++];
+
+	    dispatchEvent (event);
+	    free (event);
+	}
+
+	eventBatch.clear ();
+	eventBatchPos = 0;
+
+	flushClientList ();
+    }
+}
+
+/* Moves everything XCB has read so far, and with fromSocket whatever
+   the socket has ready, into our own queue without blocking. */
+bool
+PrivateScreen::readEvents (bool fromSocket)
+{
+    xcb_generic_event_t *event;
+
+    if (eventReader)
+    {
+	eventReader->clearReady ();
+
+	readReaderEvents ();
+
+	/* events XCB queued while we waited for a reply never made it to
+	   the reader thread, the lock keeps it from taking newer ones off
+	   the connection while we pick those up */
+	eventReader->lock ();
+
+	readReaderEvents ();
+
+	while ((event = xcb_poll_for_queued_event (connection)))
+	    xcbEvents.push_back (event);
+
+	eventReader->unlock ();
+
+	return !xcbEvents.empty ();
+    }
+
+    if (fromSocket && (event = xcb_poll_for_event (connection)))
+	xcbEvents.push_back (event);
+
+    while ((event = xcb_poll_for_queued_event (connection)))
+	xcbEvents.push_back (event);
+
+    return !xcbEvents.empty ();
+}
+
+void
+PrivateScreen::readReaderEvents ()
+{
+    EventReader::Entry entry;
+    TimerQueue::Time   now = TimerQueue::now ();
+    unsigned int       depth = eventReader->depth ();
+
+    if (depth > eventStats.maxQueueDepth)
+	eventStats.maxQueueDepth = depth;
+
+    while (eventReader->pop (entry))
+    {
+	if (now - entry.received > eventStats.maxEventAge)
+	    eventStats.maxEventAge = now - entry.received;
+
+	xcbEvents.push_back (entry.event);
+    }
+}
+
+bool
+PrivateScreen::eventsPending ()
+{
+    /* XFlush writes out Xlib's request buffer as well as XCB's */
+    XFlush (dpy);
+
+    return readEvents (true);
+}
+
+xcb_generic_event_t *
+PrivateScreen::waitForWindowEvent (Window  id,
+				   uint8_t type)
+{
+    std::deque<xcb_generic_event_t *>::iterator it;
+    xcb_generic_event_t                         *event;
+
+    XFlush (dpy);
+
+    for (;;)
+    {
+	for (it = xcbEvents.begin (); it != xcbEvents.end (); it++)
+	{
+	    if (((*it)->response_type & ~0x80) == type &&
+		eventWindow (*it) == id)
+	    {
+		event = *it;
+		xcbEvents.erase (it);
+
+		return event;
+	    }
+	}
+
+	if (eventReader)
+	{
+	    struct pollfd pfd;
+
+	    pfd.fd     = eventReader->fd ();
+	    pfd.events = POLLIN;
+
+	    if (xcb_connection_has_error (connection))
+		return NULL;
+
+	    poll (&pfd, 1, -1);
+	}
+	else
+	{
+	    event = xcb_wait_for_event (connection);
+	    if (!event)
+		return NULL;
+
+	    xcbEvents.push_back (event);
+	}
+
+	readEvents (false);
+    }
+}
+
+bool
+PrivateScreen::hasPendingWindowEvent (Window  id,
+				      uint8_t type)
+{
+    std::deque<xcb_generic_event_t *>::iterator it;
+
+    readEvents (false);
+
+    for (it = xcbEvents.begin (); it != xcbEvents.end (); it++)
+	if (((*it)->response_type & ~0x80) == type && eventWindow (*it) == id)
+	    return true;
+
+    for (unsigned int i = eventBatchPos; i < eventBatch.size (); i++)
+	if ((eventBatch[i]->response_type & ~0x80) == type &&
+	    eventWindow (eventBatch[i]) == id)
+	    return true;
+
+    return false;
+}
+
+/* Errors for requests Xlib never waited on arrive in the event stream
+   now that XCB owns it, hand them to whatever Xlib error handler is
+   installed. checkForError takes them out of the stream early, see
+   handleQueuedErrors. */
+void
+PrivateScreen::handleError (xcb_generic_error_t *error)
+{
+    XErrorEvent  xerror;
+    XErrorHandler handler;
+
+    handler = XSetErrorHandler (NULL);
+    XSetErrorHandler (handler);
+
+    if (!handler)
+	return;
+
+    xerror.type         = 0;
+    xerror.display      = dpy;
+    xerror.resourceid   = error->resource_id;
+    xerror.serial       = error->full_sequence;
+    xerror.error_code   = error->error_code;
+    xerror.request_code = error->major_code;
+    xerror.minor_code   = error->minor_code;
+
+    handler (dpy, &xerror);
+}
+
+/* Converts a wire event to an XEvent using the same converter Xlib
+   would have used, including those registered by extensions. Returns
+   false for events the converter rejects, those aren't dispatched. */
+bool
+PrivateScreen::convertEvent (xcb_generic_event_t *event,
+			     XEvent              *xevent)
+{
+    int             type = event->response_type & ~0x80;
+    WireToEventProc proc;
+
+    memset (xevent, 0, sizeof (XEvent));
+
+    /* looking the converter up takes the display lock twice, the ones
+       of extensions are registered before their events can arrive */
+    proc = wireToEventProcs[type];
+    if (!proc)
+    {
+	proc = XESetWireToEvent (dpy, type, NULL);
+	XESetWireToEvent (dpy, type, proc);
+
+	wireToEventProcs[type] = proc;
+    }
+
+    if (!proc)
+    {
+	xevent->type = type;
+	xevent->xany.display = dpy;
+	xevent->xany.serial  = event->full_sequence;
+
+	return true;
+    }
+
+    if (!proc (dpy, xevent, (xEvent *) event))
+	return false;
+
+    /* XCB already widened the sequence number */
+    xevent->xany.serial = event->full_sequence;
+
+    return true;
+}
+
+void
+PrivateScreen::dispatchEvent (xcb_generic_event_t *event)
+{
+    XEvent xevent;
+
+    if (!event->response_type)
+    {
+	handleError ((xcb_generic_error_t *) event);
+	return;
+    }
+
+    /* pointer tracking works on the wire events directly, everything
+       that reaches the handleEvent chain needs to be an XEvent */
+    switch (event->response_type & ~0x80) {
+    case XCB_BUTTON_PRESS:
+    case XCB_BUTTON_RELEASE:
+    case XCB_KEY_PRESS:
+    case XCB_KEY_RELEASE:
+    case XCB_MOTION_NOTIFY:
+    case XCB_ENTER_NOTIFY:
+    case XCB_LEAVE_NOTIFY:
+	{
+	    /* all of these share the layout of the motion event */
+	    xcb_motion_notify_event_t *motion =
+		(xcb_motion_notify_event_t *) event;
+
+	    pointerX = motion->root_x;
+	    pointerY = motion->root_y;
+	}
+	break;
+    case XCB_CLIENT_MESSAGE:
+	{
+	    xcb_client_message_event_t *message =
+		(xcb_client_message_event_t *) event;
+
+	    if (message->type == Atoms::xdndPosition)
+	    {
+		pointerX = message->data.data32[2] >> 16;
+		pointerY = message->data.data32[2] & 0xffff;
+	    }
+	}
+	break;
+    case XCB_PROPERTY_NOTIFY:
+	{
+	    xcb_property_notify_event_t *notify =
+		(xcb_property_notify_event_t *) event;
+
+	    invalidateProperty (notify->window, notify->atom);
+	}
+	break;
+    default:
+	break;
+    }
+
+    if (!convertEvent (event, &xevent))
+	return;
+
+    sn_display_process_event (snDisplay, &xevent);
+
+    inHandleEvent = true;
+    screen->handleEvent (&xevent);
+    inHandleEvent = false;
+
+    lastPointerX = pointerX;
+    lastPointerY = pointerY;
+
+    eventStats.dispatched++;
+}
+
+/*
+ * Takes everything read so far off the queue and drops events that a
+ * later event in the same batch makes redundant. This works on the wire
+ * events, so merged events are never converted to XEvents at all:
+ *
+ * - MotionNotify followed by another MotionNotify for the same window
+ *   and modifier state, with no button, key or crossing event between.
+ * - ConfigureNotify followed by another ConfigureNotify for the same
+ *   window with the same sibling, with no other event about that window
+ *   and no ConfigureNotify stacking a window relative to it between.
+ *   Only geometry is merged this way, restacks are always kept.
+ * - PropertyNotify for the same window, atom and state as a later one.
+ *   The last one is kept, so after a deletion followed by a new value
+ *   handlers see the new value last, and reading the property returns
+ *   the newest value anyway.
+ */
+void
+PrivateScreen::readEventBatch ()
+{
+    typedef std::map<Window, unsigned int>          PendingMap;
+    typedef std::pair<std::pair<Window, Atom>, int> PropertyKey;
+
+    std::vector<bool>     drop;
+    PendingMap            motion;
+    PendingMap            configure;
+    std::set<PropertyKey> properties;
+    PendingMap::iterator  it;
+    int                   n, i;
+
+    eventBatch.assign (xcbEvents.begin (), xcbEvents.end ());
+    eventBatchPos = 0;
+    xcbEvents.clear ();
+
+    n = eventBatch.size ();
+
+    eventStats.read += n;
+
+    if (!coalesceEvents)
+	return;
+
+    drop.resize (n, false);
+
+    /* motion and geometry are superseded by later events, so walk the
+       batch backwards remembering the last kept event per window */
+    for (i = n - 1; i >= 0; i--)
+    {
+	xcb_generic_event_t *event = eventBatch[i];
+
+	switch (event->response_type & ~0x80) {
+	case XCB_MOTION_NOTIFY:
+	    {
+		xcb_motion_notify_event_t *m =
+		    (xcb_motion_notify_event_t *) event;
+
+		it = motion.find (m->event);
+		if (it != motion.end () &&
+		    ((xcb_motion_notify_event_t *)
+		     eventBatch[it->second])->state == m->state)
+		    drop[i] = true;
+		else
+		    motion[m->event] = i;
+	    }
 	    break;
-	case EnterNotify:
-	case LeaveNotify:
-	    pointerX = event.xcrossing.x_root;
-	    pointerY = event.xcrossing.y_root;
+	case XCB_BUTTON_PRESS:
+	case XCB_BUTTON_RELEASE:
+	case XCB_KEY_PRESS:
+	case XCB_KEY_RELEASE:
+	case XCB_ENTER_NOTIFY:
+	case XCB_LEAVE_NOTIFY:
+	    motion.clear ();
+	    configure.erase (eventWindow (event));
 	    break;
-	case ClientMessage:
-	    if (event.xclient.message_type == Atoms::xdndPosition)
+	case XCB_CONFIGURE_NOTIFY:
 	    {
-		pointerX = event.xclient.data.l[2] >> 16;
-		pointerY = event.xclient.data.l[2] & 0xffff;
+		xcb_configure_notify_event_t *c =
+		    (xcb_configure_notify_event_t *) event;
+		xcb_configure_notify_event_t *later;
+
+		configure.erase (c->above_sibling);
+
+		it = configure.find (c->window);
+		if (it != configure.end ())
+		{
+		    later = (xcb_configure_notify_event_t *)
+			eventBatch[it->second];
+
+		    if (later->event == c->event &&
+			later->above_sibling == c->above_sibling)
+		    {
+			drop[i] = true;
+			break;
+		    }
+		}
+
+		configure[c->window] = i;
 	    }
+	    break;
+	case XCB_CLIENT_MESSAGE:
+	    if (((xcb_client_message_event_t *) event)->type ==
+		Atoms::xdndPosition)
+		motion.clear ();
+	    /* fall-through */
 	default:
+	    configure.erase (eventWindow (event));
 	    break;
-        }
+	}
+    }
+
+    for (i = n - 1; i >= 0; i--)
+    {
+	xcb_property_notify_event_t *p;
 
-	sn_display_process_event (snDisplay, &event);
+	if ((eventBatch[i]->response_type & ~0x80) != XCB_PROPERTY_NOTIFY)
+	    continue;
 
-	inHandleEvent = true;
-	screen->handleEvent (&event);
-	inHandleEvent = false;
+	p = (xcb_property_notify_event_t *) eventBatch[i];
 
-	lastPointerX = pointerX;
-	lastPointerY = pointerY;
+	PropertyKey key (std::make_pair (p->window, p->atom), p->state);
+
+	if (!properties.insert (key).second)
+	    drop[i] = true;
+    }
+
+    /* compact the batch, keeping the original order */
+    for (i = 0, n = 0; i < (int) eventBatch.size (); i++)
+    {
+	if (drop[i])
+	{
+	    eventStats.coalesced[eventBatch[i]->response_type & ~0x80]++;
+	    free (eventBatch[i]);
+	    continue;
+	}
+
+	eventBatch[n++] = eventBatch[i];
+    }
+
+    eventBatch.resize (n);
+}
+
+static bool
+isPointerEvent (xcb_generic_event_t *event)
+{
+    switch (event->response_type & ~0x80) {
+    case XCB_MOTION_NOTIFY:
+    case XCB_ENTER_NOTIFY:
+    case XCB_LEAVE_NOTIFY:
+	return true;
+    default:
+	break;
+    }
+
+    return false;
+}
+
+void
+PrivateScreen::discardPointerEvents ()
+{
+    std::deque<xcb_generic_event_t *>::iterator  qit;
+    std::vector<xcb_generic_event_t *>::iterator bit;
+
+    readEvents (false);
+
+    for (qit = xcbEvents.begin (); qit != xcbEvents.end ();)
+    {
+	if (isPointerEvent (*qit))
+	{
+	    free (*qit);
+	    qit = xcbEvents.erase (qit);
+	}
+	else
+	{
+	    qit++;
+	}
+    }
+
+    for (bit = eventBatch.begin () + eventBatchPos; bit != eventBatch.end ();)
+    {
+	if (isPointerEvent (*bit))
+	{
+	    free (*bit);
+	    bit = eventBatch.erase (bit);
+	}
+	else
+	{
+	    bit++;
+	}
+    }
+}
+
+/* XSync only waits for the reply, the errors the server sent before it
+   are left queued with the events. Handles those right away so they
+   are counted for the requests that caused them, events stay queued. */
+void
+PrivateScreen::handleQueuedErrors ()
+{
+    std::deque<xcb_generic_event_t *>::iterator  qit;
+    std::vector<xcb_generic_event_t *>::iterator bit;
+
+    if (!connection)
+	return;
+
+    readEvents (false);
+
+    for (bit = eventBatch.begin () + eventBatchPos; bit != eventBatch.end ();)
+    {
+	if (!(*bit)->response_type)
+	{
+	    handleError ((xcb_generic_error_t *) *bit);
+	    free (*bit);
+	    bit = eventBatch.erase (bit);
+	}
+	else
+	{
+	    bit++;
+	}
+    }
+
+    for (qit = xcbEvents.begin (); qit != xcbEvents.end ();)
+    {
+	if (!(*qit)->response_type)
+	{
+	    handleError ((xcb_generic_error_t *) *qit);
+	    free (*qit);
+	    qit = xcbEvents.erase (qit);
+	}
+	else
+	{
+	    qit++;
+	}
     }
 }
 
@@ -871,7 +1544,59 @@ PrivateScreen::updatePlugins ()
 	CompPlugin::unload (pp);
 
     if (!priv->dirtyPluginList)
+    {
+	/* the plugin list settled, nothing else is going to be read */
+	pluginPreloader.finish ();
+
+	if (!startupPhases.empty ())
+	{
+	    startupPhase ("plugins");
+	    reportStartup ();
+	}
+
 	screen->setOptionForPlugin ("core", "active_plugins", plugin);
+    }
+
+    pluginRegistry.save ();
+}
+
+void
+PrivateScreen::startupPhase (const char *name)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+
+    startupPhases.push_back (std::make_pair (name, (long long) ts.tv_sec *
+					     1000000LL + ts.tv_nsec / 1000));
+}
+
+/* Logs how long startup took in total and in each phase, from the
+   construction of the screen until the first plugin list was loaded. */
+void
+PrivateScreen::reportStartup ()
+{
+    CompString phases;
+    long long  total;
+
+    for (unsigned int i = 1; i < startupPhases.size (); i++)
+	phases += compPrintf ("%s %s %.1f", i > 1 ? "," : "",
+			      startupPhases[i].first,
+			      (startupPhases[i].second -
+			       startupPhases[i - 1].second) / 1000.0);
+
+    total = startupPhases.back ().second - startupPhases.front ().second;
+
+    compLogMessage ("core", CompLogLevelDebug,
+		    "startup took %.1f ms:%s ms",
+		    total / 1000.0, phases.c_str ());
+
+    compLogMessage ("core", CompLogLevelDebug,
+		    "%u plugin files read ahead, %u of them before they "
+		    "were opened",
+		    pluginPreloader.preloaded (), pluginPreloader.ready ());
+
+    startupPhases.clear ();
 }
 
 /* from fvwm2, Copyright Matthias Clasen, Dominik Vogt */
@@ -1163,27 +1888,363 @@ compLogMessage (const char   *componentName,
     va_end (args);
 }
 
-int
-PrivateScreen::getWmState (Window id)
+PropertyReply::PropertyReply () :
+    type (None),
+    format (0),
+    n (0),
+    reply ()
 {
-    Atom	  actual;
-    int		  result, format;
-    unsigned long n, left;
-    unsigned char *data;
-    unsigned long state = NormalState;
+}
 
-    result = XGetWindowProperty (priv->dpy, id,
-				 Atoms::wmState, 0L, 2L, false,
-				 Atoms::wmState, &actual, &format,
-				 &n, &left, &data);
+const void *
+PropertyReply::data () const
+{
+    if (!reply)
+	return NULL;
 
-    if (result == Success && data)
+    return xcb_get_property_value (reply.get ());
+}
+
+unsigned long
+PropertyReply::item (unsigned int i) const
+{
+    switch (format) {
+    case 8:
+	return ((const uint8_t *) data ())[i];
+    case 16:
+	return ((const uint16_t *) data ())[i];
+    case 32:
+	return ((const uint32_t *) data ())[i];
+    default:
+	break;
+    }
+
+    return 0;
+}
+
+char *
+PropertyReply::copyString () const
+{
+    if (format != 8 || !n)
+	return NULL;
+
+    return strndup ((const char *) data (), n);
+}
+
+/* The properties CompWindow::CompWindow reads from a new window,
+   requested in one go together with its attributes and geometry so
+   that reading them costs a single round trip. */
+static const Atom prefetchAtoms[] = {
+    XA_WM_CLASS,
+    XA_WM_NORMAL_HINTS,
+    XA_WM_HINTS,
+    XA_WM_TRANSIENT_FOR
+};
+
+void
+PrivateScreen::prefetchWindow (Window id)
+{
+    WindowPrefetch &prefetch = prefetches[id];
+    Atom           atoms[] = {
+	Atoms::winState,
+	Atoms::winType,
+	Atoms::wmProtocols,
+	Atoms::wmStrutPartial,
+	Atoms::wmStrut,
+	Atoms::wmClientLeader,
+	Atoms::startupId,
+	Atoms::mwmHints,
+	Atoms::winDesktop,
+	Atoms::wmState
+    };
+    unsigned int   i;
+
+    if (!prefetch.properties.empty ())
+	return;
+
+    prefetch.attributes = xcb_get_window_attributes (connection, id);
+    prefetch.geometry   = xcb_get_geometry (connection, id);
+
+    for (i = 0; i < sizeof (prefetchAtoms) / sizeof (prefetchAtoms[0]); i++)
+	prefetch.properties[prefetchAtoms[i]] =
+	    xcb_get_property (connection, false, id, prefetchAtoms[i],
+			      XCB_GET_PROPERTY_TYPE_ANY, 0,
+			      PREFETCH_PROPERTY_LENGTH);
+
+    for (i = 0; i < sizeof (atoms) / sizeof (atoms[0]); i++)
+	prefetch.properties[atoms[i]] =
+	    xcb_get_property (connection, false, id, atoms[i],
+			      XCB_GET_PROPERTY_TYPE_ANY, 0,
+			      PREFETCH_PROPERTY_LENGTH);
+}
+
+/* Creates CompWindows for the windows that exist at startup. The
+   attributes, geometry and properties of all of them are requested
+   before the first one is created, so reading those costs about one
+   round trip however many windows there are. Everything else, like
+   reparenting, still goes to the server once per window. */
+void
+PrivateScreen::adoptWindows (Window       *children,
+			     unsigned int nchildren)
+{
+    TimerQueue::Time start = TimerQueue::now ();
+    unsigned int     i;
+
+    for (i = 0; i < nchildren; i++)
     {
-	if (n)
-	    memcpy (&state, data, sizeof (unsigned long));
-	XFree ((void *) data);
+	XSelectInput (dpy, children[i],
+		      PropertyChangeMask |
+		      EnterWindowMask    |
+		      FocusChangeMask);
+
+	prefetchWindow (children[i]);
+    }
+
+    for (i = 0; i < nchildren; i++)
+	new CompWindow (children[i], i ? children[i - 1] : 0);
+
+    compLogMessage ("core", CompLogLevelDebug,
+		    "adopted %u windows in %lld ms",
+		    nchildren, TimerQueue::now () - start);
+}
+
+void
+PrivateScreen::finishPrefetch (Window id)
+{
+    std::map<Window, WindowPrefetch>::iterator it = prefetches.find (id);
+
+    if (it == prefetches.end ())
+	return;
+
+    if (it->second.attributes.sequence)
+	xcb_discard_reply (connection, it->second.attributes.sequence);
+    if (it->second.geometry.sequence)
+	xcb_discard_reply (connection, it->second.geometry.sequence);
+
+    foreach (WindowPrefetch::PropertyMap::value_type &p,
+	     it->second.properties)
+	xcb_discard_reply (connection, p.second.sequence);
+
+    prefetches.erase (it);
+}
+
+Visual *
+PrivateScreen::findVisual (VisualID id)
+{
+    Screen *s = ScreenOfDisplay (dpy, screenNum);
+    int    i, j;
+
+    for (i = 0; i < s->ndepths; i++)
+	for (j = 0; j < s->depths[i].nvisuals; j++)
+	    if (s->depths[i].visuals[j].visualid == id)
+		return &s->depths[i].visuals[j];
+
+    return NULL;
+}
+
+/* XGetWindowAttributes on top of the prefetched replies, if any */
+bool
+PrivateScreen::getWindowAttributes (Window            id,
+				    XWindowAttributes *attrib)
+{
+    xcb_get_window_attributes_cookie_t attributesCookie;
+    xcb_get_geometry_cookie_t          geometryCookie;
+    xcb_get_window_attributes_reply_t  *a;
+    xcb_get_geometry_reply_t           *g;
+
+    std::map<Window, WindowPrefetch>::iterator it = prefetches.find (id);
+
+    if (it != prefetches.end () && it->second.attributes.sequence)
+    {
+	attributesCookie = it->second.attributes;
+	geometryCookie   = it->second.geometry;
+
+	it->second.attributes.sequence = 0;
+	it->second.geometry.sequence   = 0;
+    }
+    else
+    {
+	attributesCookie = xcb_get_window_attributes (connection, id);
+	geometryCookie   = xcb_get_geometry (connection, id);
+    }
+
+    a = xcb_get_window_attributes_reply (connection, attributesCookie, NULL);
+    g = xcb_get_geometry_reply (connection, geometryCookie, NULL);
+
+    if (!a || !g)
+    {
+	if (a)
+	    free (a);
+	if (g)
+	    free (g);
+
+	return false;
     }
 
+    attrib->x                     = g->x;
+    attrib->y                     = g->y;
+    attrib->width                 = g->width;
+    attrib->height                = g->height;
+    attrib->border_width          = g->border_width;
+    attrib->depth                 = g->depth;
+    attrib->root                  = g->root;
+    attrib->visual                = findVisual (a->visual);
+    attrib->c_class               = a->_class;
+    attrib->bit_gravity           = a->bit_gravity;
+    attrib->win_gravity           = a->win_gravity;
+    attrib->backing_store         = a->backing_store;
+    attrib->backing_planes        = a->backing_planes;
+    attrib->backing_pixel         = a->backing_pixel;
+    attrib->save_under            = a->save_under;
+    attrib->colormap              = a->colormap;
+    attrib->map_installed         = a->map_is_installed;
+    attrib->map_state             = a->map_state;
+    attrib->all_event_masks       = a->all_event_masks;
+    attrib->your_event_mask       = a->your_event_mask;
+    attrib->do_not_propagate_mask = a->do_not_propagate_mask;
+    attrib->override_redirect     = a->override_redirect;
+    attrib->screen                = ScreenOfDisplay (dpy, screenNum);
+
+    free (a);
+    free (g);
+
+    return true;
+}
+
+/* Properties of windows we get PropertyNotify events for are cached
+   until the matching notification arrives. */
+void
+PrivateScreen::watchProperties (Window id)
+{
+    propertyCache[id];
+}
+
+void
+PrivateScreen::forgetProperties (Window id)
+{
+    propertyCache.erase (id);
+}
+
+void
+PrivateScreen::invalidateProperty (Window id,
+				   Atom   property)
+{
+    std::map<Window, PropertyCache>::iterator it = propertyCache.find (id);
+
+    if (it != propertyCache.end ())
+	it->second.erase (property);
+}
+
+/* Like XGetWindowProperty, length is in 32 bit units. The reply comes
+   from the property cache or the prefetched request if there is one.
+   Returns whether the property exists and is of the requested type. */
+bool
+PrivateScreen::getWindowProperty (Window        id,
+				  Atom          property,
+				  Atom          type,
+				  unsigned long length,
+				  PropertyReply &prop)
+{
+    boost::shared_ptr<xcb_get_property_reply_t> reply;
+    xcb_get_property_cookie_t                   cookie;
+    xcb_generic_error_t                         *error = NULL;
+    bool                                        prefetched = false;
+    unsigned long                               fetched = length;
+    unsigned long                               max;
+
+    std::map<Window, PropertyCache>::iterator cit = propertyCache.find (id);
+    std::map<Window, WindowPrefetch>::iterator it = prefetches.find (id);
+
+    if (cit != propertyCache.end ())
+    {
+	PropertyCache::iterator pit = cit->second.find (property);
+
+	/* a shorter read is good enough if it got everything */
+	if (pit != cit->second.end () &&
+	    (pit->second.length >= length || !pit->second.reply->bytes_after))
+	{
+	    reply = pit->second.reply;
+	    propertyStats.hits++;
+	}
+    }
+
+    if (!reply)
+    {
+	if (it != prefetches.end () && length <= PREFETCH_PROPERTY_LENGTH)
+	{
+	    WindowPrefetch::PropertyMap::iterator pit;
+
+	    pit = it->second.properties.find (property);
+	    if (pit != it->second.properties.end ())
+	    {
+		cookie  = pit->second;
+		fetched = PREFETCH_PROPERTY_LENGTH;
+		it->second.properties.erase (pit);
+		prefetched = true;
+	    }
+	}
+
+	if (!prefetched)
+	    cookie = xcb_get_property (connection, false, id, property,
+				       XCB_GET_PROPERTY_TYPE_ANY, 0, length);
+
+	reply.reset (xcb_get_property_reply (connection, cookie, &error),
+		     free);
+	if (error)
+	    free (error);
+
+	if (prefetched)
+	    propertyStats.prefetched++;
+	else
+	    propertyStats.roundTrips++;
+
+	if (!reply)
+	{
+	    prop = PropertyReply ();
+	    return false;
+	}
+
+	if (cit != propertyCache.end ())
+	{
+	    CachedProperty &cached = cit->second[property];
+
+	    cached.length = fetched;
+	    cached.reply  = reply;
+	}
+    }
+
+    prop = PropertyReply ();
+
+    prop.reply  = reply;
+    prop.type   = reply->type;
+    prop.format = reply->format;
+
+    if (reply->type == None ||
+	(type != AnyPropertyType && reply->type != type))
+	return false;
+
+    if (!prop.format)
+	return true;
+
+    prop.n = xcb_get_property_value_length (reply.get ()) / (prop.format / 8);
+
+    max = length * (32 / prop.format);
+    if (prop.n > max)
+	prop.n = max;
+
+    return true;
+}
+
+int
+PrivateScreen::getWmState (Window id)
+{
+    PropertyReply prop;
+    unsigned long state = NormalState;
+
+    if (getWindowProperty (id, Atoms::wmState, Atoms::wmState, 2L, prop) &&
+	prop.n)
+	state = prop.item (0);
+
     return state;
 }
 
@@ -1198,6 +2259,8 @@ PrivateScreen::setWmState (int state, Window id)
     XChangeProperty (priv->dpy, id,
 		     Atoms::wmState, Atoms::wmState,
 		     32, PropModeReplace, (unsigned char *) data, 2);
+
+    invalidateProperty (id, Atoms::wmState);
 }
 
 unsigned int
@@ -1267,25 +2330,14 @@ PrivateScreen::windowStateFromString (const char *str)
 unsigned int
 PrivateScreen::getWindowState (Window id)
 {
-    Atom	  actual;
-    int		  result, format;
-    unsigned long n, left;
-    unsigned char *data;
+    PropertyReply prop;
     unsigned int  state = 0;
+    unsigned int  i;
 
-    result = XGetWindowProperty (priv->dpy, id,
-				 Atoms::winState,
-				 0L, 1024L, false, XA_ATOM, &actual, &format,
-				 &n, &left, &data);
-
-    if (result == Success && data)
+    if (getWindowProperty (id, Atoms::winState, XA_ATOM, 1024L, prop))
     {
-	Atom *a = (Atom *) data;
-
-	while (n--)
-	    state |= windowStateMask (*a++);
-
-	XFree ((void *) data);
+	for (i = 0; i < prop.n; i++)
+	    state |= windowStateMask (prop.item (i));
     }
 
     return state;
@@ -1327,27 +2379,18 @@ PrivateScreen::setWindowState (unsigned int state, Window id)
     XChangeProperty (priv->dpy, id, Atoms::winState,
 		     XA_ATOM, 32, PropModeReplace,
 		     (unsigned char *) data, i);
+
+    invalidateProperty (id, Atoms::winState);
 }
 
 unsigned int
 PrivateScreen::getWindowType (Window id)
 {
-    Atom	  actual, a = None;
-    int		  result, format;
-    unsigned long n, left;
-    unsigned char *data;
-
-    result = XGetWindowProperty (priv->dpy , id,
-				 Atoms::winType,
-				 0L, 1L, false, XA_ATOM, &actual, &format,
-				 &n, &left, &data);
+    PropertyReply prop;
+    Atom          a = None;
 
-    if (result == Success && data)
-    {
-	if (n)
-	    memcpy (&a, data, sizeof (Atom));
-	XFree ((void *) data);
-    }
+    if (getWindowProperty (id, Atoms::winType, XA_ATOM, 1L, prop) && prop.n)
+	a = prop.item (0);
 
     if (a)
     {
@@ -1389,60 +2432,46 @@ PrivateScreen::getMwmHints (Window       id,
 			    unsigned int *func,
 			    unsigned int *decor)
 {
-    Atom	  actual;
-    int		  result, format;
-    unsigned long n, left;
-    unsigned char *data;
+    PropertyReply prop;
 
     *func  = MwmFuncAll;
     *decor = MwmDecorAll;
 
-    result = XGetWindowProperty (priv->dpy, id,
-				 Atoms::mwmHints,
-				 0L, 20L, false, Atoms::mwmHints,
-				 &actual, &format, &n, &left, &data);
-
-    if (result == Success && data)
+    if (getWindowProperty (id, Atoms::mwmHints, Atoms::mwmHints, 20L, prop) &&
+	prop.n >= PropMotifWmHintElements)
     {
-	MwmHints *mwmHints = (MwmHints *) data;
-
-	if (n >= PropMotifWmHintElements)
-	{
-	    if (mwmHints->flags & MwmHintsDecorations)
-		*decor = mwmHints->decorations;
+	unsigned long flags = prop.item (0);
 
-	    if (mwmHints->flags & MwmHintsFunctions)
-		*func = mwmHints->functions;
-	}
+	if (flags & MwmHintsDecorations)
+	    *decor = prop.item (2);
 
-	XFree (data);
+	if (flags & MwmHintsFunctions)
+	    *func = prop.item (1);
     }
 }
 
 unsigned int
 PrivateScreen::getProtocols (Window id)
 {
-    Atom         *protocol;
-    int          count;
-    unsigned int protocols = 0;
+    PropertyReply prop;
+    unsigned int  protocols = 0;
+    unsigned int  i;
 
-    if (XGetWMProtocols (priv->dpy, id, &protocol, &count))
+    if (getWindowProperty (id, Atoms::wmProtocols, XA_ATOM, 1024L, prop))
     {
-	int  i;
-
-	for (i = 0; i < count; i++)
+	for (i = 0; i < prop.n; i++)
 	{
-	    if (protocol[i] == Atoms::wmDeleteWindow)
+	    Atom protocol = prop.item (i);
+
+	    if (protocol == Atoms::wmDeleteWindow)
 		protocols |= CompWindowProtocolDeleteMask;
-	    else if (protocol[i] == Atoms::wmTakeFocus)
+	    else if (protocol == Atoms::wmTakeFocus)
 		protocols |= CompWindowProtocolTakeFocusMask;
-	    else if (protocol[i] == Atoms::wmPing)
+	    else if (protocol == Atoms::wmPing)
 		protocols |= CompWindowProtocolPingMask;
-	    else if (protocol[i] == Atoms::wmSyncRequest)
+	    else if (protocol == Atoms::wmSyncRequest)
 		protocols |= CompWindowProtocolSyncRequestMask;
 	}
-
-	XFree (protocol);
     }
 
     return protocols;
@@ -1453,29 +2482,13 @@ CompScreen::getWindowProp (Window       id,
 			   Atom         property,
 			   unsigned int defaultValue)
 {
-    Atom	  actual;
-    int		  result, format;
-    unsigned long n, left;
-    unsigned char *data;
-    unsigned int  retval = defaultValue;
-
-    result = XGetWindowProperty (priv->dpy, id, property,
-				 0L, 1L, false, XA_CARDINAL, &actual, &format,
-				 &n, &left, &data);
-
-    if (result == Success && data)
-    {
-	if (n)
-	{
-	    unsigned long value;
-	    memcpy (&value, data, sizeof (unsigned long));
-	    retval = (unsigned int) value;
-	}
+    PropertyReply prop;
 
-	XFree (data);
-    }
+    if (priv->getWindowProperty (id, property, XA_CARDINAL, 1L, prop) &&
+	prop.n)
+	return prop.item (0);
 
-    return retval;
+    return defaultValue;
 }
 
 void
@@ -1488,6 +2501,9 @@ CompScreen::setWindowProp (Window       id,
     XChangeProperty (priv->dpy, id, property,
 		     XA_CARDINAL, 32, PropModeReplace,
 		     (unsigned char *) &data, 1);
+
+    /* don't hand out the old value until the PropertyNotify arrives */
+    priv->invalidateProperty (id, property);
 }
 
 bool
@@ -1495,31 +2511,15 @@ PrivateScreen::readWindowProp32 (Window         id,
 				 Atom           property,
 				 unsigned short *returnValue)
 {
-    Atom	  actual;
-    int		  result, format;
-    unsigned long n, left;
-    unsigned char *data;
-    bool          retval = false;
-
-    result = XGetWindowProperty (priv->dpy, id, property,
-				 0L, 1L, false, XA_CARDINAL, &actual, &format,
-				 &n, &left, &data);
+    PropertyReply prop;
 
-    if (result == Success && data)
+    if (getWindowProperty (id, property, XA_CARDINAL, 1L, prop) && prop.n)
     {
-	if (n)
-	{
-	    CARD32 value;
-
-	    memcpy (&value, data, sizeof (CARD32));
-	    retval       = true;
-	    *returnValue = value >> 16;
-	}
-
-	XFree (data);
+	*returnValue = prop.item (0) >> 16;
+	return true;
     }
 
-    return retval;
+    return false;
 }
 
 unsigned short
@@ -1547,6 +2547,8 @@ CompScreen::setWindowProp32 (Window         id,
     XChangeProperty (priv->dpy, id, property,
 		     XA_CARDINAL, 32, PropModeReplace,
 		     (unsigned char *) &value32, 1);
+
+    priv->invalidateProperty (id, property);
 }
 
 void
@@ -1848,6 +2850,8 @@ PrivateScreen::updateOutputDevices ()
 	    if (outputDevs[i].intersects (outputDevs[j]))
 		hasOverlappingOutputs = true;
 
+    /* new outputs, every work area needs to be recomputed */
+    workareasMarked = false;
     screen->updateWorkarea ();
 
     screen->outputChangeNotify ();
@@ -2523,10 +3527,10 @@ CompScreen::findWindow (Window id)
     }
     else
     {
-        CompWindow::Map::iterator it = priv->windowsMap.find (id);
+	CompWindow *w = priv->clientIndex.find (id);
 
-        if (it != priv->windowsMap.end ())
-            return (lastFoundWindow = it->second);
+	if (w)
+	    return (lastFoundWindow = w);
     }
 
     return 0;
@@ -2539,6 +3543,9 @@ CompScreen::findTopLevelWindow (Window id, bool override_redirect)
 
     w = findWindow (id);
 
+    if (!w)
+	w = priv->frameIndex.find (id);
+
     if (w)
     {
 	if (w->overrideRedirect () && !override_redirect)
@@ -2547,15 +3554,6 @@ CompScreen::findTopLevelWindow (Window id, bool override_redirect)
 	    return w;
     }
 
-    foreach (CompWindow *w, priv->windows)
-	if (w->frame () == id)
-	{
-	    if (w->overrideRedirect () && !override_redirect)
-		return NULL;
-	    else
-		return w;
-	}
-
     return NULL;
 }
 
@@ -2573,25 +3571,22 @@ CompScreen::insertWindow (CompWindow *w, Window	aboveId)
 	    w->next = priv->windows.front ();
 	}
 	priv->windows.push_front (w);
+	w->priv->stackPos = priv->windows.begin ();
+	priv->setStackKey (w);
         if (w->id () != 1)
-            priv->windowsMap[w->id ()] = w;
+            priv->clientIndex.insert (w->id (), w);
+	if (w->frame ())
+	    priv->frameIndex.insert (w->frame (), w);
 
 	return;
     }
 
-    CompWindowList::iterator it = priv->windows.begin ();
+    CompWindow *above = priv->clientIndex.find (aboveId);
 
-    while (it != priv->windows.end ())
-    {
-	if ((*it)->id () == aboveId ||
-	    ((*it)->frame () && (*it)->frame () == aboveId))
-	{
-	    break;
-	}
-	it++;
-    }
+    if (!above)
+	above = priv->frameIndex.find (aboveId);
 
-    if (it == priv->windows.end ())
+    if (!above)
     {
 #ifdef DEBUG
 	abort ();
@@ -2599,35 +3594,116 @@ CompScreen::insertWindow (CompWindow *w, Window	aboveId)
 	return;
     }
 
-    w->next = (*it)->next;
-    w->prev = (*it);
-    (*it)->next = w;
+    w->next = above->next;
+    w->prev = above;
+    above->next = w;
 
     if (w->next)
     {
 	w->next->prev = w;
     }
 
-    priv->windows.insert (++it, w);
+    CompWindowList::iterator it = above->priv->stackPos;
+
+    w->priv->stackPos = priv->windows.insert (++it, w);
+    priv->setStackKey (w);
     if (w->id () != 1)
-        priv->windowsMap[w->id ()] = w;
+        priv->clientIndex.insert (w->id (), w);
+    if (w->frame ())
+	priv->frameIndex.insert (w->frame (), w);
 }
 
 void
 PrivateScreen::eraseWindowFromMap (Window id)
 {
     if (id != 1)
-        priv->windowsMap.erase (id);
+        priv->clientIndex.remove (id);
 }
 
+/* gives a freshly inserted window a key between the ones of its
+   neighbours and files it into its layer */
 void
-CompScreen::unhookWindow (CompWindow *w)
+PrivateScreen::setStackKey (CompWindow *w)
+{
+    unsigned long long below = w->prev ? w->prev->priv->stackKey : 0;
+    unsigned long long above = w->next ? w->next->priv->stackKey : 0;
+    unsigned long long key = 0;
+
+    w->priv->stackLayer = w->priv->getStackLayer ();
+
+    if (!w->next)
+    {
+	if (below < ~0ULL - STACK_KEY_SPACING)
+	    key = below + STACK_KEY_SPACING;
+    }
+    else if (!w->prev)
+    {
+	if (above > STACK_KEY_SPACING)
+	    key = above - STACK_KEY_SPACING;
+	else
+	    key = above / 2;
+    }
+    else if (above - below > 1)
+    {
+	key = below + (above - below) / 2;
+    }
+
+    if (!key)
+    {
+	renumberStack ();
+	return;
+    }
+
+    w->priv->stackKey = key;
+    stackLayers[w->priv->stackLayer][key] = w;
+}
+
+/* spreads the keys out evenly again once two neighbours ran out of
+   space between them, rare enough to simply rebuild every layer */
+void
+PrivateScreen::renumberStack ()
+{
+    unsigned long long key = 0;
+
+    for (unsigned int i = 0; i < StackLayerCount; i++)
+	stackLayers[i].clear ();
+
+    foreach (CompWindow *w, windows)
+    {
+	key += STACK_KEY_SPACING;
+
+	w->priv->stackKey = key;
+	stackLayers[w->priv->stackLayer][key] = w;
+    }
+}
+
+void
+PrivateScreen::updateStackLayer (CompWindow *w)
 {
-    CompWindowList::iterator it =
-	std::find (priv->windows.begin (), priv->windows.end (), w);
+    unsigned int layer = w->priv->getStackLayer ();
+
+    if (layer == w->priv->stackLayer)
+	return;
+
+    if (w->priv->stackKey)
+    {
+	stackLayers[w->priv->stackLayer].erase (w->priv->stackKey);
+	stackLayers[layer][w->priv->stackKey] = w;
+    }
 
-    priv->windows.erase (it);
+    w->priv->stackLayer = layer;
+}
+
+void
+CompScreen::unhookWindow (CompWindow *w)
+{
+    priv->windows.erase (w->priv->stackPos);
+    w->priv->stackPos = CompWindowList::iterator ();
+    priv->stackLayers[w->priv->stackLayer].erase (w->priv->stackKey);
+    w->priv->stackKey = 0;
     priv->eraseWindowFromMap (w->id ());
+    if (w->frame ())
+	priv->frameIndex.remove (w->frame ());
 
     if (w->next)
 	w->next->prev = w->prev;
@@ -3057,53 +4133,82 @@ CompScreen::removeAction (CompAction *action)
     }
 }
 
-CompRect
-PrivateScreen::computeWorkareaForBox (const CompRect& box)
+/* The parts of box the struts take away, returns how many there are */
+static unsigned int
+strutRectsForBox (const CompStruts *struts,
+		  const CompRect   &box,
+		  CompRect         *rects)
 {
-    CompRegion region;
-    int        x1, y1, x2, y2;
+    unsigned int n = 0;
+    int          x1, y1, x2, y2;
 
-    region += box;
+    x1 = struts->left.x;
+    y1 = struts->left.y;
+    x2 = x1 + struts->left.width;
+    y2 = y1 + struts->left.height;
 
-    foreach (CompWindow *w, windows)
-    {
-	if (!w->isMapped ())
-	    continue;
+    if (y1 < box.y2 () && y2 > box.y1 ())
+	rects[n++] = CompRect (x1, box.y1 (), x2 - x1, box.height ());
 
-	if (w->struts ())
-	{
-	    x1 = w->struts ()->left.x;
-	    y1 = w->struts ()->left.y;
-	    x2 = x1 + w->struts ()->left.width;
-	    y2 = y1 + w->struts ()->left.height;
+    x1 = struts->right.x;
+    y1 = struts->right.y;
+    x2 = x1 + struts->right.width;
+    y2 = y1 + struts->right.height;
 
-	    if (y1 < box.y2 () && y2 > box.y1 ())
-		region -= CompRect (x1, box.y1 (), x2 - x1, box.height ());
+    if (y1 < box.y2 () && y2 > box.y1 ())
+	rects[n++] = CompRect (x1, box.y1 (), x2 - x1, box.height ());
 
-	    x1 = w->struts ()->right.x;
-	    y1 = w->struts ()->right.y;
-	    x2 = x1 + w->struts ()->right.width;
-	    y2 = y1 + w->struts ()->right.height;
+    x1 = struts->top.x;
+    y1 = struts->top.y;
+    x2 = x1 + struts->top.width;
+    y2 = y1 + struts->top.height;
 
-	    if (y1 < box.y2 () && y2 > box.y1 ())
-		region -= CompRect (x1, box.y1 (), x2 - x1, box.height ());
+    if (x1 < box.x2 () && x2 > box.x1 ())
+	rects[n++] = CompRect (box.x1 (), y1, box.width (), y2 - y1);
 
-	    x1 = w->struts ()->top.x;
-	    y1 = w->struts ()->top.y;
-	    x2 = x1 + w->struts ()->top.width;
-	    y2 = y1 + w->struts ()->top.height;
+    x1 = struts->bottom.x;
+    y1 = struts->bottom.y;
+    x2 = x1 + struts->bottom.width;
+    y2 = y1 + struts->bottom.height;
 
-	    if (x1 < box.x2 () && x2 > box.x1 ())
-		region -= CompRect (box.x1 (), y1, box.width (), y2 - y1);
+    if (x1 < box.x2 () && x2 > box.x1 ())
+	rects[n++] = CompRect (box.x1 (), y1, box.width (), y2 - y1);
 
-	    x1 = w->struts ()->bottom.x;
-	    y1 = w->struts ()->bottom.y;
-	    x2 = x1 + w->struts ()->bottom.width;
-	    y2 = y1 + w->struts ()->bottom.height;
+    return n;
+}
 
-	    if (x1 < box.x2 () && x2 > box.x1 ())
-		region -= CompRect (box.x1 (), y1, box.width (), y2 - y1);
-	}
+static bool
+strutsAffectBox (const CompStruts *struts,
+		 const CompRect   &box)
+{
+    CompRect     rects[4];
+    unsigned int n = strutRectsForBox (struts, box, rects);
+
+    for (unsigned int i = 0; i < n; i++)
+	if (rects[i].intersects (box))
+	    return true;
+
+    return false;
+}
+
+CompRect
+PrivateScreen::computeWorkareaForBox (const CompRect& box)
+{
+    CompRegion   region;
+    CompRect     rects[4];
+    unsigned int n;
+
+    region += box;
+
+    foreach (CompWindow *w, strutWindows)
+    {
+	if (!w->isMapped ())
+	    continue;
+
+	n = strutRectsForBox (w->struts (), box, rects);
+
+	for (unsigned int i = 0; i < n; i++)
+	    region -= rects[i];
     }
 
     if (region.isEmpty ())
@@ -3116,32 +4221,83 @@ PrivateScreen::computeWorkareaForBox (const CompRect& box)
     return region.boundingRect ();
 }
 
+/* Marks the work areas of the outputs the given struts cut into as
+   needing an update, the next updateWorkarea only looks at those. */
+void
+PrivateScreen::markStruts (const CompStruts *struts)
+{
+    if (!workareasMarked)
+    {
+	dirtyWorkareas.assign (outputDevs.size (), false);
+	workareasMarked = true;
+    }
+
+    if (!struts)
+	return;
+
+    for (unsigned int i = 0; i < outputDevs.size (); i++)
+	if (!dirtyWorkareas[i] && strutsAffectBox (struts, outputDevs[i]))
+	    dirtyWorkareas[i] = true;
+}
+
+/* only windows whose struts have some area go into the index */
+void
+PrivateScreen::updateStrutIndex (CompWindow *w)
+{
+    const CompStruts *s = w->struts ();
+    bool             hasStruts;
+
+    hasStruts = s && ((s->left.width && s->left.height)     ||
+		      (s->right.width && s->right.height)   ||
+		      (s->top.width && s->top.height)       ||
+		      (s->bottom.width && s->bottom.height));
+
+    std::list<CompWindow *>::iterator it =
+	std::find (strutWindows.begin (), strutWindows.end (), w);
+
+    if (hasStruts && it == strutWindows.end ())
+	strutWindows.push_back (w);
+    else if (!hasStruts && it != strutWindows.end ())
+	strutWindows.erase (it);
+}
+
 void
 CompScreen::updateWorkarea ()
 {
-    CompRect workArea;
-    bool     workAreaChanged = false;
+    CompRect          workArea;
+    std::vector<bool> changed (priv->outputDevs.size (), false);
+    bool              workAreaChanged = false;
+    bool              marked;
+
+    /* without marks from strut changes everything is recomputed */
+    marked = priv->workareasMarked &&
+	     priv->dirtyWorkareas.size () == priv->outputDevs.size ();
 
     for (unsigned int i = 0; i < priv->outputDevs.size (); i++)
     {
 	CompRect oldWorkArea = priv->outputDevs[i].workArea ();
 
+	if (marked && !priv->dirtyWorkareas[i])
+	    continue;
+
 	workArea = priv->computeWorkareaForBox (priv->outputDevs[i]);
 
 	if (workArea != oldWorkArea)
 	{
 	    workAreaChanged = true;
+	    changed[i] = true;
 	    priv->outputDevs[i].setWorkArea (workArea);
 	}
     }
 
+    priv->workareasMarked = false;
+
     workArea = priv->computeWorkareaForBox (CompRect (0, 0,
 						      screen->width (),
 						      screen->height ()));
 
     if (priv->workArea != workArea)
     {
-	workAreaChanged = true;
 	priv->workArea = workArea;
 
 	priv->setDesktopHints ();
@@ -3149,10 +4305,20 @@ CompScreen::updateWorkarea ()
 
     if (workAreaChanged)
     {
-	/* as work area changed, update all maximized windows on this
-	   screen to snap to the new work area */
+	/* as work area changed, update all maximized windows on the
+	   affected outputs to snap to the new work area */
 	foreach (CompWindow *w, priv->windows)
-	    w->priv->updateSize ();
+	{
+	    unsigned int output;
+
+	    if (!(w->priv->state & MAXIMIZE_STATE) &&
+		!(w->priv->type & CompWindowTypeFullscreenMask))
+		continue;
+
+	    output = outputDeviceForGeometry (w->priv->serverGeometry);
+	    if (output < changed.size () && changed[output])
+		w->priv->updateSize ();
+	}
     }
 }
 
@@ -3177,16 +4343,6 @@ isClientListWindow (CompWindow *w)
     return true;
 }
 
-static void
-countClientListWindow (CompWindow *w,
-		       int        *n)
-{
-    if (isClientListWindow (w))
-    {
-	*n = *n + 1;
-    }
-}
-
 static bool
 compareMappingOrder (const CompWindow *w1,
 		     const CompWindow *w2)
@@ -3194,92 +4350,125 @@ compareMappingOrder (const CompWindow *w1,
     return w1->mapNum () < w2->mapNum ();
 }
 
-void
-PrivateScreen::updateClientList ()
-{//return; // TUX
-    bool   updateClientList = false;
-    bool   updateClientListStacking = false;
-    int	   n = 0;
+bool
+PrivateScreen::compareStackingOrder (const CompWindow *w1,
+				     const CompWindow *w2)
+{
+    return w1->priv->stackKey < w2->priv->stackKey;
+}
 
-    screen->forEachWindow (boost::bind (countClientListWindow, _1, &n));
+void
+ClientListProperty::insert (unsigned int pos,
+			    Window       id)
+{
+    ids.insert (ids.begin () + pos, id);
+}
 
-    if (n == 0)
-    {
-	if ((unsigned int) n != priv->clientList.size ())
-	{
-	    priv->clientList.clear ();
-	    priv->clientListStacking.clear ();
-	    priv->clientIdList.clear ();
-	    priv->clientIdListStacking.clear ();
-
-	    XChangeProperty (priv->dpy, priv->root,
-			     Atoms::clientList,
-			     XA_WINDOW, 32, PropModeReplace,
-			     (unsigned char *) &priv->grabWindow, 1);
-	    XChangeProperty (priv->dpy, priv->root,
-			     Atoms::clientListStacking,
-			     XA_WINDOW, 32, PropModeReplace,
-			     (unsigned char *) &priv->grabWindow, 1);
-	}
+void
+ClientListProperty::erase (unsigned int pos)
+{
+    ids.erase (ids.begin () + pos);
+}
 
+void
+ClientListProperty::flush (Display *dpy,
+			   Window  root,
+			   Atom    atom,
+			   Window  none)
+{
+    if (ids == server)
 	return;
-    }
 
-    if ((unsigned int) n != priv->clientList.size ())
+    if (ids.empty ())
     {
-	priv->clientIdList.resize (n);
-	priv->clientIdListStacking.resize (n);
-
-	updateClientList = updateClientListStacking = true;
+	XChangeProperty (dpy, root, atom, XA_WINDOW, 32, PropModeReplace,
+			 (unsigned char *) &none, 1);
+    }
+    else if (!server.empty () && ids.size () > server.size () &&
+	     std::equal (server.begin (), server.end (), ids.begin ()))
+    {
+	XChangeProperty (dpy, root, atom, XA_WINDOW, 32, PropModeAppend,
+			 (unsigned char *) &ids.at (server.size ()),
+			 ids.size () - server.size ());
     }
+    else
+    {
+	XChangeProperty (dpy, root, atom, XA_WINDOW, 32, PropModeReplace,
+			 (unsigned char *) &ids.at (0), ids.size ());
+    }
+
+    server = ids;
+}
 
-    priv->clientListStacking.clear ();
+#ifdef DEBUG
+static bool
+clientListSorted (const CompWindowVector &list,
+		  bool (*compare) (const CompWindow *, const CompWindow *))
+{
+    for (unsigned int i = 1; i < list.size (); i++)
+	if ((*compare) (list[i], list[i - 1]))
+	    return false;
 
-    foreach (CompWindow *w, priv->windows)
-	if (isClientListWindow (w))
-	    priv->clientListStacking.push_back (w);
+    return true;
+}
+#endif
 
-    /* clear clientList and copy clientListStacking into clientList */
-    priv->clientList = priv->clientListStacking;
+/* moves w to its place in both client lists, or takes it out of them
+   if it isn't a client list window (anymore). Whoever changes the
+   mapping number or stacking position of a window in the lists has to
+   call this for it, the binary searches rely on the other windows
+   being in order. */
+void
+PrivateScreen::updateClientList (CompWindow *w)
+{
+    CompWindowVector::iterator it;
+    bool                       member;
 
-    /* sort clientList in mapping order */
-    sort (priv->clientList.begin (), priv->clientList.end (),
-	  compareMappingOrder);
+    /* unhooked windows are on their way out */
+    member = isClientListWindow (w) && w->priv->stackKey;
 
-    /* make sure client id lists are up-to-date */
-    for (int i = 0; i < n; i++)
+    it = std::find (clientList.begin (), clientList.end (), w);
+    if (it != clientList.end ())
     {
-	if (!updateClientList &&
-	    priv->clientIdList[i] != priv->clientList[i]->id ())
-	{
-	    updateClientList = true;
-	}
-
-	priv->clientIdList[i] = priv->clientList[i]->id ();
+	clientIdList.erase (it - clientList.begin ());
+	clientList.erase (it);
     }
-    for (int i = 0; i < n; i++)
-    {
-	if (!updateClientListStacking &&
-	    priv->clientIdListStacking[i] != priv->clientListStacking[i]->id ())
-	{
-	    updateClientListStacking = true;
-	}
 
-	priv->clientIdListStacking[i] = priv->clientListStacking[i]->id ();
+    it = std::find (clientListStacking.begin (), clientListStacking.end (), w);
+    if (it != clientListStacking.end ())
+    {
+	clientIdListStacking.erase (it - clientListStacking.begin ());
+	clientListStacking.erase (it);
     }
 
-    if (updateClientList)
-	XChangeProperty (priv->dpy, priv->root,
-			 Atoms::clientList,
-			 XA_WINDOW, 32, PropModeReplace,
-			 (unsigned char *) &priv->clientIdList.at (0), n);
+#ifdef DEBUG
+    assert (clientListSorted (clientList, compareMappingOrder));
+    assert (clientListSorted (clientListStacking, compareStackingOrder));
+#endif
+
+    if (!member)
+	return;
+
+    it = std::upper_bound (clientList.begin (), clientList.end (), w,
+			   compareMappingOrder);
+    clientIdList.insert (it - clientList.begin (), w->id ());
+    clientList.insert (it, w);
+
+    it = std::upper_bound (clientListStacking.begin (),
+			   clientListStacking.end (), w,
+			   compareStackingOrder);
+    clientIdListStacking.insert (it - clientListStacking.begin (), w->id ());
+    clientListStacking.insert (it, w);
+}
 
-    if (updateClientListStacking)
-	XChangeProperty (priv->dpy, priv->root,
-			 Atoms::clientListStacking,
-			 XA_WINDOW, 32, PropModeReplace,
-			 (unsigned char *) &priv->clientIdListStacking.at (0),
-			 n);
+/* called once per event batch, clients watching the lists only see
+   the final result of everything that happened in it */
+void
+PrivateScreen::flushClientList ()
+{
+    clientIdList.flush (dpy, root, Atoms::clientList, grabWindow);
+    clientIdListStacking.flush (dpy, root, Atoms::clientListStacking,
+				grabWindow);
 }
 
 const CompWindowVector &
@@ -3877,8 +5066,6 @@ void
 CompScreen::warpPointer (int dx,
 			 int dy)
 {
-    XEvent      event;
-
     pointerX += dx;
     pointerY += dy;
 
@@ -3899,11 +5086,7 @@ CompScreen::warpPointer (int dx,
 
     XSync (priv->dpy, false);
 
-    while (XCheckMaskEvent (priv->dpy,
-			    LeaveWindowMask |
-			    EnterWindowMask |
-			    PointerMotionMask,
-			    &event));
+    priv->discardPointerEvents ();
 
     if (!inHandleEvent)
     {
@@ -3921,16 +5104,21 @@ CompScreen::windows ()
 Time
 CompScreen::getCurrentTime ()
 {
-    XEvent event;
+    xcb_generic_event_t *event;
+    Time                time = CurrentTime;
 
     XChangeProperty (priv->dpy, priv->grabWindow,
 		     XA_PRIMARY, XA_STRING, 8,
 		     PropModeAppend, NULL, 0);
-    XWindowEvent (priv->dpy, priv->grabWindow,
-		  PropertyChangeMask,
-		  &event);
 
-    return event.xproperty.time;
+    event = priv->waitForWindowEvent (priv->grabWindow, XCB_PROPERTY_NOTIFY);
+    if (event)
+    {
+	time = ((xcb_property_notify_event_t *) event)->time;
+	free (event);
+    }
+
+    return time;
 }
 
 Window
@@ -4090,6 +5278,9 @@ CompScreen::init (const char *name)
     XSetWindowAttributes attrib;
 
     CompOption::Value::Vector vList;
+    CompStringList            preload;
+
+    priv->startupPhase ("setup");
 
     CompPlugin *corePlugin = CompPlugin::load ("core");
     if (!corePlugin)
@@ -4106,6 +5297,13 @@ CompScreen::init (const char *name)
 	return false;
     }
 
+    if (priv->epollFd < 0 || priv->timerFd < 0)
+    {
+	compLogMessage ("core", CompLogLevelFatal,
+			"Couldn't create event loop file descriptors");
+	return false;
+    }
+
     CompPrivate p;
     p.uval = CORE_ABIVERSION;
     storeValue ("core_ABI", p);
@@ -4114,6 +5312,14 @@ CompScreen::init (const char *name)
 
     priv->plugin.set (CompOption::TypeString, vList);
 
+    /* open the configured plugins while we talk to the X server */
+    foreach (CompOption::Value &value, priv->optionGetActivePlugins ())
+	preload.push_back (value.s ());
+
+    pluginPreloader.start (preload);
+
+    priv->startupPhase ("core plugin");
+
     dpy = priv->dpy = XOpenDisplay (name);
     if (!priv->dpy)
     {
@@ -4122,7 +5328,11 @@ CompScreen::init (const char *name)
 	return false;
     }
 
-//    priv->connection = XGetXCBConnection (priv->dpy);
+    priv->startupPhase ("display");
+
+    /* events are read through XCB, see PrivateScreen::processEvents */
+    priv->connection = XGetXCBConnection (priv->dpy);
+    XSetEventQueueOwner (priv->dpy, XCBOwnsEventQueue);
 
     snprintf (priv->displayString, 255, "DISPLAY=%s",
 	      DisplayString (dpy));
@@ -4133,6 +5343,8 @@ CompScreen::init (const char *name)
 
     Atoms::init (priv->dpy);
 
+    priv->startupPhase ("atoms");
+
     XSetErrorHandler (errorHandler);
 
     priv->snDisplay = sn_display_new (dpy, NULL, NULL);
@@ -4371,12 +5583,13 @@ CompScreen::init (const char *name)
     /* TODO: bailout properly when objectInitPlugins fails */
     assert (CompPlugin::screenInitPlugins (this));
 
+    priv->startupPhase ("screen");
+
     XQueryTree (dpy, priv->root,
 		&rootReturn, &parentReturn,
 		&children, &nchildren);
 
-    for (unsigned int i = 0; i < nchildren; i++)
-	new CompWindow (children[i], i ? children[i - 1] : 0);
+    priv->adoptWindows (children, nchildren);
 
     foreach (CompWindow *w, priv->windows)
     {
@@ -4386,6 +5599,8 @@ CompScreen::init (const char *name)
 
     XFree (children);
 
+    priv->startupPhase ("windows");
+
     attrib.override_redirect = 1;
     attrib.event_mask	     = PropertyChangeMask;
 
@@ -4459,9 +5674,14 @@ CompScreen::init (const char *name)
 
     priv->pingTimer.start ();
 
+    if (debugOutput)
+	priv->statsTimer.start ();
+
     priv->initialized = true;
     priv->addScreenActions ();
 
+    priv->startupPhase ("init");
+
     return true;
 }
 
@@ -4500,8 +5720,11 @@ CompScreen::~CompScreen ()
     if (priv->snDisplay)
 	sn_display_unref (priv->snDisplay);
 
-    if (priv->watchPollFds)
-	free (priv->watchPollFds);
+    if (priv->timerFd >= 0)
+	close (priv->timerFd);
+
+    if (priv->epollFd >= 0)
+	close (priv->epollFd);
 
     XSync (priv->dpy, False);
     XCloseDisplay (priv->dpy);
@@ -4515,22 +5738,40 @@ PrivateScreen::PrivateScreen (CompScreen *screen) :
     priv (this),
     fileWatch (0),
     lastFileWatchHandle (1),
-    timers (0),
+    timers (),
+    strutWindows (),
+    dirtyWorkareas (),
+    workareasMarked (false),
     watchFds (0),
     lastWatchFdHandle (1),
-    watchPollFds (0),
-    nWatchFds (0),
+    epollFd (-1),
+    timerFd (-1),
+    timerFdDeadline (0),
+    timerStats (),
+    eventReader (NULL),
+    xcbEvents (),
+    eventBatch (),
+    eventBatchPos (0),
+    eventStats (),
     valueMap (),
+    connection (NULL),
     screenInfo (0),
+    prefetches (),
+    propertyCache (),
+    propertyStats (),
     activeWindow (0),
     below (None),
     autoRaiseTimer (),
     autoRaiseWindow (0),
     edgeDelayTimer (),
+    actionIndex (),
     plugin (),
     dirtyPluginList (true),
+    startupPhases (),
     screen (screen),
     windows (),
+    clientIndex (),
+    frameIndex (),
     vp (0, 0),
     vpSize (1, 1),
     nDesktop (1),
@@ -4540,6 +5781,8 @@ PrivateScreen::PrivateScreen (CompScreen *screen) :
     desktopWindowCount (0),
     mapNum (1),
     activeNum (1),
+    matchGeneration (1),
+    matchIndex (),
     outputDevs (0),
     currentOutputDev (0),
     hasOverlappingOutputs (false),
@@ -4558,8 +5801,23 @@ PrivateScreen::PrivateScreen (CompScreen *screen) :
     desktopHintSize (0),
     initialized (false)
 {
+    struct epoll_event event;
+
     memset (history, 0, sizeof (history));
-    gettimeofday (&lastTimeout, 0);
+    memset (wireToEventProcs, 0, sizeof (wireToEventProcs));
+
+    startupPhase ("start");
+
+    epollFd = epoll_create1 (EPOLL_CLOEXEC);
+    timerFd = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    if (epollFd >= 0 && timerFd >= 0)
+    {
+	event.events   = EPOLLIN;
+	event.data.u64 = TIMER_FD_HANDLE;
+
+	epoll_ctl (epollFd, EPOLL_CTL_ADD, timerFd, &event);
+    }
 
     pingTimer.setCallback (
 	boost::bind (&PrivateScreen::handlePingTimeout, this));
@@ -4568,6 +5826,10 @@ PrivateScreen::PrivateScreen (CompScreen *screen) :
 	boost::bind (&PrivateScreen::handleStartupSequenceTimeout, this));
     startupSequenceTimer.setTimes (1000, 1500);
 
+    statsTimer.setCallback (
+	boost::bind (&PrivateScreen::handleStatsTimeout, this));
+    statsTimer.setTimes (STATS_INTERVAL, STATS_INTERVAL + 2000);
+
     
     optionSetCloseWindowKeyInitiate (CompScreen::closeWin);
     optionSetCloseWindowButtonInitiate (CompScreen::closeWin);
@@ -0,0 +1,93 @@
+/*
+ * Copyright © 2008 Dennis Kasprzyk
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the name of
+ * Dennis Kasprzyk not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior permission.
+ * Dennis Kasprzyk makes no representations about the suitability of this
+ * software for any purpose. It is provided "as is" without express or
+ * implied warranty.
+ *
+ * DENNIS KASPRZYK DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL DENNIS KASPRZYK BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION
+ * WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Dennis Kasprzyk <onestone@compiz-fusion.org>
+ */
+
+/*
+ * Checks that core's own action argument vectors are read through their
+ * slots. The options are renamed before reading them back, a lookup by
+ * name would only find the defaults.
+ */
+
+#include <stdio.h>
+
+#include <core/core.h>
+#include "privateaction.h"
+
+static bool
+expect (const char *what,
+	int        value,
+	int        expected)
+{
+    if (value == expected)
+	return true;
+
+    fprintf (stderr, "%s: got %d, expected %d\n", what, value, expected);
+    return false;
+}
+
+int
+main ()
+{
+    ActionArguments    args (3, ActionArguments::SlotTime);
+    CompOption::Vector &options = args.options ();
+    bool               ok = true;
+
+    ok &= expect ("size", options.size (), 4);
+
+    args.set (ActionArguments::SlotEventWindow, 11);
+    args.set (ActionArguments::SlotWindow, 22);
+    args.set (ActionArguments::SlotModifiers, 33);
+    args.set (ActionArguments::SlotTime, 44);
+
+    foreach (CompOption &option, options)
+	option.setName ("renamed", CompOption::TypeInt);
+
+    ok &= expect ("event_window",
+		  ActionArguments::get (options,
+					ActionArguments::SlotEventWindow), 11);
+    ok &= expect ("window",
+		  ActionArguments::get (options,
+					ActionArguments::SlotWindow), 22);
+    ok &= expect ("modifiers",
+		  ActionArguments::get (options,
+					ActionArguments::SlotModifiers), 33);
+    ok &= expect ("time",
+		  ActionArguments::get (options,
+					ActionArguments::SlotTime), 44);
+
+    /* slots the vector doesn't have give the default */
+    ok &= expect ("x",
+		  ActionArguments::get (options,
+					ActionArguments::SlotX, -1), -1);
+
+    /* once a callback resized the vector only names count */
+    options.push_back (CompOption ("window", CompOption::TypeInt));
+    options.back ().value ().set (55);
+
+    ok &= expect ("resized window",
+		  ActionArguments::get (options,
+					ActionArguments::SlotWindow), 55);
+
+    return ok ? 0 : 1;
+}
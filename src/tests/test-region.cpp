@@ -0,0 +1,219 @@
+/*
+ * Copyright © 2008 Dennis Kasprzyk
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the name of
+ * Dennis Kasprzyk not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior permission.
+ * Dennis Kasprzyk makes no representations about the suitability of this
+ * software for any purpose. It is provided "as is" without express or
+ * implied warranty.
+ *
+ * DENNIS KASPRZYK DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL DENNIS KASPRZYK BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION
+ * WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Dennis Kasprzyk <onestone@compiz-fusion.org>
+ */
+
+/*
+ * Randomized comparison of CompRegion against the libX11 region code it
+ * replaced. Every operation is applied to random operands on both sides
+ * and the resulting bands must match rectangle for rectangle.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/Xregion.h>
+
+#include <core/core.h>
+
+#define ITERATIONS 20000
+
+static Region
+toXRegion (const CompRegion &r)
+{
+    Region x = XCreateRegion ();
+    Region empty = XCreateRegion ();
+
+    XUnionRegion (r.handle (), empty, x);
+    XDestroyRegion (empty);
+
+    return x;
+}
+
+static bool
+sameRegion (const CompRegion &r, Region x)
+{
+    Region h = r.handle ();
+
+    if (h->numRects != x->numRects)
+	return false;
+
+    if (!x->numRects)
+	return true;
+
+    if (memcmp (&h->extents, &x->extents, sizeof (BOX)))
+	return false;
+
+    return !memcmp (h->rects, x->rects, x->numRects * sizeof (BOX));
+}
+
+static CompRegion
+randomRegion (int n)
+{
+    CompRegion r;
+
+    for (int i = 0; i < n; i++)
+	r += CompRect (rand () % 60, rand () % 60,
+		       1 + rand () % 25, 1 + rand () % 25);
+
+    if (rand () % 3 == 0)
+	r -= CompRect (rand () % 60, rand () % 60,
+		       rand () % 30, rand () % 30);
+
+    return r;
+}
+
+static Region
+buildXRegion (const CompRegion &r)
+{
+    Region x = XCreateRegion ();
+
+    foreach (const CompRect &rect, r.rects ())
+	XUnionRegion (x, rect.region (), x);
+
+    return x;
+}
+
+static bool
+compare (int it)
+{
+    CompRegion a = randomRegion (rand () % 8);
+    CompRegion b = randomRegion (rand () % 8);
+    Region     xa = buildXRegion (a);
+    Region     xb = buildXRegion (b);
+    Region     xr = XCreateRegion ();
+    Region     xs;
+    int        dx = rand () % 7 - 3;
+    int        dy = rand () % 7 - 3;
+    const char *failed = NULL;
+
+    if (!sameRegion (a, xa) || !sameRegion (b, xb))
+	failed = "construction";
+
+    XUnionRegion (xa, xb, xr);
+    if (!failed && !sameRegion (a.united (b), xr))
+	failed = "united";
+
+    XIntersectRegion (xa, xb, xr);
+    if (!failed && !sameRegion (a.intersected (b), xr))
+	failed = "intersected";
+
+    XSubtractRegion (xa, xb, xr);
+    if (!failed && !sameRegion (a.subtracted (b), xr))
+	failed = "subtracted";
+
+    XXorRegion (xa, xb, xr);
+    if (!failed && !sameRegion (a.xored (b), xr))
+	failed = "xored";
+
+    xs = toXRegion (a);
+    XShrinkRegion (xs, dx, dy);
+    if (!failed && !sameRegion (a.shrinked (dx, dy), xs))
+	failed = "shrinked";
+    XDestroyRegion (xs);
+
+    xs = toXRegion (a);
+    XOffsetRegion (xs, dx, dy);
+    if (!failed && !sameRegion (a.translated (dx, dy), xs))
+	failed = "translated";
+    XDestroyRegion (xs);
+
+    for (int k = 0; k < 20 && !failed; k++)
+    {
+	int x = rand () % 80 - 5;
+	int y = rand () % 80 - 5;
+	int w = 1 + rand () % 20;
+	int h = 1 + rand () % 20;
+	int in = XRectInRegion (xa, x, y, w, h);
+
+	if (a.contains (CompPoint (x, y)) != (bool) XPointInRegion (xa, x, y))
+	    failed = "contains (point)";
+	else if (a.contains (CompRect (x, y, w, h)) != (in == RectangleIn))
+	    failed = "contains (rect)";
+	else if (a.intersects (CompRect (x, y, w, h)) != (in != RectangleOut))
+	    failed = "intersects";
+    }
+
+    if (!failed && (a == b) != (bool) XEqualRegion (xa, xb))
+	failed = "operator==";
+
+    XDestroyRegion (xa);
+    XDestroyRegion (xb);
+    XDestroyRegion (xr);
+
+    if (failed)
+    {
+	fprintf (stderr, "iteration %d: %s differs from libX11\n", it, failed);
+	return false;
+    }
+
+    return true;
+}
+
+static bool
+copyOnWrite ()
+{
+    CompRegion a (0, 0, 10, 10);
+    CompRegion b (a);
+    CompRegion c;
+
+    b.translate (5, 5);
+    if (a.boundingRect ().x1 () != 0 || b.boundingRect ().x1 () != 5)
+	return false;
+
+    c = a;
+    c += CompRect (20, 20, 5, 5);
+    if (a.numRects () != 1 || c.numRects () != 2)
+	return false;
+
+    c = CompRegion ();
+    c.translate (3, 3);
+
+    return c.isEmpty ();
+}
+
+int
+main (int argc, char **argv)
+{
+    unsigned int seed = argc > 1 ? strtoul (argv[1], NULL, 0) : 1;
+
+    srand (seed);
+
+    if (!copyOnWrite ())
+    {
+	fprintf (stderr, "copy on write: shared region was modified\n");
+	return 1;
+    }
+
+    for (int it = 0; it < ITERATIONS; it++)
+	if (!compare (it))
+	{
+	    fprintf (stderr, "seed %u\n", seed);
+	    return 1;
+	}
+
+    return 0;
+}
@@ -0,0 +1,201 @@
+/*
+ * Copyright © 2008 Dennis Kasprzyk
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the name of
+ * Dennis Kasprzyk not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior permission.
+ * Dennis Kasprzyk makes no representations about the suitability of this
+ * software for any purpose. It is provided "as is" without express or
+ * implied warranty.
+ *
+ * DENNIS KASPRZYK DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL DENNIS KASPRZYK BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION
+ * WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Dennis Kasprzyk <onestone@compiz-fusion.org>
+ */
+
+/*
+ * Randomized comparison of the layered stack searches against linear
+ * walks over the whole stack, which is how siblings were searched before
+ * the stack was split into layers.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <map>
+#include <vector>
+#include <algorithm>
+
+#include "privatestacksearch.h"
+
+#define ITERATIONS 20000
+#define LAYERS     7
+
+struct TestWindow {
+    unsigned long long key;
+    unsigned int       layer;
+    unsigned int       flags;
+};
+
+typedef std::map<unsigned long long, TestWindow *> TestLayer;
+
+struct FlagCheck {
+    FlagCheck (unsigned int mask) : mask (mask) {}
+
+    bool operator() (TestWindow *w) const
+    {
+	return (w->flags & mask);
+    }
+
+    unsigned int mask;
+};
+
+static bool
+compareKey (const TestWindow *a,
+	    const TestWindow *b)
+{
+    return a->key < b->key;
+}
+
+static bool
+passes (TestWindow         *w,
+	unsigned int       mask,
+	unsigned long long low,
+	unsigned long long high,
+	const FlagCheck    &check)
+{
+    return ((mask & (1 << w->layer)) && w->key > low && w->key < high &&
+	    check (w));
+}
+
+/* stack is ordered bottom to top */
+static TestWindow *
+linearSearchDown (std::vector<TestWindow *> &stack,
+		  unsigned int              mask,
+		  unsigned long long        low,
+		  unsigned long long        high,
+		  const FlagCheck           &check)
+{
+    std::vector<TestWindow *>::reverse_iterator it;
+
+    for (it = stack.rbegin (); it != stack.rend (); ++it)
+	if (passes (*it, mask, low, high, check))
+	    return *it;
+
+    return NULL;
+}
+
+static TestWindow *
+linearSearchUp (std::vector<TestWindow *> &stack,
+		unsigned int              mask,
+		unsigned long long        low,
+		unsigned long long        high,
+		const FlagCheck           &check)
+{
+    std::vector<TestWindow *>::iterator it;
+
+    for (it = stack.begin (); it != stack.end (); ++it)
+	if (passes (*it, mask, low, high, check))
+	    return *it;
+
+    return NULL;
+}
+
+static unsigned long long
+randomKey (std::vector<TestWindow *> &stack)
+{
+    switch (rand () % 4) {
+    case 0:
+	return 0;
+    case 1:
+	return ~0ULL;
+    case 2:
+	if (!stack.empty ())
+	    return stack[rand () % stack.size ()]->key;
+	/* fall-through */
+    default:
+	return rand () % 4096;
+    }
+}
+
+static bool
+compare (int it)
+{
+    std::vector<TestWindow>   windows (rand () % 64);
+    std::vector<TestWindow *> stack;
+    TestLayer                 layers[LAYERS];
+
+    for (unsigned int i = 0; i < windows.size (); i++)
+    {
+	TestWindow *w = &windows[i];
+
+	w->key   = 1 + rand () % 4000;
+	w->layer = rand () % LAYERS;
+	w->flags = rand () % 16;
+
+	/* keys are unique across layers */
+	bool duplicate = false;
+	for (unsigned int j = 0; j < LAYERS; j++)
+	    if (layers[j].count (w->key))
+		duplicate = true;
+
+	if (duplicate)
+	    continue;
+
+	layers[w->layer][w->key] = w;
+	stack.push_back (w);
+    }
+
+    std::sort (stack.begin (), stack.end (), compareKey);
+
+    for (int k = 0; k < 50; k++)
+    {
+	unsigned int       mask = rand () % (1 << LAYERS);
+	unsigned long long low = randomKey (stack);
+	unsigned long long high = randomKey (stack);
+	FlagCheck          check (1 + rand () % 15);
+
+	if (stackLayerSearchDown (layers, LAYERS, mask, low, high, check) !=
+	    linearSearchDown (stack, mask, low, high, check))
+	{
+	    fprintf (stderr, "iteration %d: search down differs\n", it);
+	    return false;
+	}
+
+	if (stackLayerSearchUp (layers, LAYERS, mask, low, high, check) !=
+	    linearSearchUp (stack, mask, low, high, check))
+	{
+	    fprintf (stderr, "iteration %d: search up differs\n", it);
+	    return false;
+	}
+    }
+
+    return true;
+}
+
+int
+main (int argc, char **argv)
+{
+    unsigned int seed = argc > 1 ? strtoul (argv[1], NULL, 0) : 1;
+
+    srand (seed);
+
+    for (int it = 0; it < ITERATIONS; it++)
+	if (!compare (it))
+	{
+	    fprintf (stderr, "seed %u\n", seed);
+	    return 1;
+	}
+
+    return 0;
+}
@@ -23,9 +23,236 @@
  * Authors: Dennis Kasprzyk <onestone@compiz-fusion.org>
  */
 
+#include <time.h>
+
+#include <boost/foreach.hpp>
+#define foreach BOOST_FOREACH
+
 #include <core/timer.h>
 #include <core/screen.h>
 #include "privatescreen.h"
+#include "privatetimer.h"
+
+TimerQueue::TimerQueue () :
+    minHeap (),
+    maxHeap (),
+    index (),
+    serial (0)
+{
+}
+
+TimerQueue::~TimerQueue ()
+{
+    foreach (Entry *e, minHeap)
+	delete e;
+}
+
+TimerQueue::Time
+TimerQueue::now ()
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+
+    return (Time) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+bool
+TimerQueue::empty () const
+{
+    return minHeap.empty ();
+}
+
+unsigned int
+TimerQueue::size () const
+{
+    return minHeap.size ();
+}
+
+bool
+TimerQueue::contains (CompTimer *timer) const
+{
+    return index.find (timer) != index.end ();
+}
+
+/* ties are broken by insertion order so that timers with equal
+   deadlines fire in the order they were started */
+bool
+TimerQueue::less (const Entry *a,
+		  const Entry *b,
+		  Key         key)
+{
+    if (a->*key != b->*key)
+	return a->*key < b->*key;
+
+    return (int) (a->serial - b->serial) < 0;
+}
+
+void
+TimerQueue::siftUp (Heap         &heap,
+		    unsigned int i,
+		    Key          key,
+		    Pos          pos)
+{
+    Entry *e = heap[i];
+
+    while (i > 0)
+    {
+	unsigned int parent = (i - 1) / 2;
+
+	if (!less (e, heap[parent], key))
+	    break;
+
+	heap[i] = heap[parent];
+	heap[i]->*pos = i;
+	i = parent;
+    }
+
+    heap[i] = e;
+    e->*pos = i;
+}
+
+void
+TimerQueue::siftDown (Heap         &heap,
+		      unsigned int i,
+		      Key          key,
+		      Pos          pos)
+{
+    Entry        *e = heap[i];
+    unsigned int n = heap.size ();
+
+    for (;;)
+    {
+	unsigned int child = 2 * i + 1;
+
+	if (child >= n)
+	    break;
+
+	if (child + 1 < n && less (heap[child + 1], heap[child], key))
+	    child++;
+
+	if (!less (heap[child], e, key))
+	    break;
+
+	heap[i] = heap[child];
+	heap[i]->*pos = i;
+	i = child;
+    }
+
+    heap[i] = e;
+    e->*pos = i;
+}
+
+void
+TimerQueue::erase (Heap         &heap,
+		   unsigned int i,
+		   Key          key,
+		   Pos          pos)
+{
+    unsigned int last = heap.size () - 1;
+
+    if (i != last)
+    {
+	heap[i] = heap[last];
+	heap.pop_back ();
+
+	if (i > 0 && less (heap[i], heap[(i - 1) / 2], key))
+	    siftUp (heap, i, key, pos);
+	else
+	    siftDown (heap, i, key, pos);
+    }
+    else
+    {
+	heap.pop_back ();
+    }
+}
+
+void
+TimerQueue::insert (CompTimer *timer,
+		    Time      now)
+{
+    Entry *e;
+
+    if (contains (timer))
+	return;
+
+    e = new Entry ();
+
+    e->timer       = timer;
+    e->minDeadline = now + timer->minTime ();
+    e->maxDeadline = now + timer->maxTime ();
+    e->serial      = serial++;
+
+    minHeap.push_back (e);
+    siftUp (minHeap, minHeap.size () - 1,
+	    &Entry::minDeadline, &Entry::minPos);
+
+    maxHeap.push_back (e);
+    siftUp (maxHeap, maxHeap.size () - 1,
+	    &Entry::maxDeadline, &Entry::maxPos);
+
+    index[timer] = e;
+}
+
+void
+TimerQueue::remove (CompTimer *timer)
+{
+    Index::iterator it = index.find (timer);
+    Entry           *e;
+
+    if (it == index.end ())
+	return;
+
+    e = it->second;
+    index.erase (it);
+
+    erase (minHeap, e->minPos, &Entry::minDeadline, &Entry::minPos);
+    erase (maxHeap, e->maxPos, &Entry::maxDeadline, &Entry::maxPos);
+
+    delete e;
+}
+
+CompTimer *
+TimerQueue::top () const
+{
+    return minHeap.empty () ? NULL : minHeap.front ()->timer;
+}
+
+TimerQueue::Time
+TimerQueue::minDeadline () const
+{
+    return minHeap.front ()->minDeadline;
+}
+
+TimerQueue::Time
+TimerQueue::maxDeadline () const
+{
+    return maxHeap.front ()->maxDeadline;
+}
+
+int
+TimerQueue::minLeft (CompTimer *timer,
+		     Time      now) const
+{
+    Index::const_iterator it = index.find (timer);
+
+    if (it == index.end ())
+	return 0;
+
+    return it->second->minDeadline - now;
+}
+
+int
+TimerQueue::maxLeft (CompTimer *timer,
+		     Time      now) const
+{
+    Index::const_iterator it = index.find (timer);
+
+    if (it == index.end ())
+	return 0;
+
+    return it->second->maxDeadline - now;
+}
 
 CompTimer::CompTimer () :
     mActive (false),
@@ -124,13 +351,17 @@ CompTimer::maxTime ()
 unsigned int
 CompTimer::minLeft ()
 {
-    return (mMinLeft < 0)? 0 : mMinLeft;
+    int left = screen->priv->timers.minLeft (this, TimerQueue::now ());
+
+    return (left < 0)? 0 : left;
 }
 
 unsigned int
 CompTimer::maxLeft ()
 {
-    return (mMaxLeft < 0)? 0 : mMaxLeft;
+    int left = screen->priv->timers.maxLeft (this, TimerQueue::now ());
+
+    return (left < 0)? 0 : left;
 }
 
 bool
@@ -45,6 +45,7 @@
 #include <core/atoms.h>
 #include "privatewindow.h"
 #include "privatescreen.h"
+#include "privatestacksearch.h"
 
 PluginClassStorage::Indices windowPluginClassIndices (0);
 
@@ -207,21 +208,84 @@ PrivateWindow::recalcNormalHints ()
     }
 }
 
+/* WM_NORMAL_HINTS as XGetWMNormalHints would decode it, old 15
+   element properties carry no base size or gravity */
 void
 PrivateWindow::updateNormalHints ()
 {
-    Status status;
-    long   supplied;
+    PropertyReply prop;
 
-    status = XGetWMNormalHints (screen->dpy (), priv->id,
-				&priv->sizeHints, &supplied);
+    priv->sizeHints.flags = 0;
 
-    if (!status)
-	priv->sizeHints.flags = 0;
+    if (screen->priv->getWindowProperty (priv->id, XA_WM_NORMAL_HINTS,
+					 XA_WM_SIZE_HINTS, 18L, prop) &&
+	prop.format == 32 && prop.n >= 15)
+    {
+	XSizeHints &hints = priv->sizeHints;
+
+	hints.flags        = prop.item (0);
+	hints.x            = (int32_t) prop.item (1);
+	hints.y            = (int32_t) prop.item (2);
+	hints.width        = (int32_t) prop.item (3);
+	hints.height       = (int32_t) prop.item (4);
+	hints.min_width    = (int32_t) prop.item (5);
+	hints.min_height   = (int32_t) prop.item (6);
+	hints.max_width    = (int32_t) prop.item (7);
+	hints.max_height   = (int32_t) prop.item (8);
+	hints.width_inc    = (int32_t) prop.item (9);
+	hints.height_inc   = (int32_t) prop.item (10);
+	hints.min_aspect.x = (int32_t) prop.item (11);
+	hints.min_aspect.y = (int32_t) prop.item (12);
+	hints.max_aspect.x = (int32_t) prop.item (13);
+	hints.max_aspect.y = (int32_t) prop.item (14);
+
+	if (prop.n >= 18)
+	{
+	    hints.base_width  = (int32_t) prop.item (15);
+	    hints.base_height = (int32_t) prop.item (16);
+	    hints.win_gravity = (int32_t) prop.item (17);
+	}
+	else
+	{
+	    hints.base_width  = 0;
+	    hints.base_height = 0;
+	    hints.win_gravity = 0;
+	    hints.flags &= USPosition | USSize | PAllHints;
+	}
+    }
 
     priv->recalcNormalHints ();
 }
 
+/* WM_HINTS as XGetWMHints would return it, free with XFree */
+XWMHints *
+PrivateWindow::getWmHints ()
+{
+    PropertyReply prop;
+    XWMHints      *wmHints;
+
+    if (!screen->priv->getWindowProperty (id, XA_WM_HINTS, XA_WM_HINTS,
+					  9L, prop) ||
+	prop.format != 32 || prop.n < 8)
+	return NULL;
+
+    wmHints = XAllocWMHints ();
+    if (!wmHints)
+	return NULL;
+
+    wmHints->flags         = prop.item (0);
+    wmHints->input         = prop.item (1) ? True : False;
+    wmHints->initial_state = (int32_t) prop.item (2);
+    wmHints->icon_pixmap   = prop.item (3);
+    wmHints->icon_window   = prop.item (4);
+    wmHints->icon_x        = (int32_t) prop.item (5);
+    wmHints->icon_y        = (int32_t) prop.item (6);
+    wmHints->icon_mask     = prop.item (7);
+    wmHints->window_group  = prop.n >= 9 ? prop.item (8) : 0;
+
+    return wmHints;
+}
+
 void
 PrivateWindow::updateWmHints ()
 {
@@ -234,7 +298,7 @@ PrivateWindow::updateWmHints ()
 
     inputHint = true;
 
-    newHints = XGetWMHints (screen->dpy (), id);
+    newHints = getWmHints ();
     if (newHints)
     {
 	dFlags ^= newHints->flags;
@@ -271,8 +335,7 @@ PrivateWindow::updateWmHints ()
 void
 PrivateWindow::updateClassHints ()
 {
-    XClassHint classHint;
-    int	       status;
+    PropertyReply prop;
 
     if (priv->resName)
     {
@@ -286,37 +349,34 @@ PrivateWindow::updateClassHints ()
 	priv->resClass = NULL;
     }
 
-    status = XGetClassHint (screen->dpy (),
-			    priv->id, &classHint);
-    if (status)
+    if (screen->priv->getWindowProperty (priv->id, XA_WM_CLASS, XA_STRING,
+					 1024L, prop) &&
+	prop.format == 8 && prop.n)
     {
-	if (classHint.res_name)
-	{
-	    priv->resName = strdup (classHint.res_name);
-	    XFree (classHint.res_name);
-	}
+	const char    *data = (const char *) prop.data ();
+	unsigned long nameLength = strnlen (data, prop.n);
 
-	if (classHint.res_class)
-	{
-	    priv->resClass = strdup (classHint.res_class);
-	    XFree (classHint.res_class);
-	}
+	priv->resName = strndup (data, nameLength);
+
+	if (nameLength + 1 < prop.n)
+	    priv->resClass = strndup (data + nameLength + 1,
+				      prop.n - nameLength - 1);
+	else
+	    priv->resClass = strdup ("");
     }
 }
 
 void
 PrivateWindow::updateTransientHint ()
 {
-    Window transientFor;
-    Status status;
+    PropertyReply prop;
 
     priv->transientFor = None;
 
-    status = XGetTransientForHint (screen->dpy (),
-				   priv->id, &transientFor);
-
-    if (status)
+    if (screen->priv->getWindowProperty (priv->id, XA_WM_TRANSIENT_FOR,
+					 XA_WINDOW, 1L, prop) && prop.n)
     {
+	Window     transientFor = prop.item (0);
 	CompWindow *ancestor;
 
 	ancestor = screen->findWindow (transientFor);
@@ -335,31 +395,18 @@ PrivateWindow::updateTransientHint ()
 void
 PrivateWindow::updateIconGeometry ()
 {
-    Atom	  actual;
-    int		  result, format;
-    unsigned long n, left;
-    unsigned char *data;
+    PropertyReply prop;
 
     priv->iconGeometry.setGeometry (0, 0, 0, 0);
 
-    result = XGetWindowProperty (screen->dpy (), priv->id,
-				 Atoms::wmIconGeometry,
-				 0L, 1024L, False, XA_CARDINAL,
-				 &actual, &format, &n, &left, &data);
-
-    if (result == Success && data)
+    if (screen->priv->getWindowProperty (priv->id, Atoms::wmIconGeometry,
+					 XA_CARDINAL, 1024L, prop) &&
+	prop.n == 4)
     {
-	if (n == 4)
-	{
-	    unsigned long *geometry = (unsigned long *) data;
-
-	    priv->iconGeometry.setX (geometry[0]);
-	    priv->iconGeometry.setY (geometry[1]);
-	    priv->iconGeometry.setWidth (geometry[2]);
-	    priv->iconGeometry.setHeight (geometry[3]);
-	}
-
-	XFree (data);
+	priv->iconGeometry.setX (prop.item (0));
+	priv->iconGeometry.setY (prop.item (1));
+	priv->iconGeometry.setWidth (prop.item (2));
+	priv->iconGeometry.setHeight (prop.item (3));
     }
 }
 
@@ -384,28 +431,12 @@ PrivateWindow::getClientLeaderOfAncestor ()
 Window
 PrivateWindow::getClientLeader ()
 {
-    Atom	  actual;
-    int		  result, format;
-    unsigned long n, left;
-    unsigned char *data;
+    PropertyReply prop;
 
-    result = XGetWindowProperty (screen->dpy (), priv->id,
-				 Atoms::wmClientLeader,
-				 0L, 1L, False, XA_WINDOW, &actual, &format,
-				 &n, &left, &data);
-
-    if (result == Success && data)
-    {
-	Window win = None;
-
-	if (n)
-	    memcpy (&win, data, sizeof (Window));
-
-	XFree ((void *) data);
-
-	if (win)
-	    return win;
-    }
+    if (screen->priv->getWindowProperty (priv->id, Atoms::wmClientLeader,
+					 XA_WINDOW, 1L, prop) &&
+	prop.n && prop.item (0))
+	return prop.item (0);
 
     return priv->getClientLeaderOfAncestor ();
 }
@@ -413,28 +444,11 @@ PrivateWindow::getClientLeader ()
 char *
 PrivateWindow::getStartupId ()
 {
-    Atom	  actual;
-    int		  result, format;
-    unsigned long n, left;
-    unsigned char *data;
+    PropertyReply prop;
 
-    result = XGetWindowProperty (screen->dpy (), priv->id,
-				 Atoms::startupId,
-				 0L, 1024L, False,
-				 Atoms::utf8String,
-				 &actual, &format,
-				 &n, &left, &data);
-
-    if (result == Success && data)
-    {
-	char *id = NULL;
-
-	if (n)
-	    id = strdup ((char *) data);
-	XFree ((void *) data);
-
-	return id;
-    }
+    if (screen->priv->getWindowProperty (priv->id, Atoms::startupId,
+					 Atoms::utf8String, 1024L, prop))
+	return prop.copyString ();
 
     return NULL;
 }
@@ -477,10 +491,14 @@ PrivateWindow::setFullscreenMonitors (CompFullscreenMonitorSet *monitors)
 	XChangeProperty (screen->dpy (), id, Atoms::wmFullscreenMonitors,
 			 XA_CARDINAL, 32, PropModeReplace,
 			 (unsigned char *) data, 4);
+
+	screen->priv->invalidateProperty (id, Atoms::wmFullscreenMonitors);
     }
     else if (hadFsMonitors)
     {
 	XDeleteProperty (screen->dpy (), id, Atoms::wmFullscreenMonitors);
+
+	screen->priv->invalidateProperty (id, Atoms::wmFullscreenMonitors);
     }
 
     if (state & CompWindowStateFullscreenMask)
@@ -545,6 +563,8 @@ setWindowActions (CompScreen   *s,
     XChangeProperty (s->dpy (), id, Atoms::wmAllowedActions,
 		     XA_ATOM, 32, PropModeReplace,
 		     (unsigned char *) data, i);
+
+    s->priv->invalidateProperty (id, Atoms::wmAllowedActions);
 }
 
 void
@@ -759,6 +779,9 @@ CompWindow::recalcType ()
     }
 
     priv->type = type;
+
+    screen->priv->updateStackLayer (this);
+    priv->updateMatchGeneration ();
 }
 
 
@@ -932,10 +955,7 @@ PrivateWindow::updateRegion ()
 bool
 CompWindow::updateStruts ()
 {
-    Atom	  actual;
-    int		  result, format;
-    unsigned long n, left;
-    unsigned char *data;
+    PropertyReply prop;
     bool	  hasOld, hasNew;
     CompStruts    oldStrut, newStrut;
 
@@ -975,70 +995,50 @@ CompWindow::updateStruts ()
     newStrut.bottom.width  = screen->width ();
     newStrut.bottom.height = 0;
 
-    result = XGetWindowProperty (screen->dpy (), priv->id,
-				 Atoms::wmStrutPartial,
-				 0L, 12L, false, XA_CARDINAL, &actual, &format,
-				 &n, &left, &data);
-
-    if (result == Success && data)
+    if (screen->priv->getWindowProperty (priv->id, Atoms::wmStrutPartial,
+					 XA_CARDINAL, 12L, prop) &&
+	prop.n == 12)
     {
-	unsigned long *struts = (unsigned long *) data;
+	hasNew = true;
 
-	if (n == 12)
-	{
-	    hasNew = true;
+	newStrut.left.y        = prop.item (4);
+	newStrut.left.width    = prop.item (0);
+	newStrut.left.height   = prop.item (5) - newStrut.left.y + 1;
 
-	    newStrut.left.y        = struts[4];
-	    newStrut.left.width    = struts[0];
-	    newStrut.left.height   = struts[5] - newStrut.left.y + 1;
+	newStrut.right.width   = prop.item (1);
+	newStrut.right.x       = screen->width () - newStrut.right.width;
+	newStrut.right.y       = prop.item (6);
+	newStrut.right.height  = prop.item (7) - newStrut.right.y + 1;
 
-	    newStrut.right.width   = struts[1];
-	    newStrut.right.x       = screen->width () - newStrut.right.width;
-	    newStrut.right.y       = struts[6];
-	    newStrut.right.height  = struts[7] - newStrut.right.y + 1;
-
-	    newStrut.top.x         = struts[8];
-	    newStrut.top.width     = struts[9] - newStrut.top.x + 1;
-	    newStrut.top.height    = struts[2];
-
-	    newStrut.bottom.x      = struts[10];
-	    newStrut.bottom.width  = struts[11] - newStrut.bottom.x + 1;
-	    newStrut.bottom.height = struts[3];
-	    newStrut.bottom.y      = screen->height () - newStrut.bottom.height;
-	}
+	newStrut.top.x         = prop.item (8);
+	newStrut.top.width     = prop.item (9) - newStrut.top.x + 1;
+	newStrut.top.height    = prop.item (2);
 
-	XFree (data);
+	newStrut.bottom.x      = prop.item (10);
+	newStrut.bottom.width  = prop.item (11) - newStrut.bottom.x + 1;
+	newStrut.bottom.height = prop.item (3);
+	newStrut.bottom.y      = screen->height () - newStrut.bottom.height;
     }
 
     if (!hasNew)
     {
-	result = XGetWindowProperty (screen->dpy (), priv->id,
-				     Atoms::wmStrut,
-				     0L, 4L, false, XA_CARDINAL,
-				     &actual, &format, &n, &left, &data);
-
-	if (result == Success && data)
+	if (screen->priv->getWindowProperty (priv->id, Atoms::wmStrut,
+					     XA_CARDINAL, 4L, prop) &&
+	    prop.n == 4)
 	{
-	    unsigned long *struts = (unsigned long *) data;
-
-	    if (n == 4)
-	    {
-		hasNew = true;
-
-		newStrut.left.x        = 0;
-		newStrut.left.width    = struts[0];
+	    hasNew = true;
 
-		newStrut.right.width   = struts[1];
-		newStrut.right.x       = screen->width () - newStrut.right.width;
+	    newStrut.left.x        = 0;
+	    newStrut.left.width    = prop.item (0);
 
-		newStrut.top.y         = 0;
-		newStrut.top.height    = struts[2];
+	    newStrut.right.width   = prop.item (1);
+	    newStrut.right.x       = screen->width () - newStrut.right.width;
 
-		newStrut.bottom.height = struts[3];
-		newStrut.bottom.y      = screen->height () - newStrut.bottom.height;
-	    }
+	    newStrut.top.y         = 0;
+	    newStrut.top.height    = prop.item (2);
 
-	    XFree (data);
+	    newStrut.bottom.height = prop.item (3);
+	    newStrut.bottom.y      = screen->height () - newStrut.bottom.height;
 	}
     }
 
@@ -1127,6 +1127,12 @@ CompWindow::updateStruts ()
 	    priv->struts = NULL;
 	}
 
+	if (hasOld)
+	    screen->priv->markStruts (&oldStrut);
+
+	screen->priv->markStruts (priv->struts);
+	screen->priv->updateStrutIndex (this);
+
 	return true;
     }
 
@@ -1174,8 +1180,15 @@ CompWindow::destroy ()
 
     screen->priv->eraseWindowFromMap (id ());
 
+    /* not in eraseWindowFromMap, restacking goes through that too */
+    if (id () != 1)
+	screen->priv->forgetProperties (id ());
+
     priv->id = 1;
     priv->mapNum = 0;
+    priv->updateMatchGeneration ();
+
+    screen->priv->updateClientList (this);
 
     priv->destroyRefCnt--;
     if (priv->destroyRefCnt)
@@ -1260,7 +1273,10 @@ CompWindow::map ()
     priv->mapNum = screen->priv->mapNum++;
 
     if (priv->struts)
+    {
+	screen->priv->markStruts (priv->struts);
 	screen->updateWorkarea ();
+    }
 
     if (windowClass () == InputOnly)
 	return;
@@ -1280,7 +1296,7 @@ CompWindow::map ()
     priv->updateRegion ();
     priv->updateSize ();
 
-    screen->priv->updateClientList ();
+    screen->priv->updateClientList (this);
 
     if (priv->type & CompWindowTypeDesktopMask)
 	screen->priv->desktopWindowCount++;
@@ -1321,7 +1337,10 @@ CompWindow::unmap ()
 	return;
 
     if (priv->struts)
+    {
+	screen->priv->markStruts (priv->struts);
 	screen->updateWorkarea ();
+    }
 
     if (priv->attrib.map_state != IsViewable)
 	return;
@@ -1338,11 +1357,45 @@ CompWindow::unmap ()
 		priv->attrib.width, ++priv->attrib.height - 1,
 		priv->attrib.border_width);
 
-    screen->priv->updateClientList ();
+    screen->priv->updateClientList (this);
 
     windowNotify (CompWindowNotifyUnmap);
 }
 
+/* anything a match can test about this window may have changed, which
+   makes every result cached for its previous generation stale */
+void
+PrivateWindow::updateMatchGeneration ()
+{
+    matchGeneration = screen->priv->matchGeneration++;
+}
+
+unsigned int
+PrivateWindow::matchGenerationOf (CompWindow *w)
+{
+    return w->priv->matchGeneration;
+}
+
+unsigned int
+PrivateWindow::getStackLayer ()
+{
+    if (window->overrideRedirect ())
+	return StackLayerOverrideRedirect;
+
+    if (type & CompWindowTypeDesktopMask)
+	return StackLayerDesktop;
+    else if (type & CompWindowTypeDockMask)
+	return StackLayerDock;
+    else if (type & CompWindowTypeFullscreenMask)
+	return StackLayerFullscreen;
+    else if (state & CompWindowStateAboveMask)
+	return StackLayerAbove;
+    else if (state & CompWindowStateBelowMask)
+	return StackLayerBelow;
+
+    return StackLayerNormal;
+}
+
 bool
 PrivateWindow::restack (Window aboveId)
 {
@@ -1361,7 +1414,7 @@ PrivateWindow::restack (Window aboveId)
     screen->unhookWindow (window);
     screen->insertWindow (window, aboveId);
 
-    screen->priv->updateClientList ();
+    screen->priv->updateClientList (window);
 
     window->windowNotify (CompWindowNotifyRestack);
 
@@ -1564,7 +1617,13 @@ PrivateWindow::configure (XConfigureEvent *ce)
     if (priv->frame)
 	return;
 
-    priv->attrib.override_redirect = ce->override_redirect;
+    if (priv->attrib.override_redirect != ce->override_redirect)
+    {
+	priv->attrib.override_redirect = ce->override_redirect;
+	screen->priv->updateStackLayer (window);
+	screen->priv->updateClientList (window);
+	updateMatchGeneration ();
+    }
 
     if (priv->syncWait)
     {
@@ -2022,16 +2081,55 @@ PrivateWindow::avoidStackingRelativeTo (CompWindow *w)
     return false;
 }
 
-/* goes through the stack, top-down until we find a window we should
-   stack above, normal windows can be stacked above fullscreen windows
-   (and fullscreen windows over others in their layer) if aboveFs is true. */
+/* topmost window of the given layers with a stack key between low and
+   high (both excluded) that passes check */
+template <typename Check>
 CompWindow *
-PrivateWindow::findSiblingBelow (CompWindow *w,
-				 bool       aboveFs)
+PrivateWindow::stackSearchDown (unsigned int       layers,
+				unsigned long long low,
+				unsigned long long high,
+				const Check        &check)
+{
+    return stackLayerSearchDown (screen->priv->stackLayers, StackLayerCount,
+				 layers, low, high, check);
+}
+
+/* same as stackSearchDown but for the bottommost window */
+template <typename Check>
+CompWindow *
+PrivateWindow::stackSearchUp (unsigned int       layers,
+			      unsigned long long low,
+			      unsigned long long high,
+			      const Check        &check)
+{
+    return stackLayerSearchUp (screen->priv->stackLayers, StackLayerCount,
+			       layers, low, high, check);
+}
+
+bool
+PrivateWindow::stackCheckType (unsigned int mask,
+			       CompWindow   *w)
+{
+    return (w->priv->type & mask);
+}
+
+bool
+PrivateWindow::stackableSibling (CompWindow *w,
+				 CompWindow *sibling)
+{
+    return (sibling != w && !avoidStackingRelativeTo (sibling));
+}
+
+/* whether w may be stacked right above below, normal windows can be
+   stacked above fullscreen windows (and fullscreen windows over others
+   in their layer) if aboveFs is true. */
+bool
+PrivateWindow::siblingBelowCheck (CompWindow   *w,
+				  Window       clientLeader,
+				  unsigned int type,
+				  bool         aboveFs,
+				  CompWindow   *below)
 {
-    CompWindow   *below;
-    Window	 clientLeader = w->priv->clientLeader;
-    unsigned int type = w->priv->type;
     unsigned int belowMask;
 
     if (aboveFs)
@@ -2039,6 +2137,57 @@ PrivateWindow::findSiblingBelow (CompWindow *w,
     else
 	belowMask = CompWindowTypeDockMask | CompWindowTypeFullscreenMask;
 
+    if (below == w || avoidStackingRelativeTo (below))
+	return false;
+
+    /* always above desktop windows */
+    if (below->priv->type & CompWindowTypeDesktopMask)
+	return true;
+
+    switch (type) {
+    case CompWindowTypeDesktopMask:
+	/* desktop window layer */
+	break;
+    case CompWindowTypeFullscreenMask:
+	if (aboveFs)
+	    return true;
+	/* otherwise fall-through */
+    case CompWindowTypeDockMask:
+	/* fullscreen and dock layer */
+	if (below->priv->type & (CompWindowTypeFullscreenMask |
+				 CompWindowTypeDockMask))
+	{
+	    if (stackLayerCheck (w, clientLeader, below))
+		return true;
+	}
+	else
+	{
+	    return true;
+	}
+	break;
+    default:
+	/* fullscreen and normal layer */
+	if (!(below->priv->type & belowMask))
+	{
+	    if (stackLayerCheck (w, clientLeader, below))
+		return true;
+	}
+	break;
+    }
+
+    return false;
+}
+
+/* finds the topmost window we should stack above, only the layers that
+   can hold such a window are searched. */
+CompWindow *
+PrivateWindow::findSiblingBelow (CompWindow *w,
+				 bool       aboveFs)
+{
+    Window	 clientLeader = w->priv->clientLeader;
+    unsigned int type = w->priv->type;
+    unsigned int layers = STACK_LAYER_MANAGED;
+
     /* normal stacking of fullscreen windows with below state */
     if ((type & CompWindowTypeFullscreenMask) &&
 	(w->priv->state & CompWindowStateBelowMask))
@@ -2047,59 +2196,80 @@ PrivateWindow::findSiblingBelow (CompWindow *w,
     if (w->priv->transientFor || w->priv->isGroupTransient (clientLeader))
 	clientLeader = None;
 
-    for (below = screen->windows ().back (); below;
-	 below = below->prev)
-    {
-	if (below == w || avoidStackingRelativeTo (below))
-	    continue;
+    switch (type) {
+    case CompWindowTypeDesktopMask:
+	layers = STACK_LAYER_MASK (StackLayerDesktop);
+	break;
+    case CompWindowTypeFullscreenMask:
+    case CompWindowTypeDockMask:
+	break;
+    default:
+	layers &= ~STACK_LAYER_MASK (StackLayerDock);
+	if (!aboveFs)
+	    layers &= ~STACK_LAYER_MASK (StackLayerFullscreen);
+	break;
+    }
 
-	/* always above desktop windows */
-	if (below->priv->type & CompWindowTypeDesktopMask)
-	    return below;
+    return stackSearchDown (layers, 0, ~0ULL,
+			    boost::bind (siblingBelowCheck, w, clientLeader,
+					 type, aboveFs, _1));
+}
 
-	switch (type) {
-	case CompWindowTypeDesktopMask:
-	    /* desktop window layer */
-	    break;
-	case CompWindowTypeFullscreenMask:
-	    if (aboveFs)
-		return below;
-	    /* otherwise fall-through */
-	case CompWindowTypeDockMask:
-	    /* fullscreen and dock layer */
-	    if (below->priv->type & (CompWindowTypeFullscreenMask |
-			       CompWindowTypeDockMask))
-	    {
-		if (stackLayerCheck (w, clientLeader, below))
-		    return below;
-	    }
-	    else
-	    {
-		return below;
-	    }
-	    break;
-	default:
-	    /* fullscreen and normal layer */
-	    if (!(below->priv->type & belowMask))
-	    {
-		if (stackLayerCheck (w, clientLeader, below))
-		    return below;
-	    }
-	    break;
+/* whether below is a window w can't be stacked under */
+bool
+PrivateWindow::lowestSiblingStop (CompWindow   *w,
+				  Window       clientLeader,
+				  unsigned int type,
+				  CompWindow   *below)
+{
+    if (below == w || avoidStackingRelativeTo (below))
+	return false;
+
+    /* always above desktop windows */
+    if (below->priv->type & CompWindowTypeDesktopMask)
+	return true;
+
+    switch (type) {
+    case CompWindowTypeDesktopMask:
+	/* desktop window layer - desktop windows always should be
+	   stacked at the bottom; no other window should be below them */
+	return true;
+    case CompWindowTypeFullscreenMask:
+    case CompWindowTypeDockMask:
+	/* fullscreen and dock layer */
+	if (below->priv->type & (CompWindowTypeFullscreenMask |
+				 CompWindowTypeDockMask))
+	{
+	    if (!stackLayerCheck (below, clientLeader, w))
+		return true;
 	}
+	else
+	{
+	    return true;
+	}
+	break;
+    default:
+	/* fullscreen and normal layer */
+	if (!(below->priv->type & CompWindowTypeDockMask))
+	{
+	    if (!stackLayerCheck (below, clientLeader, w))
+		return true;
+	}
+	break;
     }
 
-    return NULL;
+    return false;
 }
 
-/* goes through the stack, top-down and returns the lowest window we
-   can stack above. */
+/* returns the lowest window we can stack above, that is the one right
+   above the topmost window we can't be stacked under. */
 CompWindow *
 PrivateWindow::findLowestSiblingBelow (CompWindow *w)
 {
-    CompWindow   *below, *lowest = screen->windows ().back ();
+    CompWindow   *stop, *lowest;
     Window	 clientLeader = w->priv->clientLeader;
     unsigned int type = w->priv->type;
+    unsigned int layers = STACK_LAYER_MANAGED;
 
     /* normal stacking fullscreen windows with below state */
     if ((type & CompWindowTypeFullscreenMask) &&
@@ -2109,49 +2279,40 @@ PrivateWindow::findLowestSiblingBelow (CompWindow *w)
     if (w->priv->transientFor || w->priv->isGroupTransient (clientLeader))
 	clientLeader = None;
 
-    for (below = screen->windows ().back (); below;
-	 below = below->prev)
-    {
-	if (below == w || avoidStackingRelativeTo (below))
-	    continue;
+    switch (type) {
+    case CompWindowTypeDesktopMask:
+    case CompWindowTypeFullscreenMask:
+    case CompWindowTypeDockMask:
+	break;
+    default:
+	layers &= ~STACK_LAYER_MASK (StackLayerDock);
+	break;
+    }
+
+    stop = stackSearchDown (layers, 0, ~0ULL,
+			    boost::bind (lowestSiblingStop, w, clientLeader,
+					 type, _1));
 
-	/* always above desktop windows */
-	if (below->priv->type & CompWindowTypeDesktopMask)
-	    return below;
+    if (stop)
+    {
+	if (stop->priv->type & CompWindowTypeDesktopMask)
+	    return stop;
 
-	switch (type) {
-	case CompWindowTypeDesktopMask:
-	    /* desktop window layer - desktop windows always should be
-	       stacked at the bottom; no other window should be below them */
+	if (type == CompWindowTypeDesktopMask)
 	    return NULL;
-	    break;
-	case CompWindowTypeFullscreenMask:
-	case CompWindowTypeDockMask:
-	    /* fullscreen and dock layer */
-	    if (below->priv->type & (CompWindowTypeFullscreenMask |
-			       CompWindowTypeDockMask))
-	    {
-		if (!stackLayerCheck (below, clientLeader, w))
-		    return lowest;
-	    }
-	    else
-	    {
-		return lowest;
-	    }
-	    break;
-	default:
-	    /* fullscreen and normal layer */
-	    if (!(below->priv->type & CompWindowTypeDockMask))
-	    {
-		if (!stackLayerCheck (below, clientLeader, w))
-		    return lowest;
-	    }
-	    break;
-	}
 
-	lowest = below;
+	lowest = stackSearchUp (STACK_LAYER_MANAGED, stop->priv->stackKey,
+				~0ULL, boost::bind (stackableSibling, w, _1));
+    }
+    else
+    {
+	lowest = stackSearchUp (STACK_LAYER_MANAGED, 0, ~0ULL,
+				boost::bind (stackableSibling, w, _1));
     }
 
+    if (!lowest)
+	lowest = screen->windows ().back ();
+
     return lowest;
 }
 
@@ -3016,17 +3177,25 @@ PrivateWindow::addWindowStackChanges (XWindowChanges *xwc,
 			  CompWindowTypeDockMask))) &&
 	    !isAncestorTo (window, sibling))
 	{
-	    CompWindow *dw;
-
-	    for (dw = screen->windows ().back (); dw; dw = dw->prev)
-		if (dw == sibling)
-		    break;
+	    CompWindow         *dw;
+	    unsigned long long key = sibling->priv->stackKey + 1;
+	    unsigned int       layers =
+		STACK_LAYER_MASK (StackLayerDock) |
+		STACK_LAYER_MASK (StackLayerOverrideRedirect);
 
 	    /* Collect all dock windows first */
 	    CompWindowList dockWindows;
-	    for (; dw; dw = dw->prev)
-		if (dw->priv->type & CompWindowTypeDockMask)
+	    if (sibling->priv->stackKey)
+	    {
+		while ((dw = stackSearchDown (layers, 0, key,
+					      boost::bind (stackCheckType,
+							   CompWindowTypeDockMask,
+							   _1))))
+		{
 		    dockWindows.push_back (dw);
+		    key = dw->priv->stackKey;
+		}
+	    }
 
 	    /* Then update the dock windows */
 	    foreach (CompWindow *dw, dockWindows)
@@ -3109,6 +3278,8 @@ CompWindow::lower ()
 	CompWindow *focusedWindow = screen->priv->focusTopMostWindow ();
 	screen->insertWindow (this , aboveId);
 
+	screen->priv->updateClientList (this);
+
 	/* if the newly focused window is a desktop window,
 	   give the focus back to w */
 	if (focusedWindow &&
@@ -3137,43 +3308,58 @@ CompWindow::restackAbove (CompWindow *sibling)
     }
 }
 
+bool
+PrivateWindow::invalidSiblingBelow (CompWindow *w,
+				    CompWindow *sibling)
+{
+    return (stackableSibling (w, sibling) && !validSiblingBelow (w, sibling));
+}
+
 /* finds the highest window under sibling we can stack above */
 CompWindow *
 PrivateWindow::findValidStackSiblingBelow (CompWindow *w,
 					   CompWindow *sibling)
 {
-    CompWindow *lowest, *last, *p;
+    CompWindow         *lowest, *invalid, *p;
+    unsigned long long high = ~0ULL;
 
     /* get lowest sibling we're allowed to stack above */
-    lowest = last = findLowestSiblingBelow (w);
+    lowest = findLowestSiblingBelow (w);
+
+    /* only windows under sibling are considered */
+    if (sibling && sibling->priv->stackKey)
+	high = sibling->priv->stackKey;
 
-    /* walk from bottom up */
-    for (p = screen->windows ().front (); p; p = p->next)
+    /* going up from the bottom, lowest follows the windows we're allowed
+       to stack above until the first one we're not allowed to */
+    invalid = stackSearchUp (STACK_LAYER_MANAGED, 0, high,
+			     boost::bind (invalidSiblingBelow, w, _1));
+    if (!invalid)
     {
-	/* stop walking when we reach the sibling we should try to stack
-	   below */
-	if (p == sibling)
-	    return lowest;
+	p = stackSearchDown (STACK_LAYER_MANAGED, 0, high,
+			     boost::bind (stackableSibling, w, _1));
+	return p ? p : lowest;
+    }
 
-	/* skip windows that we should avoid */
-	if (w == p || avoidStackingRelativeTo (p))
-	    continue;
+    p = stackSearchDown (STACK_LAYER_MANAGED, 0, invalid->priv->stackKey,
+			 boost::bind (stackableSibling, w, _1));
+    if (p)
+	return p;
 
-	if (validSiblingBelow (w, p))
-	{
-	    /* update lowest as we find windows below sibling that we're
-	       allowed to stack above. last window must be equal to the
-	       lowest as we shouldn't update lowest if we passed an
-	       invalid window */
-	    if (last == lowest)
-		lowest = p;
-	}
+    /* the bottommost window already is one we can't stack above, lowest
+       only moves on if we pass it on the way up to sibling */
+    if (!lowest || !lowest->priv->stackKey ||
+	lowest->priv->stackKey >= high || !stackableSibling (w, lowest))
+	return lowest;
 
-	/* update last pointer */
-	last = p;
-    }
+    invalid = stackSearchUp (STACK_LAYER_MANAGED, lowest->priv->stackKey,
+			     high, boost::bind (invalidSiblingBelow, w, _1));
 
-    return lowest;
+    p = stackSearchDown (STACK_LAYER_MANAGED, lowest->priv->stackKey,
+			 invalid ? invalid->priv->stackKey : high,
+			 boost::bind (stackableSibling, w, _1));
+
+    return p ? p : lowest;
 }
 
 void
@@ -3236,11 +3422,10 @@ CompWindow::updateAttributes (CompStackingUpdateMode stackingMode)
 	if (sibling &&
 	    (stackingMode == CompStackingUpdateModeInitialMapDeniedFocus))
 	{
-	    CompWindow *p;
+	    CompWindow *p = screen->findWindow (screen->activeWindow ());
 
-	    for (p = sibling; p; p = p->prev)
-		if (p->priv->id == screen->activeWindow ())
-		    break;
+	    if (p && p->priv->stackKey > sibling->priv->stackKey)
+		p = NULL;
 
 	    /* window is above active window so we should lower it */
 	    if (p)
@@ -3358,6 +3543,7 @@ CompWindow::activate ()
     if (priv->state & CompWindowStateHiddenMask)
     {
 	priv->state &= ~CompWindowStateShadedMask;
+	priv->updateMatchGeneration ();
 	if (priv->shaded)
 	    priv->show ();
     }
@@ -3722,32 +3908,16 @@ CompWindow::maximize (unsigned int state)
 bool
 PrivateWindow::getUserTime (Time& time)
 {
-    Atom	  actual;
-    int		  result, format;
-    unsigned long n, left;
-    unsigned char *data;
-    bool          retval = false;
+    PropertyReply prop;
 
-    result = XGetWindowProperty (screen->dpy (), priv->id,
-				 Atoms::wmUserTime,
-				 0L, 1L, False, XA_CARDINAL, &actual, &format,
-				 &n, &left, &data);
-
-    if (result == Success && data)
+    if (screen->priv->getWindowProperty (priv->id, Atoms::wmUserTime,
+					 XA_CARDINAL, 1L, prop) && prop.n)
     {
-	if (n)
-	{
-	    CARD32 value;
-
-	    memcpy (&value, data, sizeof (CARD32));
-	    retval = true;
-	    time   = (Time) value;
-	}
-
-	XFree ((void *) data);
+	time = (Time) prop.item (0);
+	return true;
     }
 
-    return retval;
+    return false;
 }
 
 void
@@ -3759,6 +3929,8 @@ PrivateWindow::setUserTime (Time time)
 		     Atoms::wmUserTime,
 		     XA_CARDINAL, 32, PropModeReplace,
 		     (unsigned char *) &value, 1);
+
+    screen->priv->invalidateProperty (priv->id, Atoms::wmUserTime);
 }
 
 /*
@@ -4889,11 +5061,24 @@ CompWindow::CompWindow (Window id,
     priv = new PrivateWindow (this);
     assert (priv);
 
+    /* select for property changes before anything is read, so that
+       nothing changing after the prefetch goes unnoticed */
+    XSelectInput (screen->dpy (), id,
+		  PropertyChangeMask |
+		  EnterWindowMask    |
+		  FocusChangeMask);
+
+    screen->priv->watchProperties (id);
+
+    /* request everything read below at once, the replies are collected
+       as they are needed */
+    screen->priv->prefetchWindow (id);
+
     /* Failure means that window has been destroyed. We still have to add the
        window to the window list as we might get configure requests which
        require us to stack other windows relative to it. Setting some default
        values if this is the case. */
-    if (!XGetWindowAttributes (screen->dpy (), id, &priv->attrib))
+    if (!screen->priv->getWindowAttributes (id, &priv->attrib))
 	setDefaultWindowAttributes (&priv->attrib);
 
     priv->serverGeometry.set (priv->attrib.x, priv->attrib.y,
@@ -4916,11 +5101,6 @@ CompWindow::CompWindow (Window id,
     priv->transientFor = None;
     priv->clientLeader = None;
 
-    XSelectInput (screen->dpy (), id,
-		  PropertyChangeMask |
-		  EnterWindowMask    |
-		  FocusChangeMask);
-
     priv->id = id;
 
     /*XGrabButton (screen->dpy (), AnyButton, AnyModifier, priv->id, true,
@@ -5029,6 +5209,7 @@ CompWindow::CompWindow (Window id,
 	    priv->hidden || priv->shaded)
 	{
 	    priv->state |= CompWindowStateHiddenMask;
+	    priv->updateMatchGeneration ();
 
 	    priv->pendingUnmaps++;
 
@@ -5059,6 +5240,9 @@ CompWindow::CompWindow (Window id,
 	}
     }
 
+    /* core might have changed some of the prefetched properties by now */
+    screen->priv->finishPrefetch (id);
+
     /* TODO: bailout properly when objectInitPlugins fails */
     assert (CompPlugin::windowInitPlugins (this));
 
@@ -5079,6 +5263,7 @@ CompWindow::CompWindow (Window id,
 CompWindow::~CompWindow ()
 {
     screen->unhookWindow (this);
+    screen->priv->strutWindows.remove (this);
 
     if (!priv->destroyed)
     {
@@ -5107,6 +5292,8 @@ CompWindow::~CompWindow ()
 	if (priv->id != screen->priv->grabWindow)
 	    XSelectInput (screen->dpy (), priv->id, NoEventMask);
 
+	screen->priv->forgetProperties (priv->id);
+
 	XUngrabButton (screen->dpy (), AnyButton, AnyModifier, priv->id);
     }
 
@@ -5116,11 +5303,14 @@ CompWindow::~CompWindow ()
 	    screen->priv->desktopWindowCount--;
 
 	if (priv->destroyed && priv->struts)
+	{
+	    screen->priv->markStruts (priv->struts);
 	    screen->updateWorkarea ();
+	}
     }
 
-    if (priv->destroyed)
-	screen->priv->updateClientList ();
+    /* unhooked already, this only drops it from the client lists */
+    screen->priv->updateClientList (this);
 
     CompPlugin::windowFiniPlugins (this);
 
@@ -5134,8 +5324,12 @@ PrivateWindow::PrivateWindow (CompWindow *window) :
     id (None),
     frame (None),
     wrapper (None),
+    stackPos (),
+    stackKey (0),
+    stackLayer (StackLayerNormal),
     mapNum (0),
     activeNum (0),
+    matchGeneration (screen->priv->matchGeneration++),
     transientFor (None),
     clientLeader (None),
     hints (NULL),
@@ -5273,6 +5467,8 @@ PrivateWindow::setOverrideRedirect (bool overrideRedirect)
     window->recalcType ();
     window->recalcActions ();
 
+    screen->priv->updateClientList (window);
+
     screen->matchPropertyChanged (window);
 }
 
@@ -5398,6 +5594,8 @@ CompWindow::setWindowFrameExtents (CompWindowExtents *i)
 			 Atoms::frameExtents,
 			 XA_CARDINAL, 32, PropModeReplace,
 			 (unsigned char *) data, 4);
+
+	screen->priv->invalidateProperty (priv->id, Atoms::frameExtents);
     }
 }
 
@@ -5418,7 +5616,6 @@ PrivateWindow::reparent ()
     XWindowAttributes    wa;
     XWindowChanges       xwc;
     int                  mask;
-    XEvent               e;
     CompWindow::Geometry sg = serverGeometry;
     Display              *dpy = screen->dpy ();
     
@@ -5429,11 +5626,8 @@ PrivateWindow::reparent ()
 
     XSync (dpy, false);
 
-    if (XCheckTypedWindowEvent (dpy, id, DestroyNotify, &e))
-    {
-        XPutBackEvent (dpy, &e);
-        return false;
-    }
+    if (screen->priv->hasPendingWindowEvent (id, DestroyNotify))
+	return false;
 
     XGrabServer (dpy);
     XChangeSaveSet (dpy, id, SetModeInsert);
@@ -5459,6 +5653,8 @@ PrivateWindow::reparent ()
 			    sg.width (), sg.height (), 0, attrib.depth,
 			    InputOutput, attrib.visual, mask, &attr);
 
+    screen->priv->frameIndex.insert (frame, window);
+
     XGrabButton (dpy, AnyButton, AnyModifier, frame, true,
 		 ButtonPressMask | ButtonReleaseMask | ButtonMotionMask,
 		 GrabModeSync, GrabModeSync, None, None);
@@ -5515,7 +5711,6 @@ PrivateWindow::unreparent ()
 {
   return; // TUX
     Display        *dpy = screen->dpy ();
-    XEvent         e;
     bool           alive = true;
     XWindowChanges xwc;
 
@@ -5524,11 +5719,8 @@ PrivateWindow::unreparent ()
 
     XSync (dpy, false);
 
-    if (XCheckTypedWindowEvent (dpy, id, DestroyNotify, &e))
-    {
-        XPutBackEvent (dpy, &e);
-        alive = false;
-    }
+    if (screen->priv->hasPendingWindowEvent (id, DestroyNotify))
+	alive = false;
 
     if ((!destroyed) && alive)
     {
@@ -5568,6 +5760,8 @@ PrivateWindow::unreparent ()
 	XMoveWindow (dpy, id, serverGeometry.x (), serverGeometry.y ());
     }
 
+    screen->priv->frameIndex.remove (frame);
+
     XDestroyWindow (dpy, wrapper);
     XDestroyWindow (dpy, frame);
     wrapper = None;
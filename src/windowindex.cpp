@@ -0,0 +1,179 @@
+/*
+ * Copyright © 2008 Dennis Kasprzyk
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the name of
+ * Dennis Kasprzyk not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior permission.
+ * Dennis Kasprzyk makes no representations about the suitability of this
+ * software for any purpose. It is provided "as is" without express or
+ * implied warranty.
+ *
+ * DENNIS KASPRZYK DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL DENNIS KASPRZYK BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION
+ * WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Authors: Dennis Kasprzyk <onestone@compiz-fusion.org>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "privatewindowindex.h"
+
+#define WINDOW_INDEX_MIN_BITS 6
+
+WindowIndex::WindowIndex () :
+    slots (NULL),
+    mask (0),
+    shift (0),
+    count (0)
+{
+}
+
+WindowIndex::~WindowIndex ()
+{
+    free (slots);
+}
+
+/* X resource ids only differ in their low bits within one client, a
+   fibonacci hash spreads them over the whole table */
+unsigned int
+WindowIndex::slot (Window id) const
+{
+    unsigned long long h = (unsigned long long) id * 0x9e3779b97f4a7c15ULL;
+
+    return (unsigned int) (h >> shift) & mask;
+}
+
+CompWindow *
+WindowIndex::find (Window id) const
+{
+    if (!count || !id)
+	return NULL;
+
+    for (unsigned int i = slot (id); slots[i].id; i = (i + 1) & mask)
+	if (slots[i].id == id)
+	    return slots[i].window;
+
+    return NULL;
+}
+
+void
+WindowIndex::grow ()
+{
+    Slot         *old = slots;
+    unsigned int oldSize = old ? mask + 1 : 0;
+    unsigned int bits = WINDOW_INDEX_MIN_BITS;
+
+    while ((1u << bits) < (count + 1) * 2)
+	bits++;
+
+    slots = (Slot *) calloc (1u << bits, sizeof (Slot));
+    if (!slots)
+    {
+	slots = old;
+	return;
+    }
+
+    mask  = (1u << bits) - 1;
+    shift = 64 - bits;
+
+    for (unsigned int i = 0; i < oldSize; i++)
+    {
+	if (!old[i].id)
+	    continue;
+
+	unsigned int j = slot (old[i].id);
+
+	while (slots[j].id)
+	    j = (j + 1) & mask;
+
+	slots[j] = old[i];
+    }
+
+    free (old);
+}
+
+void
+WindowIndex::insert (Window id, CompWindow *w)
+{
+    if (!id)
+	return;
+
+    if (!slots || (count + 1) * 2 > mask + 1)
+    {
+	grow ();
+	if (!slots)
+	    return;
+    }
+
+    unsigned int i = slot (id);
+
+    while (slots[i].id && slots[i].id != id)
+	i = (i + 1) & mask;
+
+    if (!slots[i].id)
+    {
+	slots[i].id = id;
+	count++;
+    }
+
+    slots[i].window = w;
+}
+
+void
+WindowIndex::remove (Window id)
+{
+    if (!count || !id)
+	return;
+
+    unsigned int i = slot (id);
+
+    while (slots[i].id != id)
+    {
+	if (!slots[i].id)
+	    return;
+
+	i = (i + 1) & mask;
+    }
+
+    /* pull back every following entry of the cluster that would no
+       longer be reachable from its home slot once i is emptied */
+    for (unsigned int j = (i + 1) & mask; slots[j].id; j = (j + 1) & mask)
+    {
+	unsigned int home = slot (slots[j].id);
+
+	if (((j - home) & mask) >= ((j - i) & mask))
+	{
+	    slots[i] = slots[j];
+	    i = j;
+	}
+    }
+
+    slots[i].id     = None;
+    slots[i].window = NULL;
+    count--;
+}
+
+void
+WindowIndex::clear ()
+{
+    if (slots)
+	memset (slots, 0, (mask + 1) * sizeof (Slot));
+
+    count = 0;
+}
+
+unsigned int
+WindowIndex::size () const
+{
+    return count;
+}